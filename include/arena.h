@@ -0,0 +1,54 @@
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (1 << 20)
+#define ARENA_ALIGNMENT 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock* next;
+    size_t capacity;
+    size_t offset;
+} ArenaBlock;
+
+// Bump allocator for sim-lifetime objects, reset in O(1) between modes
+typedef struct {
+    ArenaBlock* head;
+    ArenaBlock* current;
+    size_t in_use;
+    size_t high_water;
+    size_t reserved;
+} Arena;
+
+// Allocation point to rewind to, everything allocated after it is dropped at once
+typedef struct {
+    ArenaBlock* block;
+    size_t offset;
+    size_t in_use;
+} ArenaMark;
+
+typedef struct PoolItem {
+    struct PoolItem* next;
+} PoolItem;
+
+// Fixed size free-list on top of an arena
+typedef struct {
+    Arena* arena;
+    size_t item_size;
+    PoolItem* free_list;
+} Pool;
+
+// Function declarations
+// ---------------------
+void* arena_alloc(Arena* a, size_t size);
+void arena_reset(Arena* a);
+ArenaMark arena_mark(const Arena* a);
+void arena_rewind(Arena* a, ArenaMark mark);
+void arena_free(Arena* a);
+
+void pool_init(Pool* p, Arena* a, size_t item_size);
+void* pool_alloc(Pool* p);
+void pool_free(Pool* p, void* item);
+
+#endif  // ARENA_H
@@ -0,0 +1,9 @@
+#ifndef _ARGS_H
+#define _ARGS_H
+
+// Function declarations
+// ---------------------
+void usage(void);
+void get_arguments(int argc, char **argv);
+
+#endif  // ARGS_H
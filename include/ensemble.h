@@ -0,0 +1,36 @@
+#ifndef _ENSEMBLE_H
+#define _ENSEMBLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim2d.h"
+
+#define DEFAULT_ENSEMBLE_FRAMES 600
+#define DEFAULT_ENSEMBLE_CSV_PATH "ensemble.csv"
+#define MAX_ENSEMBLE_WORLDS 1000000
+#define MAX_ENSEMBLE_FRAMES 1000000
+#define ENSEMBLE_BATCH 16            // worlds a thread claims at once
+#define ENSEMBLE_LANES 4             // small voronoi worlds stepped together, one per SSE lane
+#define ENSEMBLE_LANE_MAX_SEEDS 256  // worlds up to this size test every pair instead of using the map
+
+// Summary of one world after its last frame, written as one CSV row
+typedef struct {
+    uint64_t rng_seed;
+    double energy;
+    double mean_speed;
+    vec2 centroid;
+    double spread;  // RMS distance from the centroid
+    double ms;
+    SimCounters counters;
+} EnsembleResult;
+
+extern size_t ENSEMBLE_WORLDS;
+extern size_t ENSEMBLE_FRAMES;
+extern const char* ENSEMBLE_CSV_PATH;
+
+// Function declarations
+// ---------------------
+void run_ensemble(void);
+
+#endif  // ENSEMBLE_H
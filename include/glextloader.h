@@ -37,6 +37,8 @@ extern PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus;
 extern PFNGLUNIFORM1IPROC glUniform1i;
 extern PFNGLDRAWBUFFERSPROC glDrawBuffers;
 extern PFNGLUNIFORM4FPROC glUniform4f;
+extern PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
+extern PFNGLUNMAPBUFFERPROC glUnmapBuffer;
 
 // TODO: there is something fishy with Windows gl.h header
 // Let's try to ship our own gl.h just like glext.h
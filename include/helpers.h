@@ -2,6 +2,9 @@
 #define _HELPERS_H
 
 #include <stdbool.h>
+#include <stdint.h>
+
+#include "vec2.h"
 
 // Macros
 #define UNREACHABLE(message)                                                      \
@@ -11,39 +14,21 @@
     } while (0)
 #define UNUSED(x) (void)(x) 
 
+// Counter based random numbers, every simulation draws from its own. Batches of independent items give each
+// item its own stream so they can be drawn in any order and on any thread
 typedef struct {
-    float x, y;
-} vec2;
-
-typedef struct {
-    float x, y, z, w;
-} vec4;
+    uint64_t seed;
+    uint64_t counter;
+} Rng;
 
 // Function declarations
 // ---------------------
-void usage(void);
-void get_arguments(int argc, char **argv);
-void init_signal_handler(void);
-
-float rand_float(void);
+double now_ms(void);
+void seed_rng(Rng* rng, uint64_t seed);
+float rand_float(Rng* rng);
+Rng rng_stream(const Rng* rng, uint64_t index);
 float lerpf(float start, float end, float t);
 
-float vec2_sqr_dist(vec2 v1, vec2 v2);
-float vec2_dist(vec2 v1, vec2 v2);
-float vec2_sqr_mag(vec2 v);
-float vec2_mag(vec2 v);
-float vec2_dot(vec2 v1, vec2 v2);
-
-vec2 vec2_mul(vec2 v1, vec2 v2);
-vec2 vec2_add(vec2 v1, vec2 v2);
-vec2 vec2_sub(vec2 v1, vec2 v2);
-vec2 vec2_scale(vec2 v, float s);
-vec2 vec2_normalize(vec2 v);
-vec2 vec2_unit_normal(vec2 v1, vec2 v2);
-vec2 vec2_unit_tangent(vec2 v1, vec2 v2);
-
-bool vec2_is_zero(vec2 v);
-
 void collision_sim_0(vec2 pos1, vec2 pos2, float r1, float r2, vec2* vel1, vec2* vel2);
 void collision_sim_1(vec2 pos1, vec2 pos2, float m1, float m2, vec2* vel1, vec2* vel2);
 
@@ -0,0 +1,43 @@
+#ifndef _HISTORY_H
+#define _HISTORY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define DEFAULT_HISTORY_MB 0
+#define MAX_HISTORY_MB 16384
+#define HISTORY_MAX_ENTRIES (1 << 16)
+#define HISTORY_KEYFRAME_INTERVAL 16  // deltas per keyframe, deltas grow as the state drifts away from it
+
+// One saved state, keyframes hold the raw words and deltas the XOR against their keyframe
+typedef struct {
+    size_t offset;
+    size_t size;
+    size_t count;       // words in the state
+    uint64_t keyframe;  // sequence number of the keyframe a delta decodes against, its own for keyframes
+} HistoryEntry;
+
+// Ring of saved states, every simulation owns one. Zeroed it is disabled
+typedef struct {
+    uint8_t* bytes;  // ring of records, a record never wraps around the end
+    size_t capacity;
+    HistoryEntry* entries;
+    uint64_t oldest;  // sequence number of the oldest entry
+    uint64_t next;    // sequence number the next push gets
+    uint64_t keyframe;
+
+    uint8_t* scratch;
+    size_t scratch_size;
+} History;
+
+// Function declarations
+// ---------------------
+void init_history(History* h, size_t budget_bytes);
+void free_history(History* h);
+bool history_enabled(const History* h);
+void history_clear(History* h);
+void history_push(History* h, const uint32_t* words, size_t count);
+bool history_pop(History* h, uint32_t* words, size_t count);
+
+#endif  // HISTORY_H
@@ -0,0 +1,44 @@
+#ifndef _IMPORT_H
+#define _IMPORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sim2d.h"
+
+#define IMPORT_CSV_CHUNK 4096  // bytes of text per parse task, rows belong to the chunk they start in
+#define IMPORT_MAX_RADIUS (2 * SEED_MAX_RADIUS)
+
+// Columns of a CSV row and the float32 fields of a binary record, in this order. CSV rows may stop after any
+// column from y on, missing columns read as 0. A radius of 0 takes [-r], a color of 0,0,0 gets a random one
+typedef enum {
+    IMPORT_X = 0,
+    IMPORT_Y,
+    IMPORT_VX,
+    IMPORT_VY,
+    IMPORT_RADIUS,
+    IMPORT_R,
+    IMPORT_G,
+    IMPORT_B,
+    COUNT_IMPORT_FIELDS
+} ImportField;
+
+// Rows found in one chunk of a CSV file, the first pass counts them and the second parses them in place
+typedef struct {
+    size_t first_row;
+    size_t rows;
+} ImportChunk;
+
+// First bad row a worker ran into, the lowest one over all workers is reported
+typedef struct {
+    const char* message;
+    size_t row;
+} ImportError;
+
+extern const char* INIT_FROM_PATH;
+
+// Function declarations
+// ---------------------
+void load_initial_seeds(const char* path);
+
+#endif  // IMPORT_H
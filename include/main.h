@@ -2,18 +2,26 @@
 #define _MAIN_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 #define GLFW_INCLUDE_GLEXT
 #include <GLFW/glfw3.h>
 
 #include "glextloader.h"
 #include "helpers.h"
+#include "sim2d.h"
 
 // Shader paths
 #define VERTEX_FILE_PATH "shaders/quad.vert"
 #define VORONOI_FRAGMENT_FILE_PATH "shaders/voronoi.frag"
 #define ATOMS_FRAGMENT_FILE_PATH "shaders/atoms.frag"
 #define BUBBLES_FRAGMENT_FILE_PATH "shaders/bubbles.frag"
+#define SPRINGS_FRAGMENT_FILE_PATH "shaders/springs.frag"
+#define GALAXY_FRAGMENT_FILE_PATH "shaders/galaxy.frag"
+#define FLUID_FRAGMENT_FILE_PATH "shaders/fluid.frag"
+#define OVERLAY_VERTEX_FILE_PATH "shaders/overlay.vert"
+#define OVERLAY_FRAGMENT_FILE_PATH "shaders/overlay.frag"
+#define OBSTACLE_VERTEX_FILE_PATH "shaders/obstacle.vert"
 
 // Constants
 // ---------------------
@@ -22,21 +30,19 @@
 #define DEFAULT_SCREEN_HEIGHT 1080
 #define MANUAL_TIME_STEP 0.05
 
-// Seed properties
-#define DEFAULT_SEED_COUNT 20
-#define DEFAULT_SEED_RADIUS 15
-
-#define SEED_MAX_COUNT 200
-#define SEED_MIN_RADIUS 5
-#define SEED_MAX_RADIUS 150
-
-// Simulation properties
-#define SUB_STEPS 10
+// Camera properties
+#define CAMERA_ZOOM_STEP 1.25f      // per scroll wheel notch
+#define CAMERA_MIN_ZOOM 0.0001f
+#define CAMERA_MAX_ZOOM 64.0f
+#define VORONOI_CULL_MARGIN 0.5f    // of the view size, cells of seeds off screen still reach into it
 
 typedef enum {
     VORONOI_FRAGMENT = 0,
     ATOMS_FRAGMENT,
     BUBBLES_FRAGMENT,
+    SPRINGS_FRAGMENT,
+    GALAXY_FRAGMENT,
+    FLUID_FRAGMENT,
     COUNT_FRAGMENTS
 } FragmentFile;
 
@@ -52,53 +58,63 @@ typedef enum {
     COUNT_ATTRIBS,
 } Attrib;
 
-typedef enum {
-    MODE_VORONOI = 0,
-    MODE_ATOMS,
-    MODE_BUBBLES,
-    COUNT_MODES
-} Mode;
-
 typedef enum {
     RESOLUTION_UNIFORM = 0,
+    CAMERA_UNIFORM,
+    ZOOM_UNIFORM,
     COUNT_UNIFORMS
 } Uniform;
 
+// Screen pixel = (world - center) * zoom + half the window, both with y pointing up
 typedef struct {
-    vec2 pos;
-    vec4 color;
-    int radius;
-    vec2 vel;
-    vec2 acc;
-} Seed;
+    vec2 center;
+    float zoom;
+} Camera;
 
 extern const char* uniform_names[COUNT_UNIFORMS];
-extern const char* mode_names[COUNT_MODES];
 extern const char* vertex_files[COUNT_VERTICES];
 extern const char* fragment_files[COUNT_FRAGMENTS];
 
-extern Seed* seeds;
+// The simulation on screen, created from the options below. Loading a snapshot or a recording overwrites them
+extern Sim2D* sim;
 
 extern int SEED_RADIUS;
 extern size_t SEED_COUNT;
+extern size_t REORDER_INTERVAL;
+extern size_t HISTORY_MB;
+extern float BH_THETA;
+extern int WORLD_WIDTH;
+extern int WORLD_HEIGHT;
+extern Integrator INTEGRATOR;
+extern uint64_t RAND_SEED;  // only used when HAS_RAND_SEED, otherwise runs are seeded from the clock
+extern bool HAS_RAND_SEED;
+extern const char* BENCH_NAME;
 
 extern Mode SIM_MODE;
+extern Mode NEXT_MODE;
 extern double DELTA_TIME;
 extern bool IS_PAUSE;
+extern bool IS_DETERMINISTIC;
 extern bool IS_RUNNING;
 extern bool IS_DRAG_MODE;
+extern bool IS_LASSO_MODE;
+extern bool IS_PAN_MODE;
+
+extern Camera camera;
 
 extern GLint uniforms[COUNT_UNIFORMS];
+extern GLuint programs[COUNT_MODES];
 extern GLuint vbo;
 extern GLuint vao;
 
-extern void (*render_frame)(GLFWwindow*, double, int, int);
+extern void (*step_frame)(GLFWwindow*, double, int, int);
 
 // Function declarations
 // ---------------------
 void render_loop(GLFWwindow* window);
-void init_sim_mode(Mode mode);
-void free_sim_mode(void);
+SimConfig app_sim_config(void);
+
+void run_bench(const char* name);
 
 void init_glfw_settings(void);
 GLFWwindow* init_glfw_window(void);
@@ -106,6 +122,19 @@ void init_glfw_callbacks(GLFWwindow* window);
 void init_gl_settings(void);
 void init_gl_uniforms(GLuint program);
 void init_shaders(GLuint* program, const char* vert_file_path, const char* frag_file_path);
+void init_mode_programs(void);
+void use_mode_program(Mode mode, int width, int height);
 void update_gl_uniforms(int width, int height);
+void fit_camera(int width, int height);
+vec2 screen_to_world(vec2 screen, int width, int height);
+vec2 world_to_screen(vec2 world, int width, int height);
+void step_sim_frame(GLFWwindow* window, double dt, int width, int height);
+void draw_seeds(int width, int height);
+
+void init_overlay(void);
+void init_obstacle_lines(void);
+void render_obstacles(int width, int height);
+void render_selection(int width, int height);
+void render_overlay(int width, int height);
 
 #endif  // MAIN_H
\ No newline at end of file
@@ -0,0 +1,18 @@
+#ifndef _OBSTACLES_H
+#define _OBSTACLES_H
+
+#include <stddef.h>
+
+#include "sim2d.h"
+
+#define OBSTACLE_MAX_COUNT 1000000
+
+extern const char* OBSTACLES_PATH;
+extern Segment* obstacles;
+extern size_t obstacle_count;
+
+// Function declarations
+// ---------------------
+void load_obstacles(const char* path);
+
+#endif  // OBSTACLES_H
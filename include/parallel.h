@@ -0,0 +1,22 @@
+#ifndef _PARALLEL_H
+#define _PARALLEL_H
+
+#include <stddef.h>
+
+#define MAX_THREAD_COUNT 64
+#define PARALLEL_MIN_ITEMS 1024
+
+// Processes items [begin, end) on the given worker, worker 0 is the calling thread
+typedef void (*ParallelFn)(size_t begin, size_t end, size_t worker, void* ctx);
+
+extern size_t THREAD_COUNT;
+
+// Function declarations
+// ---------------------
+void init_thread_pool(size_t thread_count);
+void free_thread_pool(void);
+size_t default_thread_count(void);
+
+void parallel_for(size_t count, ParallelFn fn, void* ctx);
+
+#endif  // PARALLEL_H
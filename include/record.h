@@ -0,0 +1,45 @@
+#ifndef _RECORD_H
+#define _RECORD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORD_MAGIC "SIM2DREC"
+#define RECORD_VERSION 1
+#define RECORD_QUANTUM 64.0f             // fixed point steps per pixel
+#define RECORD_KEYFRAME_INTERVAL 60      // frames between self-contained frames, bounds the cost of a seek
+#define RECORD_QUEUE_DEPTH 4             // frames the simulation may run ahead of the writer
+#define RECORD_BUFFER_SIZE (1 << 20)
+#define MAX_REPLAY_SPEED 64
+
+// Followed by the colors (vec4) and radii (int32) of every seed, then one record per frame: a uint32 payload
+// size and the zigzag varint residuals of the fixed point x/y against a linear prediction from the last two
+// frames. The keyframe offsets (uint64) close the file, a recording cut short is indexed by scanning instead
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t mode;
+    uint32_t keyframe_interval;
+    float quantum;
+    uint32_t reserved;
+    uint64_t seed_count;
+    uint64_t frame_count;   // written when the recording is closed
+    uint64_t index_offset;  // 0 until the recording is closed
+} RecordHeader;
+
+extern const char* RECORD_PATH;
+extern const char* REPLAY_PATH;
+extern size_t REPLAY_SPEED;
+
+// Function declarations
+// ---------------------
+void init_recorder(const char* path);
+void free_recorder(void);
+void record_frame(void);
+
+void init_replay(const char* path);
+void free_replay(void);
+
+#endif  // RECORD_H
@@ -0,0 +1,159 @@
+#ifndef _SIM2D_H
+#define _SIM2D_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec2.h"
+
+// Constants
+// ---------------------
+// World the seeds are generated in
+#define DEFAULT_WORLD_WIDTH 1920
+#define DEFAULT_WORLD_HEIGHT 1080
+#define MAX_WORLD_SIZE 1000000
+
+// Seed properties
+#define DEFAULT_SEED_COUNT 20
+#define DEFAULT_SEED_RADIUS 15
+
+#define SEED_MAX_COUNT 10000000
+#define SEED_MIN_RADIUS 5
+#define SEED_MAX_RADIUS 150
+
+// Simulation properties
+#define SUB_STEPS 4
+#define BUBBLES_SUB_STEPS 8  // piles under gravity need more impulse passes to stay apart
+#define VERLET_SUB_STEPS 3
+#define CFL_FRACTION 0.5f  // part of the smallest radius the fastest seed may move in an adaptive substep
+#define MAX_ADAPTIVE_SUB_STEPS 64
+#define GRAVITY ((vec2){0.0f, -20.0f})
+#define BUBBLES_CONTACT_SCALE (1.0f / 1.5f)
+#define DETERMINISTIC_RAND_SEED 1
+#define DETERMINISTIC_FRAME_DT (1.0 / 60.0)
+#define DEFAULT_REORDER_INTERVAL 60
+#define MAX_REORDER_INTERVAL 100000
+#define DEFAULT_BH_THETA 0.5f  // Barnes-Hut opening angle of galaxy mode, 0 sums every pair directly
+#define MAX_BH_THETA 2.0f
+
+typedef enum {
+    MODE_VORONOI = 0,
+    MODE_ATOMS,
+    MODE_BUBBLES,
+    MODE_SPRINGS,
+    MODE_GALAXY,
+    MODE_FLUID,
+    COUNT_MODES
+} Mode;
+
+typedef enum {
+    INTEGRATOR_IMPULSE = 0,
+    INTEGRATOR_VERLET,
+    COUNT_INTEGRATORS
+} Integrator;
+
+typedef struct {
+    vec2 pos;
+    vec4 color;
+    int radius;
+    vec2 vel;
+    vec2 acc;
+} Seed;
+
+// Springs reference seeds by index and are kept sorted by p0 so the solver streams through memory
+typedef struct {
+    float k;
+    float rest_len;
+    uint32_t p0;
+    uint32_t p1;
+} Spring;
+
+// Static wall seeds bounce off on either side, polygons and boundaries are chains of them
+typedef struct {
+    vec2 a;
+    vec2 b;
+} Segment;
+
+typedef struct {
+    size_t pairs_tested;
+    size_t pairs_colliding;
+    size_t contacts_overflowed;  // voronoi contacts past the batch buffer, resolved one at a time
+    size_t seeds_awake;     // summed over steps, divide by steps for the count
+    size_t seeds_sleeping;
+    size_t steps;
+    double physics_ms;
+    double contacts_ms;  // finding and resolving contacts, part of physics_ms
+    double upload_ms;
+} SimCounters;
+
+// Everything a simulation is created from, start from default_sim_config()
+typedef struct {
+    Mode mode;
+    Integrator integrator;
+    size_t seed_count;
+    int seed_radius;
+    size_t reorder_interval;  // frames between Morton reorders, 0 disables them
+    size_t history_bytes;     // memory kept for stepping backward, 0 disables it
+    uint64_t rng_seed;
+    bool deterministic;    // contacts resolved in seed order, results do not depend on the thread count
+    bool quiet;            // no info messages, for batches of many small simulations
+    bool scalar_contacts;  // voronoi pairs resolved one at a time as the broad phase finds them, for comparison
+    int world_width;       // seeds are generated around the center of the world
+    int world_height;
+    float bh_theta;        // galaxy mode treats a quadtree cell as one body below this size over distance
+    const Segment* obstacles;  // copied by init_sim into a BVH built once, the caller may free them after
+    size_t obstacle_count;
+} SimConfig;
+
+// Mouse state for dragging and lasso selection, the cursor is in world coordinates
+typedef struct {
+    vec2 cursor;
+    bool drag;
+    bool lasso;
+} SimInput;
+
+// One simulation and all of its state. Independent simulations may step on different threads at the same
+// time, a single one must not be used from two threads at once
+typedef struct Sim2D Sim2D;
+
+extern const char* mode_names[COUNT_MODES];
+extern const char* integrator_names[COUNT_INTEGRATORS];
+
+// Function declarations
+// ---------------------
+SimConfig default_sim_config(void);
+Sim2D* init_sim(const SimConfig* config);
+void free_sim(Sim2D* sim);
+void switch_sim_mode(Sim2D* sim, Mode mode);
+void step_sim(Sim2D* sim, double dt, int width, int height);
+void sim_end_frame(Sim2D* sim);
+void set_sim_input(Sim2D* sim, const SimInput* input);
+void scatter_seeds(Sim2D* sim, int width, int height);
+void clear_selection(Sim2D* sim);
+
+Mode sim_mode(const Sim2D* sim);
+const SimConfig* sim_config(const Sim2D* sim);
+size_t sim_seed_count(const Sim2D* sim);
+Seed* sim_seeds(Sim2D* sim);
+float* sim_inv_mass(Sim2D* sim);
+const uint32_t* sim_seed_ids(const Sim2D* sim);
+SimCounters* sim_counters(Sim2D* sim);
+double sim_total_energy(const Sim2D* sim);
+size_t sim_sub_steps(const Sim2D* sim);
+size_t sim_adaptive_sub_steps(const Sim2D* sim, double dt);
+size_t sim_memory_in_use(const Sim2D* sim);
+size_t sim_memory_high_water(const Sim2D* sim);
+size_t sim_memory_reserved(const Sim2D* sim);
+void print_alloc_stats(const Sim2D* sim);
+const Spring* sim_springs(const Sim2D* sim, size_t* count);
+const Segment* sim_obstacles(const Sim2D* sim, size_t* count);
+size_t sim_lasso(const Sim2D* sim, const vec2** points);
+bool sim_selection_bounds(const Sim2D* sim, vec2* lo, vec2* hi);
+size_t sim_seeds_in_rect(Sim2D* sim, vec2 lo, vec2 hi, Seed* out);
+void mark_seeds_moved(Sim2D* sim);
+
+Sim2D* begin_sim_restore(const SimConfig* config, size_t spring_count, Spring** springs);
+void end_sim_restore(Sim2D* sim, size_t spring_count);
+
+#endif  // SIM2D_H
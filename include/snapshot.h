@@ -0,0 +1,51 @@
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <signal.h>
+#include <stdint.h>
+
+#define SNAPSHOT_FILE_PATH "snapshot.bin"
+#define SNAPSHOT_MAGIC "SIM2DSNP"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_BYTE_ORDER 0x01020304u  // reads back swapped on a machine of the other endianness
+#define SNAPSHOT_ALIGN 64                // every section starts on a cache line of the mapping
+
+// Per-seed arrays are stored structure of arrays, springs as the raw Spring records
+typedef enum {
+    SNAPSHOT_POS = 0,
+    SNAPSHOT_VEL,
+    SNAPSHOT_ACC,
+    SNAPSHOT_COLOR,
+    SNAPSHOT_RADIUS,
+    SNAPSHOT_INV_MASS,
+    SNAPSHOT_SPRINGS,
+    COUNT_SNAPSHOT_SECTIONS
+} SnapshotSection;
+
+typedef struct {
+    uint64_t offset;  // from the start of the file
+    uint64_t size;
+} SnapshotRange;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t byte_order;
+    uint32_t mode;
+    uint32_t integrator;
+    int32_t seed_radius;
+    uint64_t seed_count;
+    uint64_t spring_count;
+    SnapshotRange sections[COUNT_SNAPSHOT_SECTIONS];
+} SnapshotHeader;
+
+extern const char* SNAPSHOT_LOAD_PATH;
+extern volatile sig_atomic_t IS_SNAPSHOT_REQUESTED;
+
+// Function declarations
+// ---------------------
+void save_snapshot(const char* path);
+void load_snapshot(const char* path);
+
+#endif  // SNAPSHOT_H
@@ -0,0 +1,57 @@
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define STATS_HISTORY 240  // frames kept for the overlay graph
+#define MAX_STATS_INTERVAL 3600
+
+// One rendered frame, counters are the deltas of sim_counters over the frame
+typedef struct {
+    double frame_ms;
+    double physics_ms;
+    double upload_ms;
+    size_t steps;
+    size_t pairs_tested;
+    size_t pairs_colliding;
+    size_t seeds_awake;
+    size_t seeds_sleeping;
+} FrameSample;
+
+// Aggregate over the frames of one log interval
+typedef struct {
+    size_t frames;
+    double seconds;
+    double frame_min_ms;
+    double frame_avg_ms;
+    double frame_max_ms;
+    double physics_ms;
+    double upload_ms;
+    double steps;  // simulation substeps per frame
+    double pairs_tested;
+    double pairs_colliding;
+    double seeds_awake;  // per step
+    double seeds_sleeping;
+    double seeds_per_sec;  // seed updates per second of physics time
+    size_t memory_bytes;  // in use at the end of the interval
+    size_t memory_high_water_bytes;
+    size_t memory_reserved_bytes;
+} StatsSummary;
+
+extern size_t STATS_INTERVAL;
+extern const char* STATS_CSV_PATH;
+extern bool IS_OVERLAY;
+
+extern FrameSample stats_history[STATS_HISTORY];
+extern size_t stats_history_count;
+
+// Function declarations
+// ---------------------
+void init_stats(void);
+void free_stats(void);
+void stats_record_frame(double frame_ms);
+void stats_summarize(size_t frames, StatsSummary* summary);
+const FrameSample* stats_sample(size_t age);
+
+#endif  // STATS_H
@@ -0,0 +1,59 @@
+#ifndef _TRACE_H
+#define _TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_FILE_PATH "trace.json"
+#define TRACE_MAX_THREADS 128
+#define TRACE_RING_CAPACITY (1 << 16)  // events kept per thread, older ones are overwritten
+#define TRACE_THREAD_NAME_SIZE 32
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+// Start of a zone, the matching end is recorded when the variable leaves scope
+typedef struct {
+    const char* name;
+    uint64_t start;
+} TraceZone;
+
+// Function declarations
+// ---------------------
+void init_trace(void);
+void free_trace(void);
+void trace_dump(const char* path);
+
+void trace_thread_name(const char* name);
+void trace_zone_end(TraceZone* zone);
+
+static inline uint64_t trace_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Zones are only compiled in with -DTRACE (make TRACE=1), otherwise they cost nothing
+#ifdef TRACE
+#define _TRACE_CONCAT_INNER(a, b) a##b
+#define _TRACE_CONCAT(a, b) _TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name)                                                                   \
+    TraceZone _TRACE_CONCAT(_trace_zone_, __LINE__) __attribute__((cleanup(trace_zone_end))) = \
+        (TraceZone){(name), trace_ticks()}
+#define TRACE_THREAD(name) trace_thread_name(name)
+#else
+#define TRACE_ZONE(name) \
+    do {                 \
+    } while (0)
+#define TRACE_THREAD(name) \
+    do {                   \
+    } while (0)
+#endif
+
+#endif  // TRACE_H
@@ -0,0 +1,102 @@
+#ifndef _VEC2_H
+#define _VEC2_H
+
+#include <assert.h>
+#include <math.h>
+#include <stdbool.h>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+typedef struct {
+    float x, y;
+} vec2;
+
+typedef struct {
+    float x, y, z, w;
+} vec4;
+
+// Scalar helpers
+// ---------------------
+
+// Reciprocal square root. On SSE the hardware estimate (~12 bits) is refined
+// with one Newton-Raphson step, which is close to full float precision
+static inline float inv_sqrtf(float x) {
+#ifdef __SSE__
+    float r = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+    return r * (1.5f - 0.5f * x * r * r);
+#else
+    return 1.0f / sqrtf(x);
+#endif
+}
+
+// Vector helpers
+// ---------------------
+static inline float vec2_dot(vec2 v1, vec2 v2) {
+    return v1.x * v2.x + v1.y * v2.y;
+}
+
+static inline float vec2_sqr_mag(vec2 v) {
+    return v.x * v.x + v.y * v.y;
+}
+
+static inline float vec2_mag(vec2 v) {
+    return sqrtf(vec2_sqr_mag(v));
+}
+
+static inline float vec2_sqr_dist(vec2 v1, vec2 v2) {
+    float dx = v1.x - v2.x;
+    float dy = v1.y - v2.y;
+    return dx * dx + dy * dy;
+}
+
+static inline float vec2_dist(vec2 v1, vec2 v2) {
+    return sqrtf(vec2_sqr_dist(v1, v2));
+}
+
+static inline vec2 vec2_mul(vec2 v1, vec2 v2) {
+    return (vec2){v1.x * v2.x, v1.y * v2.y};
+}
+
+static inline vec2 vec2_add(vec2 v1, vec2 v2) {
+    return (vec2){v1.x + v2.x, v1.y + v2.y};
+}
+
+static inline vec2 vec2_sub(vec2 v1, vec2 v2) {
+    return (vec2){v1.x - v2.x, v1.y - v2.y};
+}
+
+static inline vec2 vec2_scale(vec2 v, float s) {
+    return (vec2){v.x * s, v.y * s};
+}
+
+static inline vec2 vec2_div_scalar(vec2 v, float s) {
+    assert(s != 0.0f);
+    return vec2_scale(v, 1.0f / s);
+}
+
+// Rotates v by 90 degrees counter-clockwise
+static inline vec2 vec2_perp(vec2 v) {
+    return (vec2){-v.y, v.x};
+}
+
+static inline vec2 vec2_normalize(vec2 v) {
+    float sqr_mag = vec2_sqr_mag(v);
+    assert(sqr_mag != 0.0f);
+    return vec2_scale(v, inv_sqrtf(sqr_mag));
+}
+
+static inline vec2 vec2_unit_normal(vec2 v1, vec2 v2) {
+    return vec2_normalize(vec2_sub(v2, v1));
+}
+
+static inline vec2 vec2_unit_tangent(vec2 v1, vec2 v2) {
+    return vec2_perp(vec2_unit_normal(v1, v2));
+}
+
+static inline bool vec2_is_zero(vec2 v) {
+    return v.x == 0.0f && v.y == 0.0f;
+}
+
+#endif  // _VEC2_H
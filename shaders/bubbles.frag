@@ -5,7 +5,7 @@ precision mediump float;
 uniform vec2 resolution;
 
 in vec2 seed_pos;
-flat in int seed_mark_rad;
+flat in float seed_mark_rad;
 
 out vec4 out_color;
 
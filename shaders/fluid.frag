@@ -0,0 +1,25 @@
+#version 460
+
+precision mediump float;
+
+uniform vec2 resolution;
+
+in vec2 seed_pos;
+in vec4 seed_color;
+flat in float seed_mark_rad;
+
+out vec4 out_color;
+
+void main(void) {
+    // Particles are drawn a bit larger than their spacing so neighbours blend into one surface
+    float r = seed_mark_rad * 1.5;
+    float d = length(gl_FragCoord.xy - seed_pos);
+
+    if (d < r) {
+        gl_FragDepth = d / r;
+        out_color = vec4(seed_color.rgb * (1.0 - 0.3 * d / r), 1.0 - d / r);
+    } else {
+        gl_FragDepth = 1;
+        out_color = vec4(0, 0, 0, 0);
+    }
+}
@@ -0,0 +1,25 @@
+#version 460
+
+precision mediump float;
+
+uniform vec2 resolution;
+
+in vec2 seed_pos;
+in vec4 seed_color;
+flat in float seed_mark_rad;
+
+out vec4 out_color;
+
+void main(void) {
+    float d = length(gl_FragCoord.xy - seed_pos) / max(seed_mark_rad, 1.0);
+
+    if (d < 1.0) {
+        // Bright core fading out to the edge of the disc
+        float glow = (1.0 - d) * (1.0 - d);
+        gl_FragDepth = d;
+        out_color = vec4(mix(seed_color.rgb, vec3(1.0), glow * glow), glow);
+    } else {
+        gl_FragDepth = 1;
+        out_color = vec4(0, 0, 0, 0);
+    }
+}
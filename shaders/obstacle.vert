@@ -0,0 +1,22 @@
+// Obstacle segments drawn as GL_LINES, two vertices per segment in world
+// coordinates. The camera takes them to window pixels like the seeds,
+// the overlay fragment shader fills them with the color passed on.
+#version 460
+
+precision mediump float;
+
+uniform vec2 resolution;
+uniform vec2 camera;
+uniform float zoom;
+
+layout(location = 0) in vec2 point_in;
+
+out vec4 rect_color;
+
+void main(void)
+{
+    vec2 pixel = (point_in - camera) * zoom + resolution / 2.0;
+    gl_Position = vec4(pixel / resolution * 2.0 - 1.0, 0.0, 1.0);
+
+    rect_color = vec4(0.85, 0.85, 0.85, 1.0);
+}
@@ -0,0 +1,11 @@
+#version 460
+
+precision mediump float;
+
+in vec4 rect_color;
+
+out vec4 out_color;
+
+void main(void) {
+    out_color = rect_color;
+}
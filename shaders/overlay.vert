@@ -0,0 +1,26 @@
+// Screen space rectangles for the stats overlay, one instance per rectangle.
+// Each instance is a triangle strip quad generated from gl_VertexID and
+// placed in pixels, origin at the bottom left like gl_FragCoord.
+#version 460
+
+precision mediump float;
+
+uniform vec2 resolution;
+
+layout(location = 0) in vec2 rect_pos_in;
+layout(location = 1) in vec2 rect_size_in;
+layout(location = 2) in vec4 rect_color_in;
+
+out vec4 rect_color;
+
+void main(void)
+{
+    vec2 uv;
+    uv.x = (gl_VertexID & 1);
+    uv.y = ((gl_VertexID >> 1) & 1);
+
+    vec2 pixel = rect_pos_in + uv * rect_size_in;
+    gl_Position = vec4(pixel / resolution * 2.0 - 1.0, 0.0, 1.0);
+
+    rect_color = rect_color_in;
+}
@@ -6,13 +6,17 @@
 
 precision mediump float;
 
+uniform vec2 resolution;
+uniform vec2 camera;
+uniform float zoom;
+
 layout(location = 0) in vec2 seed_pos_in;
 layout(location = 1) in vec4 seed_color_in;
 layout(location = 2) in int seed_mark_rad_in;
 
 out vec2 seed_pos;
 out vec4 seed_color;
-out flat int seed_mark_rad;
+out flat float seed_mark_rad;
 
 void main(void)
 {
@@ -21,7 +25,8 @@ void main(void)
     uv.y = ((gl_VertexID >> 1) & 1);
     gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
     
-    seed_pos  = seed_pos_in;
+    // Seeds live in world coordinates, the camera takes them to window pixels
+    seed_pos  = (seed_pos_in - camera) * zoom + resolution / 2.0;
     seed_color = seed_color_in;
-    seed_mark_rad = seed_mark_rad_in;
+    seed_mark_rad = seed_mark_rad_in * zoom;
 }
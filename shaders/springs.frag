@@ -0,0 +1,23 @@
+#version 460
+
+precision mediump float;
+
+uniform vec2 resolution;
+
+in vec2 seed_pos;
+in vec4 seed_color;
+flat in float seed_mark_rad;
+
+out vec4 out_color;
+
+void main(void) {
+    float d = length(gl_FragCoord.xy - seed_pos);
+
+    if (d < seed_mark_rad) {
+        gl_FragDepth = d / seed_mark_rad;
+        out_color = mix(seed_color, vec4(0, 0, 0, 1), d / seed_mark_rad / 1.5);
+    } else {
+        gl_FragDepth = 1;
+        out_color = vec4(0, 0, 0, 0);
+    }
+}
@@ -8,7 +8,7 @@ uniform vec2 resolution;
 
 in vec2 seed_pos;
 in vec4 seed_color;
-flat in int seed_mark_rad;
+flat in float seed_mark_rad;
 
 out vec4 out_color;
 
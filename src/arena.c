@@ -0,0 +1,124 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// This source inner helpers
+size_t _align_up(size_t size);
+ArenaBlock* _new_block(size_t min_size);
+void _track_alloc(Arena* a, size_t size);
+
+// Function definitions
+// ---------------------
+void* arena_alloc(Arena* a, size_t size) {
+    size = _align_up(size);
+
+    // Walk to the first retained block that still fits, blocks are reused after a reset
+    while (a->current != NULL && a->current->offset + size > a->current->capacity && a->current->next != NULL) {
+        a->current = a->current->next;
+        a->current->offset = 0;
+    }
+
+    if (a->current == NULL || a->current->offset + size > a->current->capacity) {
+        ArenaBlock* b = _new_block(size);
+        if (a->current == NULL) {
+            a->head = b;
+        } else {
+            a->current->next = b;
+        }
+        a->current = b;
+        a->reserved += b->capacity;
+    }
+
+    void* ptr = (char*)a->current + _align_up(sizeof(ArenaBlock)) + a->current->offset;
+    a->current->offset += size;
+    _track_alloc(a, size);
+
+    return ptr;
+}
+
+// Rewind to the first block, memory stays reserved for the next mode
+void arena_reset(Arena* a) {
+    a->current = a->head;
+    if (a->current != NULL) a->current->offset = 0;
+    a->in_use = 0;
+}
+
+ArenaMark arena_mark(const Arena* a) {
+    return (ArenaMark){a->current, a->current != NULL ? a->current->offset : 0, a->in_use};
+}
+
+// Like a reset that keeps what was allocated before the mark, the blocks after it are reused
+void arena_rewind(Arena* a, ArenaMark mark) {
+    if (mark.block == NULL) {
+        arena_reset(a);
+        return;
+    }
+
+    a->current = mark.block;
+    a->current->offset = mark.offset;
+    a->in_use = mark.in_use;
+}
+
+void arena_free(Arena* a) {
+    ArenaBlock* b = a->head;
+    while (b != NULL) {
+        ArenaBlock* b_next = b->next;
+        free(b);
+        b = b_next;
+    }
+
+    a->head = NULL;
+    a->current = NULL;
+    a->in_use = 0;
+    a->reserved = 0;
+}
+
+void pool_init(Pool* p, Arena* a, size_t item_size) {
+    p->arena = a;
+    p->item_size = item_size < sizeof(PoolItem) ? sizeof(PoolItem) : item_size;
+    p->free_list = NULL;
+}
+
+void* pool_alloc(Pool* p) {
+    PoolItem* item = p->free_list;
+    if (item == NULL) return arena_alloc(p->arena, p->item_size);
+
+    p->free_list = item->next;
+    _track_alloc(p->arena, _align_up(p->item_size));
+    return item;
+}
+
+void pool_free(Pool* p, void* item) {
+    PoolItem* it = (PoolItem*)item;
+    it->next = p->free_list;
+    p->free_list = it;
+    p->arena->in_use -= _align_up(p->item_size);
+}
+
+// Private function definitions
+// ---------------------
+size_t _align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+ArenaBlock* _new_block(size_t min_size) {
+    size_t header = _align_up(sizeof(ArenaBlock));
+    size_t capacity = min_size > ARENA_BLOCK_SIZE - header ? min_size : ARENA_BLOCK_SIZE - header;
+
+    ArenaBlock* b = malloc(header + capacity);
+    if (b == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    b->next = NULL;
+    b->capacity = capacity;
+    b->offset = 0;
+    return b;
+}
+
+void _track_alloc(Arena* a, size_t size) {
+    a->in_use += size;
+    if (a->in_use > a->high_water) a->high_water = a->in_use;
+}
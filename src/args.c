@@ -0,0 +1,354 @@
+#include "args.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ensemble.h"
+#include "history.h"
+#include "import.h"
+#include "main.h"
+#include "obstacles.h"
+#include "parallel.h"
+#include "record.h"
+#include "snapshot.h"
+#include "stats.h"
+
+// This source inner helpers
+void _invalid_arg_exit();
+
+bool _is_in_range(int target, int min, int max);
+const char *_long_option_arg(int argc, char **argv, int *i);
+int _options(int argc, char *argv[], const char *legal);
+
+const char *legal_args = "m:c:r:j:i:";
+const char switch_char = '-';
+const char unknown_char = '?';
+char *opt_arg = NULL;
+int opt_index = 1;
+
+// Function definitions
+// ---------------------
+void usage(void) {
+    printf("usage: sim [-m num] [-c num] [-r num] [-j num] [-i num] [--reorder frames] [--history-mb mb]\n");
+    printf("           [--stats-interval seconds] [--stats-csv path] [--load path] [--record path]\n");
+    printf("           [--replay path] [--deterministic] [--bench name] [--ensemble worlds]\n");
+    printf("           [--ensemble-frames frames] [--ensemble-csv path] [--seed num] [--init-from path]\n");
+    printf("           [--world WIDTHxHEIGHT] [--theta num] [--obstacles path]\n");
+    printf("       Optionally specify simulation mode: [-m] (%u-%u). By default Mode 1 is chosen\n", 1, COUNT_MODES);
+    printf("              Mode 1: - 'Voronoi'\n");
+    printf("              Mode 2: - 'Atoms'\n");
+    printf("              Mode 3: - 'Bubbles'\n");
+    printf("              Mode 4: - 'Springs'\n");
+    printf("              Mode 5: - 'Galaxy'\n");
+    printf("              Mode 6: - 'Fluid'\n");
+    printf("       Optionally specify seed count:      [-c] (%u-%u)\n", 1, SEED_MAX_COUNT);
+    printf("       Optionally specify seed radius:     [-r] (%u-%u). Not used by 'bubbles' mode\n", SEED_MIN_RADIUS, SEED_MAX_RADIUS);
+    printf("       Optionally specify thread count:    [-j] (%u-%u). By default all online CPUs are used\n", 1, MAX_THREAD_COUNT);
+    printf("       Optionally specify integrator:      [-i] (%u-%u). By default Integrator 1 is chosen\n", 1, COUNT_INTEGRATORS);
+    printf("              Integrator 1: - 'Impulse' - velocity impulses, %u substeps, %u in 'bubbles' mode\n", SUB_STEPS,
+           BUBBLES_SUB_STEPS);
+    printf("              Integrator 2: - 'Verlet'  - position based contacts, %u substeps\n", VERLET_SUB_STEPS);
+    printf("       Optionally specify the world size: [--world WIDTHxHEIGHT] (%u-%u). By default %ux%u,\n", 1,
+           MAX_WORLD_SIZE, DEFAULT_WORLD_WIDTH, DEFAULT_WORLD_HEIGHT);
+    printf("              seeds bounce off its edges and are generated around its center\n");
+    printf("       Optionally add static walls from a file: [--obstacles path] - one chain of points\n");
+    printf("              'x,y x,y ...' per line in world coordinates, a polygon repeats its first point\n");
+    printf("       Optionally set the Barnes-Hut opening angle of 'galaxy' mode: [--theta num] (0-%.0f). By default %.1f,\n",
+           MAX_BH_THETA, DEFAULT_BH_THETA);
+    printf("              larger is faster and coarser, 0 sums the pull of every pair\n");
+    printf("       Optionally specify seed reorder interval: [--reorder frames] (%u-%u). By default %u, 0 disables it\n",
+           0, MAX_REORDER_INTERVAL, DEFAULT_REORDER_INTERVAL);
+    printf("       Optionally set the memory kept for stepping backward: [--history-mb mb] (%u-%u). By default %u, 0 disables it\n",
+           0, MAX_HISTORY_MB, DEFAULT_HISTORY_MB);
+    printf("       Optionally log frame stats periodically: [--stats-interval seconds] (%u-%u) to stderr,\n",
+           1, MAX_STATS_INTERVAL);
+    printf("              or as CSV rows to a file with [--stats-csv path]\n");
+    printf("       Optionally start from a snapshot saved with 'S' or SIGUSR1: [--load path]\n");
+    printf("              mode, integrator and seed count come from the snapshot\n");
+    printf("       Optionally start from seeds stored in a file: [--init-from path]\n");
+    printf("              '.csv' rows of x,y[,vx,vy[,radius[,r,g,b]]], other files float32 records of all 8 fields,\n");
+    printf("              a radius of 0 takes [-r] and a color of 0,0,0 gets a random one\n");
+    printf("       Optionally record every frame's seed positions to a file: [--record path]\n");
+    printf("       Optionally play a recording back instead of simulating: [--replay path]\n");
+    printf("       Optionally make runs reproducible: [--deterministic] - fixed random seed, fixed %.4fs frames\n",
+           DETERMINISTIC_FRAME_DT);
+    printf("              and contacts resolved in seed order, results do not depend on [-j]\n");
+    printf("       Optionally set the random seed: [--seed num]. By default the clock, or %u with [--deterministic]\n",
+           DETERMINISTIC_RAND_SEED);
+    printf("              seeds are generated from it the same way whatever the thread count\n");
+    printf("       Optionally run a headless benchmark and exit: [--bench name]\n");
+    printf("              'stability' - energy drift and overlap of both integrators\n");
+    printf("              'locality'  - cache misses with and without seed reordering\n");
+    printf("              'determinism' - state hashes of every mode and integrator across thread counts\n");
+    printf("              'contacts'  - voronoi contacts per second, batched against one pair at a time\n");
+    printf("       Optionally step many small worlds headless and exit: [--ensemble worlds] (%u-%u)\n", 1,
+           MAX_ENSEMBLE_WORLDS);
+    printf("              each world gets its own random seed, the other options apply to all of them\n");
+    printf("              [--ensemble-frames frames] (%u-%u) sets the length, by default %u frames of %.4fs\n", 1,
+           MAX_ENSEMBLE_FRAMES, DEFAULT_ENSEMBLE_FRAMES, DETERMINISTIC_FRAME_DT);
+    printf("              one summary row per world is appended to [--ensemble-csv path], by default '%s'\n",
+           DEFAULT_ENSEMBLE_CSV_PATH);
+}
+
+void get_arguments(int argc, char **argv) {
+    int letter = -1;
+    int value = -1;
+    char *tail = "\n";
+
+    if (argc > 1) {
+        // Long options are consumed here, the rest is left for the short option parser
+        char *short_argv[argc];
+        int short_argc = 1;
+        short_argv[0] = argv[0];
+
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], "--help") == 0) {
+                usage();
+                exit(0);
+            } else if (strcmp(argv[i], "--deterministic") == 0) {
+                IS_DETERMINISTIC = true;
+            } else if (strcmp(argv[i], "--bench") == 0) {
+                BENCH_NAME = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--reorder") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int frames = (int)strtoul(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || !_is_in_range(frames, 0, MAX_REORDER_INTERVAL)) {
+                    printf("for 'reorder' option [--reorder frames]\n");
+                    _invalid_arg_exit();
+                }
+                REORDER_INTERVAL = frames;
+            } else if (strcmp(argv[i], "--world") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int width = (int)strtoul(arg, &end, 10);
+                int height = -1;
+                if (end != arg && end[0] == 'x') {
+                    const char *tail_arg = end + 1;
+                    height = (int)strtoul(tail_arg, &end, 10);
+                    if (end == tail_arg) height = -1;
+                }
+                if (end[0] != '\0' || !_is_in_range(width, 1, MAX_WORLD_SIZE) ||
+                    !_is_in_range(height, 1, MAX_WORLD_SIZE)) {
+                    printf("for 'world' option [--world WIDTHxHEIGHT]\n");
+                    _invalid_arg_exit();
+                }
+                WORLD_WIDTH = width;
+                WORLD_HEIGHT = height;
+            } else if (strcmp(argv[i], "--theta") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                float theta = strtof(arg, &end);
+                if (end == arg || end[0] != '\0' || !(theta >= 0.0f && theta <= MAX_BH_THETA)) {
+                    printf("for 'theta' option [--theta num] - must be within (0-%.0f)\n", MAX_BH_THETA);
+                    _invalid_arg_exit();
+                }
+                BH_THETA = theta;
+            } else if (strcmp(argv[i], "--history-mb") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int mb = (int)strtoul(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || !_is_in_range(mb, 0, MAX_HISTORY_MB)) {
+                    printf("for 'history' option [--history-mb mb]\n");
+                    _invalid_arg_exit();
+                }
+                HISTORY_MB = mb;
+            } else if (strcmp(argv[i], "--stats-interval") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int seconds = (int)strtoul(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || !_is_in_range(seconds, 1, MAX_STATS_INTERVAL)) {
+                    printf("for 'stats interval' option [--stats-interval seconds]\n");
+                    _invalid_arg_exit();
+                }
+                STATS_INTERVAL = seconds;
+            } else if (strcmp(argv[i], "--stats-csv") == 0) {
+                STATS_CSV_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--seed") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                errno = 0;
+                unsigned long long seed = strtoull(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || arg[0] == '-' || errno == ERANGE) {
+                    printf("for 'seed' option [--seed num]\n");
+                    _invalid_arg_exit();
+                }
+                RAND_SEED = seed;
+                HAS_RAND_SEED = true;
+            } else if (strcmp(argv[i], "--ensemble") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int worlds = (int)strtoul(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || !_is_in_range(worlds, 1, MAX_ENSEMBLE_WORLDS)) {
+                    printf("for 'ensemble' option [--ensemble worlds]\n");
+                    _invalid_arg_exit();
+                }
+                ENSEMBLE_WORLDS = worlds;
+            } else if (strcmp(argv[i], "--ensemble-frames") == 0) {
+                const char *arg = _long_option_arg(argc, argv, &i);
+                char *end = NULL;
+                int frames = (int)strtoul(arg, &end, 10);
+                if (end == arg || end[0] != '\0' || !_is_in_range(frames, 1, MAX_ENSEMBLE_FRAMES)) {
+                    printf("for 'ensemble frames' option [--ensemble-frames frames]\n");
+                    _invalid_arg_exit();
+                }
+                ENSEMBLE_FRAMES = frames;
+            } else if (strcmp(argv[i], "--ensemble-csv") == 0) {
+                ENSEMBLE_CSV_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--load") == 0) {
+                SNAPSHOT_LOAD_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--init-from") == 0) {
+                INIT_FROM_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--obstacles") == 0) {
+                OBSTACLES_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--record") == 0) {
+                RECORD_PATH = _long_option_arg(argc, argv, &i);
+            } else if (strcmp(argv[i], "--replay") == 0) {
+                REPLAY_PATH = _long_option_arg(argc, argv, &i);
+            } else {
+                short_argv[short_argc++] = argv[i];
+            }
+        }
+        argc = short_argc;
+        argv = short_argv;
+
+        // A CSV file without an interval logs every second
+        if (STATS_CSV_PATH != NULL && STATS_INTERVAL == 0) STATS_INTERVAL = 1;
+
+        // Precheck
+        letter = _options(argc, argv, legal_args);
+        value = opt_arg != NULL ? (int)strtoul(opt_arg, &tail, 10) : -1;
+
+        while (letter != -1) {
+            if (letter == unknown_char) {
+                printf("invalid option: %s\n", argv[opt_index - 1]);
+                _invalid_arg_exit();
+            } else if (errno == ERANGE) {
+                printf("invalid option argument: [-%c num] - number is invalid\n", letter);
+                _invalid_arg_exit();
+            } else if (value == -1 || tail[0] != '\0' || errno == EINVAL) {
+                printf("invalid option argument: [-%c num] - must be followed by number\n", letter);
+                _invalid_arg_exit();
+            }
+
+            switch (letter) {
+                case 'm':
+                    if (_is_in_range(value, 1, COUNT_MODES))
+                        SIM_MODE = value - 1;
+                    else {
+                        printf("for 'mode' option [-%c]\n", letter);
+                        _invalid_arg_exit();
+                    }
+                    break;
+                case 'c':
+                    if (_is_in_range(value, 1, SEED_MAX_COUNT))
+                        SEED_COUNT = value;
+                    else {
+                        printf("for 'count' option [-%c]\n", letter);
+                        _invalid_arg_exit();
+                    }
+                    break;
+                case 'r':
+                    if (_is_in_range(value, SEED_MIN_RADIUS, SEED_MAX_RADIUS))
+                        SEED_RADIUS = value;
+                    else {
+                        printf("for 'radius' option [-%c]\n", letter);
+                        _invalid_arg_exit();
+                    }
+                    break;
+                case 'i':
+                    if (_is_in_range(value, 1, COUNT_INTEGRATORS))
+                        INTEGRATOR = value - 1;
+                    else {
+                        printf("for 'integrator' option [-%c]\n", letter);
+                        _invalid_arg_exit();
+                    }
+                    break;
+                case 'j':
+                    if (_is_in_range(value, 1, MAX_THREAD_COUNT))
+                        THREAD_COUNT = value;
+                    else {
+                        printf("for 'threads' option [-%c]\n", letter);
+                        _invalid_arg_exit();
+                    }
+                    break;
+                default:
+                    break;
+            }
+
+            tail = "\0";
+            letter = _options(argc, argv, legal_args);
+            value = opt_arg != NULL ? (int)strtoul(opt_arg, &tail, 10) : -1;
+        }
+    }
+}
+
+// Private function definitions
+// ---------------------
+void _invalid_arg_exit(void) {
+    usage();
+    exit(EINVAL);
+}
+
+bool _is_in_range(int target, int min, int max) {
+    if (target > max || target < min) {
+        printf("provided argument: %d is not in range (%d-%d) ", target, min, max);
+        return false;
+    }
+    return true;
+}
+
+const char *_long_option_arg(int argc, char **argv, int *i) {
+    if (*i + 1 >= argc) {
+        printf("invalid option argument: [%s] - must be followed by a value\n", argv[*i]);
+        _invalid_arg_exit();
+    }
+    *i += 1;
+    return argv[*i];
+}
+
+int _options(int argc, char *argv[], const char *legal) {
+    static char *posn = "";  // position in argv[opt_index]
+    char *legal_index = NULL;
+    int letter = 0;
+
+    if (!*posn) {
+        // no more args, no switch_char or no option letter ?
+        if ((opt_index >= argc) ||
+            (*(posn = argv[opt_index]) != switch_char) ||
+            !*++posn)
+            return -1;
+        // find double switch_char ?
+        if (*posn == switch_char) {
+            opt_index++;
+            return -1;
+        }
+    }
+    letter = *posn++;
+    if (!(legal_index = strchr(legal, letter))) {
+        if (!*posn)
+            opt_index++;
+        return unknown_char;
+    }
+    if (*++legal_index != ':') {
+        // no option arg
+        opt_arg = NULL;
+        if (!*posn)
+            opt_index++;
+    } else {
+        if (*posn)
+            // no space between opt and opt arg
+            opt_arg = posn;
+        else if (argc <= ++opt_index) {
+            posn = "";
+            opt_arg = NULL;
+        } else
+            opt_arg = argv[opt_index];
+        posn = "";
+        opt_index++;
+    }
+    return letter;
+}
\ No newline at end of file
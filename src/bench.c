@@ -0,0 +1,503 @@
+#include <linux/perf_event.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "parallel.h"
+
+#define BENCH_RAND_SEED 42
+#define BENCH_FRAMES 600
+#define BENCH_WARMUP_FRAMES 60
+#define BENCH_FRAME_DT (1.0 / 60.0)
+#define LOCALITY_FRAMES 60
+#define LOCALITY_COVERAGE 0.25f
+#define DETERMINISM_FRAMES 120
+#define DETERMINISM_MIN_SEEDS 4096  // enough that every parallel_for is split between workers
+#define DETERMINISM_THREAD_RUNS 3
+#define CONTACTS_FRAMES 120
+#define CONTACTS_COVERAGE 0.9f  // dense enough that most seeds touch a neighbour
+
+typedef struct {
+    double energy_start;
+    double energy_end;
+    float max_overlap;
+    float end_overlap;
+    double ms_per_frame;
+    SimCounters counters;
+} StabilityResult;
+
+typedef struct {
+    double contacts_per_frame;  // overlapping pairs counted once per step
+    double contacts_per_sec;    // over the time spent finding and resolving them
+    double overflowed_per_frame;
+    double contacts_ms_per_frame;
+    double ms_per_frame;
+} ContactsResult;
+
+typedef enum {
+    COUNTER_CACHE_MISSES = 0,
+    COUNTER_L1D_MISSES,
+    COUNTER_INSTRUCTIONS,
+    COUNT_COUNTERS
+} Counter;
+
+typedef struct {
+    uint64_t counters[COUNT_COUNTERS];
+    bool counted;
+    double ms_per_frame;
+} LocalityResult;
+
+static_assert(COUNT_COUNTERS == 3, "Update list of counter names");
+const char* counter_names[COUNT_COUNTERS] = {
+    [COUNTER_CACHE_MISSES] = "cache misses",
+    [COUNTER_L1D_MISSES] = "L1d misses",
+    [COUNTER_INSTRUCTIONS] = "instructions",
+};
+
+const size_t determinism_threads[DETERMINISM_THREAD_RUNS] = {1, 4, 32};
+
+bool bench_scalar_contacts = false;
+
+// This source inner helpers
+void _restart_sim(Mode mode, Integrator integrator, size_t reorder_interval);
+int _compare_seed_x(const void* a, const void* b);
+float _max_overlap(size_t* order);
+void _run_stability(Integrator integrator, size_t* order, StabilityResult* result);
+void _bench_stability(void);
+int _open_counter(uint32_t type, uint64_t config);
+bool _open_counters(int* fds);
+void _close_counters(int* fds, LocalityResult* result);
+void _world_size(float coverage, int* width, int* height);
+void _run_locality(size_t interval, int width, int height, LocalityResult* result);
+void _bench_locality(void);
+uint64_t _hash_bytes(uint64_t hash, const void* data, size_t size);
+uint64_t _state_hash(void);
+uint64_t _run_determinism(Mode mode, Integrator integrator, size_t threads, int width, int height);
+void _bench_determinism(void);
+void _run_contacts(Mode mode, bool scalar, int width, int height, ContactsResult* result);
+void _bench_contacts(void);
+
+// Function definitions
+// ---------------------
+void run_bench(const char* name) {
+    if (strcmp(name, "stability") == 0) {
+        _bench_stability();
+    } else if (strcmp(name, "locality") == 0) {
+        _bench_locality();
+    } else if (strcmp(name, "determinism") == 0) {
+        _bench_determinism();
+    } else if (strcmp(name, "contacts") == 0) {
+        _bench_contacts();
+    } else {
+        fprintf(stderr, "[ERROR]: Unknown benchmark '%s'\n", name);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Private function definitions
+// ---------------------
+// Every run starts from a fresh simulation drawing the same random numbers, without a history to fill
+void _restart_sim(Mode mode, Integrator integrator, size_t reorder_interval) {
+    SimConfig config = app_sim_config();
+    config.mode = mode;
+    config.integrator = integrator;
+    config.reorder_interval = reorder_interval;
+    config.history_bytes = 0;
+    config.rng_seed = BENCH_RAND_SEED;
+    config.scalar_contacts = bench_scalar_contacts;
+
+    free_sim(sim);
+    sim = init_sim(&config);
+}
+
+// Mass follows the radius like in the impulse solver, gravity only acts in bubbles mode
+int _compare_seed_x(const void* a, const void* b) {
+    const Seed* seeds = sim_seeds(sim);
+    float x1 = seeds[*(const size_t*)a].pos.x;
+    float x2 = seeds[*(const size_t*)b].pos.x;
+    return (x1 > x2) - (x1 < x2);
+}
+
+// Deepest penetration relative to the contact distance, sweep and prune along x
+float _max_overlap(size_t* order) {
+    float scale = SIM_MODE == MODE_BUBBLES ? BUBBLES_CONTACT_SCALE : 1.0f;
+    int max_radius = 0;
+    const Seed* seeds = sim_seeds(sim);
+
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        order[i] = i;
+        if (seeds[i].radius > max_radius) max_radius = seeds[i].radius;
+    }
+    qsort(order, SEED_COUNT, sizeof(size_t), _compare_seed_x);
+
+    float worst = 0.0f;
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        const Seed* s1 = &seeds[order[i]];
+        float reach = (s1->radius + max_radius) * scale;
+
+        for (size_t j = i + 1; j < SEED_COUNT && seeds[order[j]].pos.x - s1->pos.x < reach; j++) {
+            const Seed* s2 = &seeds[order[j]];
+            float contact = (s1->radius + s2->radius) * scale;
+            float overlap = (contact - vec2_dist(s1->pos, s2->pos)) / contact;
+            if (overlap > worst) worst = overlap;
+        }
+    }
+    return worst;
+}
+
+void _run_stability(Integrator integrator, size_t* order, StabilityResult* result) {
+    _restart_sim(SIM_MODE, integrator, REORDER_INTERVAL);
+
+    size_t sub_steps = sim_sub_steps(sim);
+    double sub_dt = BENCH_FRAME_DT / sub_steps;
+    double elapsed = 0.0;
+
+    *result = (StabilityResult){0};
+
+    for (size_t frame = 0; frame < BENCH_FRAMES; frame++) {
+        // Let the initial cluster explode before sampling energy and overlap
+        if (frame == BENCH_WARMUP_FRAMES) result->energy_start = sim_total_energy(sim);
+
+        double start = now_ms();
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, sub_dt, WORLD_WIDTH, WORLD_HEIGHT);
+        }
+        sim_end_frame(sim);
+        elapsed += now_ms() - start;
+
+        if (frame >= BENCH_WARMUP_FRAMES) {
+            result->end_overlap = _max_overlap(order);
+            if (result->end_overlap > result->max_overlap) result->max_overlap = result->end_overlap;
+        }
+    }
+
+    result->energy_end = sim_total_energy(sim);
+    result->ms_per_frame = elapsed / BENCH_FRAMES;
+    result->counters = *sim_counters(sim);
+}
+
+void _bench_stability(void) {
+    size_t* order = malloc(sizeof(size_t) * SEED_COUNT);
+    if (order == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    StabilityResult results[COUNT_INTEGRATORS];
+    size_t sub_steps[COUNT_INTEGRATORS];
+    for (Integrator i = 0; i < COUNT_INTEGRATORS; i++) {
+        _run_stability(i, order, &results[i]);
+        sub_steps[i] = sim_sub_steps(sim);
+    }
+    free(order);
+
+    printf("[BENCH]: stability, '%s' mode, %zu seeds, %d frames of %.4fs\n",
+           mode_names[SIM_MODE], SEED_COUNT, BENCH_FRAMES, BENCH_FRAME_DT);
+    printf("%-10s %9s %13s %12s %12s %13s %15s %10s\n",
+           "integrator", "substeps", "energy drift", "max overlap", "end overlap",
+           "pairs/frame", "contacts/frame", "ms/frame");
+
+    for (Integrator i = 0; i < COUNT_INTEGRATORS; i++) {
+        StabilityResult* r = &results[i];
+        double drift = (r->energy_end - r->energy_start) / fabs(r->energy_start) * 100.0;
+
+        printf("%-10s %9zu %12.2f%% %11.2f%% %11.2f%% %13.0f %15.0f %10.3f\n",
+               integrator_names[i], sub_steps[i], drift,
+               r->max_overlap * 100.0f, r->end_overlap * 100.0f,
+               (double)r->counters.pairs_tested / BENCH_FRAMES,
+               (double)r->counters.pairs_colliding / BENCH_FRAMES,
+               r->ms_per_frame);
+    }
+}
+
+int _open_counter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+// Counters are inherited by threads started afterwards, the pool has to be (re)started after this
+bool _open_counters(int* fds) {
+    fds[COUNTER_CACHE_MISSES] = _open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    fds[COUNTER_L1D_MISSES] = _open_counter(PERF_TYPE_HW_CACHE,
+                                            PERF_COUNT_HW_CACHE_L1D |
+                                                (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    fds[COUNTER_INSTRUCTIONS] = _open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+
+    bool counted = false;
+    for (Counter c = 0; c < COUNT_COUNTERS; c++) {
+        if (fds[c] < 0) continue;
+        ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+        ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+        counted = true;
+    }
+    return counted;
+}
+
+// Inherited counts are folded into the parent once the worker threads exit, so stop the pool first
+void _close_counters(int* fds, LocalityResult* result) {
+    for (Counter c = 0; c < COUNT_COUNTERS; c++) {
+        result->counters[c] = 0;
+        if (fds[c] < 0) continue;
+
+        ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fds[c], &result->counters[c], sizeof(uint64_t)) != sizeof(uint64_t)) {
+            result->counters[c] = 0;
+        }
+        close(fds[c]);
+    }
+}
+
+// The world is sized so the seeds cover a fixed share of it, otherwise 100k seeds just jam the screen
+void _world_size(float coverage, int* width, int* height) {
+    float aspect = (float)DEFAULT_SCREEN_WIDTH / DEFAULT_SCREEN_HEIGHT;
+    float area = SEED_COUNT * M_PI * SEED_RADIUS * SEED_RADIUS / coverage;
+    *height = (int)fmaxf(sqrtf(area / aspect), DEFAULT_SCREEN_HEIGHT);
+    *width = (int)(*height * aspect);
+}
+
+void _run_locality(size_t interval, int width, int height, LocalityResult* result) {
+    _restart_sim(SIM_MODE, INTEGRATOR, interval);
+    scatter_seeds(sim, width, height);
+
+    size_t sub_steps = sim_sub_steps(sim);
+    double sub_dt = BENCH_FRAME_DT / sub_steps;
+    int fds[COUNT_COUNTERS];
+
+    *result = (LocalityResult){0};
+    free_thread_pool();
+    result->counted = _open_counters(fds);
+    init_thread_pool(THREAD_COUNT);
+
+    double start = now_ms();
+    for (size_t frame = 0; frame < LOCALITY_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, sub_dt, width, height);
+        }
+        sim_end_frame(sim);
+    }
+    result->ms_per_frame = (now_ms() - start) / LOCALITY_FRAMES;
+
+    free_thread_pool();
+    _close_counters(fds, result);
+    init_thread_pool(THREAD_COUNT);
+}
+
+void _bench_locality(void) {
+    size_t intervals[2] = {0, REORDER_INTERVAL > 0 ? REORDER_INTERVAL : DEFAULT_REORDER_INTERVAL};
+    LocalityResult results[2];
+
+    int width, height;
+    _world_size(LOCALITY_COVERAGE, &width, &height);
+
+    for (size_t i = 0; i < 2; i++) {
+        _run_locality(intervals[i], width, height, &results[i]);
+    }
+
+    printf("[BENCH]: locality, '%s' mode, %zu seeds in a %dx%d world, %d frames of %.4fs, '%s' integrator\n",
+           mode_names[SIM_MODE], SEED_COUNT, width, height, LOCALITY_FRAMES, BENCH_FRAME_DT,
+           integrator_names[INTEGRATOR]);
+    if (!results[0].counted) {
+        printf("[WARNING]: perf_event_open is unavailable (see /proc/sys/kernel/perf_event_paranoid), only timing is reported\n");
+    }
+    printf("%-16s %16s %16s %16s %10s\n", "reorder", counter_names[COUNTER_CACHE_MISSES],
+           counter_names[COUNTER_L1D_MISSES], counter_names[COUNTER_INSTRUCTIONS], "ms/frame");
+
+    for (size_t i = 0; i < 2; i++) {
+        LocalityResult* r = &results[i];
+        char label[48];
+        if (intervals[i] == 0) {
+            snprintf(label, sizeof(label), "off");
+        } else {
+            snprintf(label, sizeof(label), "every %zu frames", intervals[i]);
+        }
+
+        printf("%-16s %16llu %16llu %16llu %10.3f\n", label,
+               (unsigned long long)r->counters[COUNTER_CACHE_MISSES],
+               (unsigned long long)r->counters[COUNTER_L1D_MISSES],
+               (unsigned long long)r->counters[COUNTER_INSTRUCTIONS],
+               r->ms_per_frame);
+    }
+}
+
+// FNV-1a
+uint64_t _hash_bytes(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3ull;
+    }
+    return hash;
+}
+
+// Fields are hashed one by one in generation order, padding and the current memory order do not count
+uint64_t _state_hash(void) {
+    size_t* index = malloc(sizeof(size_t) * SEED_COUNT);
+    if (index == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+    const Seed* seeds = sim_seeds(sim);
+    const uint32_t* seed_ids = sim_seed_ids(sim);
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        index[seed_ids[i]] = i;
+    }
+
+    uint64_t hash = 0xCBF29CE484222325ull;
+    for (size_t id = 0; id < SEED_COUNT; id++) {
+        const Seed* s = &seeds[index[id]];
+        hash = _hash_bytes(hash, &s->pos, sizeof(vec2));
+        hash = _hash_bytes(hash, &s->vel, sizeof(vec2));
+        hash = _hash_bytes(hash, &s->acc, sizeof(vec2));
+    }
+
+    free(index);
+    return hash;
+}
+
+uint64_t _run_determinism(Mode mode, Integrator integrator, size_t threads, int width, int height) {
+    free_thread_pool();
+    init_thread_pool(threads);
+
+    _restart_sim(mode, integrator, REORDER_INTERVAL);
+    // The springs lattice is generated in place, scattering would tear it apart
+    if (mode != MODE_SPRINGS) scatter_seeds(sim, width, height);
+
+    size_t sub_steps = sim_sub_steps(sim);
+    for (size_t frame = 0; frame < DETERMINISM_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, DETERMINISTIC_FRAME_DT / sub_steps, width, height);
+        }
+        sim_end_frame(sim);
+    }
+    return _state_hash();
+}
+
+void _bench_determinism(void) {
+    IS_DETERMINISTIC = true;
+    if (SEED_COUNT < DETERMINISM_MIN_SEEDS) SEED_COUNT = DETERMINISM_MIN_SEEDS;
+
+    int width, height;
+    _world_size(LOCALITY_COVERAGE, &width, &height);
+    size_t thread_count = THREAD_COUNT;
+
+    printf("[BENCH]: determinism, %zu seeds in a %dx%d world, %d frames of %.4fs\n",
+           SEED_COUNT, width, height, DETERMINISM_FRAMES, DETERMINISTIC_FRAME_DT);
+    printf("%-10s %-10s", "mode", "integrator");
+    for (size_t t = 0; t < DETERMINISM_THREAD_RUNS; t++) {
+        char label[32];
+        snprintf(label, sizeof(label), "-j %zu", determinism_threads[t]);
+        printf(" %16s", label);
+    }
+    printf(" %8s\n", "result");
+
+    bool all_equal = true;
+    for (Mode mode = 0; mode < COUNT_MODES; mode++) {
+        for (Integrator integrator = 0; integrator < COUNT_INTEGRATORS; integrator++) {
+            // Springs, galaxy and fluid modes always run their own integrator
+            bool own_integrator = mode == MODE_SPRINGS || mode == MODE_GALAXY || mode == MODE_FLUID;
+            if (own_integrator && integrator != INTEGRATOR_IMPULSE) continue;
+
+            uint64_t hashes[DETERMINISM_THREAD_RUNS];
+            bool equal = true;
+            for (size_t t = 0; t < DETERMINISM_THREAD_RUNS; t++) {
+                hashes[t] = _run_determinism(mode, integrator, determinism_threads[t], width, height);
+                equal = equal && hashes[t] == hashes[0];
+            }
+            all_equal = all_equal && equal;
+
+            printf("%-10s %-10s", mode_names[mode], integrator_names[integrator]);
+            for (size_t t = 0; t < DETERMINISM_THREAD_RUNS; t++) {
+                printf(" %016llx", (unsigned long long)hashes[t]);
+            }
+            printf(" %8s\n", equal ? "same" : "DIFFERS");
+        }
+    }
+
+    free_thread_pool();
+    init_thread_pool(thread_count);
+    if (!all_equal) exit(EXIT_FAILURE);
+}
+
+void _run_contacts(Mode mode, bool scalar, int width, int height, ContactsResult* result) {
+    bench_scalar_contacts = scalar;
+    _restart_sim(mode, INTEGRATOR_IMPULSE, REORDER_INTERVAL);
+    bench_scalar_contacts = false;
+    scatter_seeds(sim, width, height);
+
+    size_t sub_steps = sim_sub_steps(sim);
+    double sub_dt = BENCH_FRAME_DT / sub_steps;
+    for (size_t frame = 0; frame < BENCH_WARMUP_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, sub_dt, width, height);
+        }
+        sim_end_frame(sim);
+    }
+
+    SimCounters before = *sim_counters(sim);
+    double start = now_ms();
+    for (size_t frame = 0; frame < CONTACTS_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, sub_dt, width, height);
+        }
+        sim_end_frame(sim);
+    }
+    double elapsed = now_ms() - start;
+    const SimCounters* after = sim_counters(sim);
+
+    double contacts = after->pairs_colliding - before.pairs_colliding;
+    double contacts_ms = after->contacts_ms - before.contacts_ms;
+    double overflowed = after->contacts_overflowed - before.contacts_overflowed;
+    *result = (ContactsResult){
+        .contacts_per_frame = contacts / CONTACTS_FRAMES,
+        .contacts_per_sec = contacts_ms > 0.0 ? contacts / (contacts_ms / 1000.0) : 0.0,
+        .overflowed_per_frame = overflowed / CONTACTS_FRAMES,
+        .contacts_ms_per_frame = contacts_ms / CONTACTS_FRAMES,
+        .ms_per_frame = elapsed / CONTACTS_FRAMES,
+    };
+}
+
+// Both voronoi narrow phases on the same dense world. Each counts a pair once per step, when its lower seed
+// finds it overlapping, the counts still differ a little since the batched one moves seeds only after every
+// pair was found
+void _bench_contacts(void) {
+    Mode mode = SIM_MODE == MODE_ATOMS ? MODE_ATOMS : MODE_VORONOI;
+    const char* labels[2] = {"scalar", "batched"};
+    ContactsResult results[2];
+
+    int width, height;
+    _world_size(CONTACTS_COVERAGE, &width, &height);
+
+    for (size_t i = 0; i < 2; i++) {
+        _run_contacts(mode, i == 0, width, height, &results[i]);
+    }
+
+    printf("[BENCH]: contacts, '%s' mode, %zu seeds in a %dx%d world, %d frames of %.4fs after %d warmup frames\n",
+           mode_names[mode], SEED_COUNT, width, height, CONTACTS_FRAMES, BENCH_FRAME_DT, BENCH_WARMUP_FRAMES);
+    printf("%-10s %15s %14s %18s %10s %17s\n", "path", "contacts/frame", "contacts/s", "contacts ms/frame",
+           "ms/frame", "overflowed/frame");
+
+    for (size_t i = 0; i < 2; i++) {
+        ContactsResult* r = &results[i];
+        printf("%-10s %15.0f %14.3g %18.3f %10.3f %17.0f\n", labels[i], r->contacts_per_frame,
+               r->contacts_per_sec, r->contacts_ms_per_frame, r->ms_per_frame, r->overflowed_per_frame);
+    }
+    printf("[INFO]: the batched narrow phase takes %.2fx the time of the scalar one\n",
+           results[0].contacts_ms_per_frame > 0.0
+               ? results[1].contacts_ms_per_frame / results[0].contacts_ms_per_frame
+               : 0.0);
+}
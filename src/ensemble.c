@@ -0,0 +1,451 @@
+#include "ensemble.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "main.h"
+#include "parallel.h"
+#include "trace.h"
+
+// Seeds of ENSEMBLE_LANES worlds interleaved, seed i of lane l sits at i * ENSEMBLE_LANES + l so one register
+// holds the same seed of every world
+typedef struct {
+    size_t seed_count;
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float* radius;
+    size_t pairs_colliding[ENSEMBLE_LANES];
+} EnsembleLanes;
+
+// This source inner helpers
+void* _ensemble_worker(void* arg);
+bool _lanes_supported(const SimConfig* config);
+void _run_world(size_t world, EnsembleResult* result);
+void _run_lanes(size_t first, size_t count);
+void _bounce_lanes(EnsembleLanes* lanes, float width, float height);
+void _collide_lanes(EnsembleLanes* lanes);
+void _advance_lanes(EnsembleLanes* lanes, float dt);
+void _summarize_world(Sim2D* world, EnsembleResult* result);
+void _write_ensemble_csv(void);
+
+size_t ENSEMBLE_WORLDS = 0;
+size_t ENSEMBLE_FRAMES = DEFAULT_ENSEMBLE_FRAMES;
+const char* ENSEMBLE_CSV_PATH = DEFAULT_ENSEMBLE_CSV_PATH;
+
+SimConfig ensemble_config;
+EnsembleResult* ensemble_results = NULL;
+
+pthread_mutex_t ensemble_lock = PTHREAD_MUTEX_INITIALIZER;
+size_t ensemble_next = 0;
+
+// Function definitions
+// ---------------------
+// Worlds only differ in their random seed, which follows the run's seed so deterministic runs give the same rows.
+// Each world is small enough that its parallel_for calls run inline, cores take whole batches of worlds instead
+void run_ensemble(void) {
+    ensemble_config = app_sim_config();
+    ensemble_config.history_bytes = 0;
+    ensemble_config.quiet = true;
+
+    ensemble_results = calloc(ENSEMBLE_WORLDS, sizeof(EnsembleResult));
+    if (ensemble_results == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    size_t batches = (ENSEMBLE_WORLDS + ENSEMBLE_BATCH - 1) / ENSEMBLE_BATCH;
+    size_t thread_count = THREAD_COUNT == 0 ? default_thread_count() : THREAD_COUNT;
+    if (thread_count > MAX_THREAD_COUNT) thread_count = MAX_THREAD_COUNT;
+    if (thread_count > batches) thread_count = batches;
+
+    printf("[INFO]: Ensemble of %zu '%s' worlds, %zu seeds each, %zu frames of %.4fs on %zu threads\n",
+           ENSEMBLE_WORLDS, mode_names[ensemble_config.mode], ensemble_config.seed_count, ENSEMBLE_FRAMES,
+           DETERMINISTIC_FRAME_DT, thread_count);
+    if (_lanes_supported(&ensemble_config)) {
+        printf("[INFO]: Worlds step %d at a time, one per SIMD lane\n", ENSEMBLE_LANES);
+    }
+
+    double start = now_ms();
+    pthread_t threads[MAX_THREAD_COUNT];
+    for (size_t i = 1; i < thread_count; i++) {
+        if (pthread_create(&threads[i], NULL, _ensemble_worker, (void*)i) != 0) {
+            printf("[ERROR]: Failed to start ensemble thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    _ensemble_worker((void*)0);
+    for (size_t i = 1; i < thread_count; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    double elapsed_ms = now_ms() - start;
+
+    _write_ensemble_csv();
+    printf("[INFO]: %zu worlds in %.1fms, %.1f worlds/s, %.2f M seed steps/s, written to '%s'\n",
+           ENSEMBLE_WORLDS, elapsed_ms, ENSEMBLE_WORLDS * 1000.0 / elapsed_ms,
+           (double)ENSEMBLE_WORLDS * ensemble_config.seed_count * ENSEMBLE_FRAMES / (elapsed_ms * 1000.0),
+           ENSEMBLE_CSV_PATH);
+
+    free(ensemble_results);
+    ensemble_results = NULL;
+}
+
+// Private function definitions
+// ---------------------
+void* _ensemble_worker(void* arg) {
+    char name[TRACE_THREAD_NAME_SIZE];
+    snprintf(name, sizeof(name), "ensemble %zu", (size_t)arg);
+    TRACE_THREAD(name);
+
+    while (true) {
+        pthread_mutex_lock(&ensemble_lock);
+        size_t begin = ensemble_next;
+        ensemble_next += ENSEMBLE_BATCH;
+        pthread_mutex_unlock(&ensemble_lock);
+
+        if (begin >= ENSEMBLE_WORLDS) break;
+        size_t end = begin + ENSEMBLE_BATCH > ENSEMBLE_WORLDS ? ENSEMBLE_WORLDS : begin + ENSEMBLE_BATCH;
+        for (size_t world = begin; world < end;) {
+            if (_lanes_supported(&ensemble_config)) {
+                size_t count = end - world < ENSEMBLE_LANES ? end - world : ENSEMBLE_LANES;
+                _run_lanes(world, count);
+                world += count;
+            } else {
+                _run_world(world, &ensemble_results[world]);
+                world++;
+            }
+        }
+    }
+    return NULL;
+}
+
+void _run_world(size_t world, EnsembleResult* result) {
+    TRACE_ZONE("ensemble_world");
+
+    SimConfig config = ensemble_config;
+    config.rng_seed += world;
+
+    double start = now_ms();
+    Sim2D* sim = init_sim(&config);
+    // The springs lattice is generated in place, scattering would tear it apart
+    if (config.mode != MODE_SPRINGS) scatter_seeds(sim, config.world_width, config.world_height);
+
+    size_t sub_steps = sim_sub_steps(sim);
+    for (size_t frame = 0; frame < ENSEMBLE_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            step_sim(sim, DETERMINISTIC_FRAME_DT / sub_steps, config.world_width, config.world_height);
+        }
+        sim_end_frame(sim);
+    }
+
+    result->rng_seed = config.rng_seed;
+    _summarize_world(sim, result);
+    result->ms = now_ms() - start;
+    free_sim(sim);
+}
+
+// Voronoi worlds on the Impulse integrator without obstacles, small enough that testing every pair beats the map
+bool _lanes_supported(const SimConfig* config) {
+    return config->mode == MODE_VORONOI && config->integrator == INTEGRATOR_IMPULSE &&
+           config->obstacle_count == 0 && !config->scalar_contacts && config->seed_count <= ENSEMBLE_LANE_MAX_SEEDS;
+}
+
+// The worlds are generated and summarized by their own Sim2D, only the stepping runs on the interleaved copy.
+// Each pair is resolved as soon as it is found like the scalar voronoi path, so the rows differ from the ones
+// of larger worlds. A short last batch fills its spare lanes with the first world and drops them
+void _run_lanes(size_t first, size_t count) {
+    TRACE_ZONE("ensemble_lanes");
+
+    double start = now_ms();
+    Sim2D* worlds[ENSEMBLE_LANES];
+    for (size_t l = 0; l < count; l++) {
+        SimConfig config = ensemble_config;
+        config.rng_seed += first + l;
+        worlds[l] = init_sim(&config);
+        scatter_seeds(worlds[l], config.world_width, config.world_height);
+    }
+
+    size_t n = sim_seed_count(worlds[0]);
+    EnsembleLanes lanes = {.seed_count = n};
+    float** fields[] = {&lanes.x, &lanes.y, &lanes.vx, &lanes.vy, &lanes.radius};
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        *fields[f] = malloc(sizeof(float) * n * ENSEMBLE_LANES);
+        if (*fields[f] == NULL) {
+            printf("[ERROR]: Memory was not allocated\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    for (size_t l = 0; l < ENSEMBLE_LANES; l++) {
+        const Seed* seeds = sim_seeds(worlds[l < count ? l : 0]);
+        for (size_t i = 0; i < n; i++) {
+            size_t k = i * ENSEMBLE_LANES + l;
+            lanes.x[k] = seeds[i].pos.x;
+            lanes.y[k] = seeds[i].pos.y;
+            lanes.vx[k] = seeds[i].vel.x;
+            lanes.vy[k] = seeds[i].vel.y;
+            lanes.radius[k] = seeds[i].radius;
+        }
+    }
+
+    size_t sub_steps = sim_sub_steps(worlds[0]);
+    float dt = DETERMINISTIC_FRAME_DT / sub_steps;
+    double contacts_ms = 0.0;
+    for (size_t frame = 0; frame < ENSEMBLE_FRAMES; frame++) {
+        for (size_t i = 0; i < sub_steps; i++) {
+            _bounce_lanes(&lanes, ensemble_config.world_width, ensemble_config.world_height);
+            double contacts_start = now_ms();
+            _collide_lanes(&lanes);
+            contacts_ms += now_ms() - contacts_start;
+            _advance_lanes(&lanes, dt);
+        }
+    }
+    double physics_ms = now_ms() - start;
+
+    size_t steps = ENSEMBLE_FRAMES * sub_steps;
+    for (size_t l = 0; l < count; l++) {
+        Seed* seeds = sim_seeds(worlds[l]);
+        for (size_t i = 0; i < n; i++) {
+            size_t k = i * ENSEMBLE_LANES + l;
+            seeds[i].pos = (vec2){lanes.x[k], lanes.y[k]};
+            seeds[i].vel = (vec2){lanes.vx[k], lanes.vy[k]};
+        }
+
+        // The lanes share the time, each world is charged its part
+        SimCounters* counters = sim_counters(worlds[l]);
+        counters->steps += steps;
+        counters->seeds_awake += steps * n;
+        counters->pairs_tested += steps * n * (n - 1) / 2;
+        counters->pairs_colliding += lanes.pairs_colliding[l];
+        counters->physics_ms += physics_ms / count;
+        counters->contacts_ms += contacts_ms / count;
+
+        EnsembleResult* result = &ensemble_results[first + l];
+        result->rng_seed = sim_config(worlds[l])->rng_seed;
+        _summarize_world(worlds[l], result);
+        free_sim(worlds[l]);
+    }
+
+    double ms = now_ms() - start;
+    for (size_t l = 0; l < count; l++) {
+        ensemble_results[first + l].ms = ms / count;
+    }
+    for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+        free(*fields[f]);
+    }
+}
+
+// The wall bounce of _apply_constraints, a lane flips the sign of its velocity where the mask is set
+void _bounce_lanes(EnsembleLanes* lanes, float width, float height) {
+    size_t count = lanes->seed_count * ENSEMBLE_LANES;
+#ifdef __SSE__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    const __m128 w = _mm_set1_ps(width);
+    const __m128 h = _mm_set1_ps(height);
+    for (size_t k = 0; k < count; k += ENSEMBLE_LANES) {
+        __m128 x = _mm_loadu_ps(&lanes->x[k]);
+        __m128 y = _mm_loadu_ps(&lanes->y[k]);
+        __m128 vx = _mm_loadu_ps(&lanes->vx[k]);
+        __m128 vy = _mm_loadu_ps(&lanes->vy[k]);
+        __m128 flip_x = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(x, zero), _mm_cmplt_ps(vx, zero)),
+                                  _mm_and_ps(_mm_cmpgt_ps(x, w), _mm_cmpgt_ps(vx, zero)));
+        __m128 flip_y = _mm_or_ps(_mm_and_ps(_mm_cmplt_ps(y, zero), _mm_cmplt_ps(vy, zero)),
+                                  _mm_and_ps(_mm_cmpgt_ps(y, h), _mm_cmpgt_ps(vy, zero)));
+        _mm_storeu_ps(&lanes->vx[k], _mm_xor_ps(vx, _mm_and_ps(flip_x, sign)));
+        _mm_storeu_ps(&lanes->vy[k], _mm_xor_ps(vy, _mm_and_ps(flip_y, sign)));
+    }
+#else
+    for (size_t k = 0; k < count; k++) {
+        if ((lanes->x[k] < 0.0f && lanes->vx[k] < 0) || (lanes->x[k] > width && lanes->vx[k] > 0)) {
+            lanes->vx[k] = -lanes->vx[k];
+        }
+        if ((lanes->y[k] < 0.0f && lanes->vy[k] < 0) || (lanes->y[k] > height && lanes->vy[k] > 0)) {
+            lanes->vy[k] = -lanes->vy[k];
+        }
+    }
+#endif
+}
+
+// Every pair in index order with the arithmetic of _resolve_contact, masses are the radii. Seed i stays in
+// registers while it meets the later seeds, lanes whose pair does not overlap get zero impulse and push
+void _collide_lanes(EnsembleLanes* lanes) {
+    size_t n = lanes->seed_count;
+#ifdef __SSE__
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 two = _mm_set1_ps(2.0f);
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (size_t i = 0; i < n; i++) {
+        size_t ki = i * ENSEMBLE_LANES;
+        __m128 xi = _mm_loadu_ps(&lanes->x[ki]);
+        __m128 yi = _mm_loadu_ps(&lanes->y[ki]);
+        __m128 vxi = _mm_loadu_ps(&lanes->vx[ki]);
+        __m128 vyi = _mm_loadu_ps(&lanes->vy[ki]);
+        __m128 ri = _mm_loadu_ps(&lanes->radius[ki]);
+
+        for (size_t j = i + 1; j < n; j++) {
+            size_t k = j * ENSEMBLE_LANES;
+            __m128 xj = _mm_loadu_ps(&lanes->x[k]);
+            __m128 yj = _mm_loadu_ps(&lanes->y[k]);
+            __m128 rj = _mm_loadu_ps(&lanes->radius[k]);
+            __m128 dx = _mm_sub_ps(xi, xj);
+            __m128 dy = _mm_sub_ps(yi, yj);
+            __m128 radii_sum = _mm_add_ps(ri, rj);
+            __m128 sqr_dist = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+            __m128 hit = _mm_cmplt_ps(sqr_dist, _mm_mul_ps(radii_sum, radii_sum));
+            int mask = _mm_movemask_ps(hit);
+            if (mask == 0) continue;
+
+            for (size_t l = 0; l < ENSEMBLE_LANES; l++) {
+                lanes->pairs_colliding[l] += (mask >> l) & 1;
+            }
+
+            // Seeds on the same point are taken apart along x
+            __m128 dist = _mm_sqrt_ps(sqr_dist);
+            __m128 apart = _mm_cmpgt_ps(dist, zero);
+            __m128 nx = _mm_or_ps(_mm_and_ps(apart, _mm_div_ps(dx, dist)), _mm_andnot_ps(apart, one));
+            __m128 ny = _mm_and_ps(apart, _mm_div_ps(dy, dist));
+
+            __m128 vxj = _mm_loadu_ps(&lanes->vx[k]);
+            __m128 vyj = _mm_loadu_ps(&lanes->vy[k]);
+            __m128 dn = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(vxi, vxj), nx), _mm_mul_ps(_mm_sub_ps(vyi, vyj), ny));
+            __m128 scale = _mm_and_ps(hit, _mm_div_ps(_mm_mul_ps(two, dn), radii_sum));
+            __m128 j1 = _mm_mul_ps(rj, scale);
+            __m128 j2 = _mm_mul_ps(ri, scale);
+            __m128 push = _mm_and_ps(hit, _mm_mul_ps(half, _mm_sub_ps(radii_sum, dist)));
+
+            vxi = _mm_sub_ps(vxi, _mm_mul_ps(nx, j1));
+            vyi = _mm_sub_ps(vyi, _mm_mul_ps(ny, j1));
+            xi = _mm_add_ps(xi, _mm_mul_ps(nx, push));
+            yi = _mm_add_ps(yi, _mm_mul_ps(ny, push));
+            _mm_storeu_ps(&lanes->vx[k], _mm_add_ps(vxj, _mm_mul_ps(nx, j2)));
+            _mm_storeu_ps(&lanes->vy[k], _mm_add_ps(vyj, _mm_mul_ps(ny, j2)));
+            _mm_storeu_ps(&lanes->x[k], _mm_sub_ps(xj, _mm_mul_ps(nx, push)));
+            _mm_storeu_ps(&lanes->y[k], _mm_sub_ps(yj, _mm_mul_ps(ny, push)));
+        }
+
+        _mm_storeu_ps(&lanes->x[ki], xi);
+        _mm_storeu_ps(&lanes->y[ki], yi);
+        _mm_storeu_ps(&lanes->vx[ki], vxi);
+        _mm_storeu_ps(&lanes->vy[ki], vyi);
+    }
+#else
+    for (size_t i = 0; i < n; i++) {
+        for (size_t j = i + 1; j < n; j++) {
+            for (size_t l = 0; l < ENSEMBLE_LANES; l++) {
+                size_t a = i * ENSEMBLE_LANES + l;
+                size_t b = j * ENSEMBLE_LANES + l;
+                float dx = lanes->x[a] - lanes->x[b];
+                float dy = lanes->y[a] - lanes->y[b];
+                float radii_sum = lanes->radius[a] + lanes->radius[b];
+                float sqr_dist = dx * dx + dy * dy;
+                if (!(sqr_dist < radii_sum * radii_sum)) continue;
+
+                lanes->pairs_colliding[l]++;
+                float dist = sqrtf(sqr_dist);
+                float nx = dist > 0.0f ? dx / dist : 1.0f;
+                float ny = dist > 0.0f ? dy / dist : 0.0f;
+                float dn = (lanes->vx[a] - lanes->vx[b]) * nx + (lanes->vy[a] - lanes->vy[b]) * ny;
+                float scale = 2.0f * dn / radii_sum;
+                float j1 = lanes->radius[b] * scale;
+                float j2 = lanes->radius[a] * scale;
+                float push = 0.5f * (radii_sum - dist);
+                lanes->vx[a] -= nx * j1;
+                lanes->vy[a] -= ny * j1;
+                lanes->vx[b] += nx * j2;
+                lanes->vy[b] += ny * j2;
+                lanes->x[a] += nx * push;
+                lanes->y[a] += ny * push;
+                lanes->x[b] -= nx * push;
+                lanes->y[b] -= ny * push;
+            }
+        }
+    }
+#endif
+}
+
+// Voronoi seeds carry no acceleration. Small worlds move far less than half a radius per substep, so nothing is
+// swept like in _advance_seed
+void _advance_lanes(EnsembleLanes* lanes, float dt) {
+    size_t count = lanes->seed_count * ENSEMBLE_LANES;
+#ifdef __SSE__
+    const __m128 step = _mm_set1_ps(dt);
+    for (size_t k = 0; k < count; k += ENSEMBLE_LANES) {
+        __m128 x = _mm_add_ps(_mm_loadu_ps(&lanes->x[k]), _mm_mul_ps(_mm_loadu_ps(&lanes->vx[k]), step));
+        __m128 y = _mm_add_ps(_mm_loadu_ps(&lanes->y[k]), _mm_mul_ps(_mm_loadu_ps(&lanes->vy[k]), step));
+        _mm_storeu_ps(&lanes->x[k], x);
+        _mm_storeu_ps(&lanes->y[k], y);
+    }
+#else
+    for (size_t k = 0; k < count; k++) {
+        lanes->x[k] += lanes->vx[k] * dt;
+        lanes->y[k] += lanes->vy[k] * dt;
+    }
+#endif
+}
+
+void _summarize_world(Sim2D* world, EnsembleResult* result) {
+    size_t count = sim_seed_count(world);
+    const Seed* seeds = sim_seeds(world);
+
+    double speed = 0.0;
+    double cx = 0.0;
+    double cy = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        const Seed* s = &seeds[i];
+        speed += vec2_mag(s->vel);
+        cx += s->pos.x;
+        cy += s->pos.y;
+    }
+    cx /= count;
+    cy /= count;
+
+    double spread = 0.0;
+    for (size_t i = 0; i < count; i++) {
+        double dx = seeds[i].pos.x - cx;
+        double dy = seeds[i].pos.y - cy;
+        spread += dx * dx + dy * dy;
+    }
+
+    result->energy = sim_total_energy(world);
+    result->mean_speed = speed / count;
+    result->centroid = (vec2){(float)cx, (float)cy};
+    result->spread = sqrt(spread / count);
+    result->counters = *sim_counters(world);
+}
+
+// Rows are appended so the runs of a parameter sweep can share one file, the header starts a new one.
+// The solver column tells rows stepped in SIMD lanes from rows stepped by step_sim, their results differ
+void _write_ensemble_csv(void) {
+    FILE* file = fopen(ENSEMBLE_CSV_PATH, "a");
+    if (file == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open ensemble file '%s'\n", ENSEMBLE_CSV_PATH);
+        exit(EXIT_FAILURE);
+    }
+    if (ftell(file) == 0) {
+        fprintf(file, "world,rng_seed,mode,integrator,solver,seeds,radius,frames,energy,mean_speed,centroid_x,"
+                      "centroid_y,spread,pairs_tested,pairs_colliding,physics_ms,ms\n");
+    }
+
+    const char* solver = _lanes_supported(&ensemble_config) ? "lanes" : "step_sim";
+    for (size_t i = 0; i < ENSEMBLE_WORLDS; i++) {
+        const EnsembleResult* r = &ensemble_results[i];
+        fprintf(file, "%zu,%llu,%s,%s,%s,%zu,%d,%zu,%.6g,%.6g,%.3f,%.3f,%.3f,%zu,%zu,%.3f,%.3f\n", i,
+                (unsigned long long)r->rng_seed, mode_names[ensemble_config.mode],
+                integrator_names[ensemble_config.integrator], solver, ensemble_config.seed_count,
+                ensemble_config.seed_radius, ENSEMBLE_FRAMES, r->energy, r->mean_speed, r->centroid.x,
+                r->centroid.y, r->spread, r->counters.pairs_tested, r->counters.pairs_colliding,
+                r->counters.physics_ms, r->ms);
+    }
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "[ERROR]: Ensemble file '%s' could not be written completely\n", ENSEMBLE_CSV_PATH);
+        exit(EXIT_FAILURE);
+    }
+}
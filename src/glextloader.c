@@ -39,6 +39,8 @@ PFNGLCHECKFRAMEBUFFERSTATUSPROC glCheckFramebufferStatus = NULL;
 PFNGLUNIFORM1IPROC glUniform1i = NULL;
 PFNGLDRAWBUFFERSPROC glDrawBuffers = NULL;
 PFNGLUNIFORM4FPROC glUniform4f = NULL;
+PFNGLMAPBUFFERRANGEPROC glMapBufferRange = NULL;
+PFNGLUNMAPBUFFERPROC glUnmapBuffer = NULL;
 
 void load_gl_extensions(void) {
     // TODO: check for failtures?
@@ -76,6 +78,8 @@ void load_gl_extensions(void) {
     glUniform1i = (PFNGLUNIFORM1IPROC)glfwGetProcAddress("glUniform1i");
     glDrawBuffers = (PFNGLDRAWBUFFERSPROC)glfwGetProcAddress("glDrawBuffers");
     glUniform4f = (PFNGLUNIFORM4FPROC)glfwGetProcAddress("glUniform4f");
+    glMapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+    glUnmapBuffer = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
 #ifdef _WIN32
     glActiveTexture = (PFNGLACTIVETEXTUREPROC)glfwGetProcAddress("glActiveTexture");
 #endif  // _WIN32
@@ -0,0 +1,197 @@
+#include "history.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// This source inner helpers
+size_t _align_record(size_t size);
+size_t _free_offset(const History* h, size_t size);
+size_t _reserve(History* h, size_t size);
+void _evict_oldest(History* h);
+size_t _encode_delta(const uint32_t* words, const uint32_t* key, size_t count, uint8_t* out);
+void _decode_delta(const uint8_t* in, const uint32_t* key, size_t count, uint32_t* words);
+
+// Bytes of an XORed word by 2 bit code, unchanged words cost only their code
+const uint8_t history_code_bytes[4] = {0, 2, 3, 4};
+
+// Function definitions
+// ---------------------
+void init_history(History* h, size_t budget_bytes) {
+    if (budget_bytes == 0) return;
+
+    h->bytes = malloc(budget_bytes);
+    h->entries = malloc(sizeof(HistoryEntry) * HISTORY_MAX_ENTRIES);
+    if (h->bytes == NULL || h->entries == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+    h->capacity = budget_bytes;
+    history_clear(h);
+}
+
+void free_history(History* h) {
+    free(h->bytes);
+    free(h->entries);
+    free(h->scratch);
+    h->bytes = NULL;
+    h->entries = NULL;
+    h->scratch = NULL;
+    h->capacity = 0;
+    h->scratch_size = 0;
+}
+
+bool history_enabled(const History* h) {
+    return h->bytes != NULL;
+}
+
+void history_clear(History* h) {
+    h->oldest = h->next;
+    h->keyframe = UINT64_MAX;
+}
+
+// Oldest states are dropped to make room, a state larger than the whole budget is not kept
+void history_push(History* h, const uint32_t* words, size_t count) {
+    size_t raw = sizeof(uint32_t) * count;
+    if (!history_enabled(h) || _align_record(raw) > h->capacity) return;
+
+    const HistoryEntry* key = h->keyframe != UINT64_MAX && h->keyframe >= h->oldest
+                                  ? &h->entries[h->keyframe % HISTORY_MAX_ENTRIES]
+                                  : NULL;
+    bool is_keyframe = key == NULL || key->count != count || h->next - h->keyframe >= HISTORY_KEYFRAME_INTERVAL;
+
+    size_t size = raw;
+    if (!is_keyframe) {
+        size_t needed = (count + 3) / 4 + raw;
+        if (needed > h->scratch_size) {
+            free(h->scratch);
+            h->scratch = malloc(needed);
+            h->scratch_size = needed;
+            if (h->scratch == NULL) {
+                printf("[ERROR]: Memory was not allocated\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        size = _encode_delta(words, (const uint32_t*)(h->bytes + key->offset), count, h->scratch);
+        is_keyframe = size >= raw;
+    }
+
+    size_t offset = _reserve(h, is_keyframe ? raw : size);
+
+    // Making room may have dropped the keyframe the delta was encoded against
+    if (!is_keyframe && h->keyframe < h->oldest) {
+        is_keyframe = true;
+        offset = _reserve(h, raw);
+    }
+
+    if (is_keyframe) {
+        size = raw;
+        memcpy(h->bytes + offset, words, raw);
+        h->keyframe = h->next;
+    } else {
+        memcpy(h->bytes + offset, h->scratch, size);
+    }
+
+    h->entries[h->next % HISTORY_MAX_ENTRIES] = (HistoryEntry){offset, size, count, h->keyframe};
+    h->next++;
+}
+
+// Restores the newest state and drops it, false when there is none left of this size
+bool history_pop(History* h, uint32_t* words, size_t count) {
+    if (!history_enabled(h) || h->next == h->oldest) return false;
+
+    uint64_t seq = h->next - 1;
+    const HistoryEntry* e = &h->entries[seq % HISTORY_MAX_ENTRIES];
+    if (e->count != count) {
+        history_clear(h);
+        return false;
+    }
+
+    if (e->keyframe == seq) {
+        memcpy(words, h->bytes + e->offset, sizeof(uint32_t) * count);
+        h->keyframe = UINT64_MAX;
+    } else {
+        const HistoryEntry* key = &h->entries[e->keyframe % HISTORY_MAX_ENTRIES];
+        _decode_delta(h->bytes + e->offset, (const uint32_t*)(h->bytes + key->offset), count, words);
+    }
+
+    h->next = seq;
+    return true;
+}
+
+// Private function definitions
+// ---------------------
+// Records start 8 byte aligned so keyframes can be read as words in place
+size_t _align_record(size_t size) {
+    return (size + 7) & ~(size_t)7;
+}
+
+// Where a record fits without touching live ones, SIZE_MAX when the oldest have to go first
+size_t _free_offset(const History* h, size_t size) {
+    if (h->next == h->oldest) return 0;
+    if (h->next - h->oldest == HISTORY_MAX_ENTRIES) return SIZE_MAX;
+
+    const HistoryEntry* oldest = &h->entries[h->oldest % HISTORY_MAX_ENTRIES];
+    const HistoryEntry* newest = &h->entries[(h->next - 1) % HISTORY_MAX_ENTRIES];
+    size_t tail = oldest->offset;
+    size_t head = _align_record(newest->offset + newest->size);
+
+    // Live records are [tail, head), or wrapped around as [tail, end) and [0, head)
+    if (tail < head) {
+        if (head + size <= h->capacity) return head;
+        return size <= tail ? 0 : SIZE_MAX;
+    }
+    return head + size <= tail ? head : SIZE_MAX;
+}
+
+size_t _reserve(History* h, size_t size) {
+    size = _align_record(size);
+
+    size_t offset;
+    while ((offset = _free_offset(h, size)) == SIZE_MAX) {
+        _evict_oldest(h);
+    }
+    return offset;
+}
+
+// Deltas are useless without their keyframe, they go together with it
+void _evict_oldest(History* h) {
+    h->oldest++;
+    while (h->oldest < h->next &&
+           h->entries[h->oldest % HISTORY_MAX_ENTRIES].keyframe < h->oldest) {
+        h->oldest++;
+    }
+}
+
+// A 2 bit length code per word packed four to a byte, followed by the significant bytes of every XOR
+size_t _encode_delta(const uint32_t* words, const uint32_t* key, size_t count, uint8_t* out) {
+    uint8_t* control = out;
+    uint8_t* data = out + (count + 3) / 4;
+    memset(control, 0, (count + 3) / 4);
+
+    for (size_t i = 0; i < count; i++) {
+        uint32_t x = words[i] ^ key[i];
+        int code = x == 0 ? 0 : x <= 0xFFFF ? 1 : x <= 0xFFFFFF ? 2 : 3;
+        control[i / 4] |= code << (2 * (i % 4));
+
+        for (int b = 0; b < history_code_bytes[code]; b++) {
+            *data++ = (uint8_t)(x >> (8 * b));
+        }
+    }
+    return data - out;
+}
+
+void _decode_delta(const uint8_t* in, const uint32_t* key, size_t count, uint32_t* words) {
+    const uint8_t* control = in;
+    const uint8_t* data = in + (count + 3) / 4;
+
+    for (size_t i = 0; i < count; i++) {
+        int code = (control[i / 4] >> (2 * (i % 4))) & 3;
+
+        uint32_t x = 0;
+        for (int b = 0; b < history_code_bytes[code]; b++) {
+            x |= (uint32_t)*data++ << (8 * b);
+        }
+        words[i] = key[i] ^ x;
+    }
+}
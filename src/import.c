@@ -0,0 +1,343 @@
+#include "import.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "parallel.h"
+
+// This source inner helpers
+bool _is_csv_path(const char* path);
+void _map_import_file(const char* path);
+size_t _count_csv(void);
+size_t _count_binary(void);
+void _exit_on_import_error(const char* path);
+
+size_t _chunk_begin(size_t chunk);
+size_t _chunk_end(size_t chunk);
+const char* _next_row(const char* row);
+bool _is_skipped_row(const char* row, const char* end);
+void _count_csv_rows(size_t begin, size_t end, size_t worker, void* ctx);
+void _parse_csv_rows(size_t begin, size_t end, size_t worker, void* ctx);
+const char* _parse_csv_row(const char* row, const char* end, float* fields);
+bool _parse_float(const char** p, const char* end, float* value);
+void _read_binary_records(size_t begin, size_t end, size_t worker, void* ctx);
+const char* _import_seed(size_t i, const float* fields);
+void _report_import_error(size_t worker, size_t row, const char* message);
+
+const char* INIT_FROM_PATH = NULL;
+
+const char* import_data = NULL;
+size_t import_size = 0;
+
+ImportChunk* import_chunks = NULL;
+size_t import_chunk_count = 0;
+ImportError import_errors[MAX_THREAD_COUNT];
+
+Seed* import_seeds = NULL;
+Rng import_rng;
+int import_radius = DEFAULT_SEED_RADIUS;
+
+// Exactly representable powers of ten, a short decimal is scaled by one of them without pow()
+const double import_pow10[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+// Function definitions
+// ---------------------
+// The file is mapped and the seeds are filled in parallel straight from it, a '.csv' file is parsed in chunks,
+// anything else is read as raw float32 records. Mode, integrator and the default radius come from the options
+void load_initial_seeds(const char* path) {
+    double start = now_ms();
+
+    _map_import_file(path);
+    bool is_csv = _is_csv_path(path);
+    size_t count = is_csv ? _count_csv() : _count_binary();
+    if (count < 1 || count > SEED_MAX_COUNT) {
+        fprintf(stderr, "[ERROR]: Seed file '%s' holds %zu seeds, expected %u-%u\n", path, count, 1, SEED_MAX_COUNT);
+        exit(EXIT_FAILURE);
+    }
+
+    SEED_COUNT = count;
+    free_sim(sim);
+    SimConfig config = app_sim_config();
+    sim = begin_sim_restore(&config, 0, NULL);
+
+    import_seeds = sim_seeds(sim);
+    import_radius = config.seed_radius;
+    seed_rng(&import_rng, config.rng_seed);
+    memset(import_errors, 0, sizeof(import_errors));
+
+    if (is_csv) {
+        parallel_for(import_chunk_count, _parse_csv_rows, NULL);
+    } else {
+        parallel_for(count, _read_binary_records, NULL);
+    }
+    _exit_on_import_error(path);
+
+    munmap((void*)import_data, import_size);
+    free(import_chunks);
+    import_data = NULL;
+    import_chunks = NULL;
+
+    end_sim_restore(sim, 0);
+    printf("[INFO]: %zu seeds imported from '%s' in %.2f ms\n", count, path, now_ms() - start);
+}
+
+// Private function definitions
+// ---------------------
+bool _is_csv_path(const char* path) {
+    const char* ext = strrchr(path, '.');
+    return ext != NULL && strcasecmp(ext, ".csv") == 0;
+}
+
+void _map_import_file(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[ERROR]: Could not open seed file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        fprintf(stderr, "[ERROR]: Seed file '%s' is empty\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    import_size = st.st_size;
+    import_data = mmap(NULL, import_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (import_data == MAP_FAILED) {
+        fprintf(stderr, "[ERROR]: Could not map seed file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    madvise((void*)import_data, import_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+}
+
+// Rows are counted per chunk first, the prefix sum tells every chunk where its rows go in the seed array
+size_t _count_csv(void) {
+    import_chunk_count = (import_size + IMPORT_CSV_CHUNK - 1) / IMPORT_CSV_CHUNK;
+    import_chunks = calloc(import_chunk_count, sizeof(ImportChunk));
+    if (import_chunks == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    parallel_for(import_chunk_count, _count_csv_rows, NULL);
+
+    size_t rows = 0;
+    for (size_t c = 0; c < import_chunk_count; c++) {
+        import_chunks[c].first_row = rows;
+        rows += import_chunks[c].rows;
+    }
+    return rows;
+}
+
+size_t _count_binary(void) {
+    size_t record_size = sizeof(float) * COUNT_IMPORT_FIELDS;
+    if (import_size % record_size != 0) {
+        fprintf(stderr, "[ERROR]: Seed file size is not a multiple of the %zu byte record\n", record_size);
+        exit(EXIT_FAILURE);
+    }
+    return import_size / record_size;
+}
+
+void _exit_on_import_error(const char* path) {
+    const ImportError* first = NULL;
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        const ImportError* e = &import_errors[w];
+        if (e->message != NULL && (first == NULL || e->row < first->row)) first = e;
+    }
+    if (first == NULL) return;
+
+    fprintf(stderr, "[ERROR]: Seed file '%s' is invalid at seed %zu: %s\n", path, first->row + 1, first->message);
+    exit(EXIT_FAILURE);
+}
+
+// A row belongs to the chunk its first byte is in, a chunk starting mid row skips ahead to the next one
+size_t _chunk_begin(size_t chunk) {
+    size_t offset = chunk * IMPORT_CSV_CHUNK;
+    if (offset == 0 || import_data[offset - 1] == '\n') return offset;
+
+    const char* newline = memchr(import_data + offset, '\n', import_size - offset);
+    return newline == NULL ? import_size : (size_t)(newline - import_data) + 1;
+}
+
+size_t _chunk_end(size_t chunk) {
+    size_t offset = (chunk + 1) * IMPORT_CSV_CHUNK;
+    return offset < import_size ? offset : import_size;
+}
+
+const char* _next_row(const char* row) {
+    const char* newline = memchr(row, '\n', import_data + import_size - row);
+    return newline == NULL ? import_data + import_size : newline + 1;
+}
+
+// Blank rows anywhere and a header naming the columns on the first row are not seeds
+bool _is_skipped_row(const char* row, const char* end) {
+    const char* p = row;
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+
+    if (p == end) return true;
+    return row == import_data && (*p == '"' || (*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z'));
+}
+
+void _count_csv_rows(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    UNUSED(ctx);
+
+    for (size_t c = begin; c < end; c++) {
+        const char* chunk_end = import_data + _chunk_end(c);
+        const char* row = import_data + _chunk_begin(c);
+        size_t rows = 0;
+        while (row < chunk_end) {
+            const char* next = _next_row(row);
+            if (!_is_skipped_row(row, next)) rows++;
+            row = next;
+        }
+        import_chunks[c].rows = rows;
+    }
+}
+
+void _parse_csv_rows(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(ctx);
+
+    float fields[COUNT_IMPORT_FIELDS];
+    for (size_t c = begin; c < end; c++) {
+        const char* chunk_end = import_data + _chunk_end(c);
+        const char* row = import_data + _chunk_begin(c);
+        size_t i = import_chunks[c].first_row;
+        while (row < chunk_end) {
+            const char* next = _next_row(row);
+            if (!_is_skipped_row(row, next)) {
+                const char* error = _parse_csv_row(row, next, fields);
+                if (error == NULL) error = _import_seed(i, fields);
+                if (error != NULL) _report_import_error(worker, i, error);
+                i++;
+            }
+            row = next;
+        }
+    }
+}
+
+// Returns NULL once the row is split into fields, missing trailing columns are 0
+const char* _parse_csv_row(const char* row, const char* end, float* fields) {
+    const char* p = row;
+    size_t count = 0;
+
+    memset(fields, 0, sizeof(float) * COUNT_IMPORT_FIELDS);
+    while (true) {
+        if (count == COUNT_IMPORT_FIELDS) return "too many columns";
+        if (!_parse_float(&p, end, &fields[count++])) return "column is not a number";
+
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+        if (p == end || *p == '\n') break;
+        if (*p++ != ',') return "columns must be separated by ','";
+    }
+    return count < 2 ? "a row needs at least x and y" : NULL;
+}
+
+// Decimal with an optional fraction and exponent. The mapping is not NUL terminated, so strtof can not be used
+bool _parse_float(const char** p, const char* end, float* value) {
+    const char* s = *p;
+    while (s < end && (*s == ' ' || *s == '\t')) s++;
+
+    bool negative = s < end && *s == '-';
+    if (s < end && (*s == '-' || *s == '+')) s++;
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    size_t digits = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+        if (mantissa < UINT64_MAX / 10) {
+            mantissa = mantissa * 10 + (*s - '0');
+        } else {
+            exponent++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && *s >= '0' && *s <= '9'; s++, digits++) {
+            if (mantissa < UINT64_MAX / 10) {
+                mantissa = mantissa * 10 + (*s - '0');
+                exponent--;
+            }
+        }
+    }
+    if (digits == 0) return false;
+
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        s++;
+        bool exp_negative = s < end && *s == '-';
+        if (s < end && (*s == '-' || *s == '+')) s++;
+        if (s == end || *s < '0' || *s > '9') return false;
+
+        int e = 0;
+        for (; s < end && *s >= '0' && *s <= '9'; s++) {
+            if (e < 10000) e = e * 10 + (*s - '0');
+        }
+        exponent += exp_negative ? -e : e;
+    }
+
+    double v = (double)mantissa;
+    if (exponent >= 0 && exponent <= 22) {
+        v *= import_pow10[exponent];
+    } else if (exponent < 0 && exponent >= -22) {
+        v /= import_pow10[-exponent];
+    } else {
+        v *= pow(10.0, exponent);
+    }
+    *value = (float)(negative ? -v : v);
+    *p = s;
+    return true;
+}
+
+// Records are read where they are mapped, nothing is copied before the seeds themselves
+void _read_binary_records(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(ctx);
+
+    const float* records = (const float*)import_data;
+    for (size_t i = begin; i < end; i++) {
+        const char* error = _import_seed(i, &records[i * COUNT_IMPORT_FIELDS]);
+        if (error != NULL) _report_import_error(worker, i, error);
+    }
+}
+
+const char* _import_seed(size_t i, const float* fields) {
+    for (int f = 0; f < COUNT_IMPORT_FIELDS; f++) {
+        if (!isfinite(fields[f])) return "value is not finite";
+    }
+    float radius = fields[IMPORT_RADIUS];
+    if (radius < 0.0f || radius > IMPORT_MAX_RADIUS) return "radius out of range";
+
+    Seed* s = &import_seeds[i];
+    s->pos = (vec2){fields[IMPORT_X], fields[IMPORT_Y]};
+    s->vel = (vec2){fields[IMPORT_VX], fields[IMPORT_VY]};
+    s->acc = (vec2){0.0f, 0.0f};
+    s->radius = radius == 0.0f ? import_radius : fmaxf(roundf(radius), 1.0f);
+
+    if (fields[IMPORT_R] == 0.0f && fields[IMPORT_G] == 0.0f && fields[IMPORT_B] == 0.0f) {
+        Rng rng = rng_stream(&import_rng, i);
+        s->color.x = rand_float(&rng);
+        s->color.y = rand_float(&rng);
+        s->color.z = rand_float(&rng);
+    } else {
+        s->color = (vec4){fields[IMPORT_R], fields[IMPORT_G], fields[IMPORT_B], 0.0f};
+    }
+    s->color.w = 1.0f;
+    return NULL;
+}
+
+void _report_import_error(size_t worker, size_t row, const char* message) {
+    ImportError* e = &import_errors[worker];
+    if (e->message != NULL && e->row <= row) return;
+
+    e->message = message;
+    e->row = row;
+}
@@ -10,47 +10,103 @@
 #define GLFW_INCLUDE_GLEXT
 #include <GLFW/glfw3.h>
 
+#include "args.h"
+#include "ensemble.h"
 #include "helpers.h"
+#include "history.h"
+#include "import.h"
 #include "main.h"
+#include "obstacles.h"
+#include "parallel.h"
+#include "record.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
 void init_signal_handler(void);
 void _signal_handler(int signal);
 void _exit_handler(void);
 
+Sim2D* sim = NULL;
+
+int SEED_RADIUS = DEFAULT_SEED_RADIUS;
+size_t SEED_COUNT = DEFAULT_SEED_COUNT;
+size_t REORDER_INTERVAL = DEFAULT_REORDER_INTERVAL;
+size_t HISTORY_MB = DEFAULT_HISTORY_MB;
+float BH_THETA = DEFAULT_BH_THETA;
+int WORLD_WIDTH = DEFAULT_WORLD_WIDTH;
+int WORLD_HEIGHT = DEFAULT_WORLD_HEIGHT;
+Integrator INTEGRATOR = INTEGRATOR_IMPULSE;
+uint64_t RAND_SEED = 0;
+bool HAS_RAND_SEED = false;
+
 Mode SIM_MODE = MODE_VORONOI;
+Mode NEXT_MODE = MODE_VORONOI;
 double DELTA_TIME = 0.0;
 
+const char* BENCH_NAME = NULL;
+
 bool IS_PAUSE = false;
+bool IS_DETERMINISTIC = false;
 bool IS_DRAG_MODE = false;
+bool IS_LASSO_MODE = false;
+bool IS_PAN_MODE = false;
 bool IS_RUNNING = false;
 
-void (*render_frame)(GLFWwindow*, double, int, int) = NULL;
+void (*step_frame)(GLFWwindow*, double, int, int) = NULL;
 
 // Main function
 int main(int argc, char** argv) {
-    srand(time(0));
-
     get_arguments(argc, argv);
+    if (OBSTACLES_PATH != NULL) load_obstacles(OBSTACLES_PATH);
     init_signal_handler();
     atexit(_exit_handler);
 
-    init_sim_mode(SIM_MODE);
+    init_trace();
+    TRACE_THREAD("main");
+
+    // Ensemble worlds are too small to split, its threads each step whole worlds and leave the pool idle
+    if (ENSEMBLE_WORLDS > 0) {
+        run_ensemble();
+        return 0;
+    }
+    init_thread_pool(THREAD_COUNT);
+
+    if (BENCH_NAME != NULL) {
+        run_bench(BENCH_NAME);
+        return 0;
+    }
+    step_frame = step_sim_frame;
+    if (REPLAY_PATH != NULL) {
+        init_replay(REPLAY_PATH);
+    } else if (SNAPSHOT_LOAD_PATH != NULL) {
+        load_snapshot(SNAPSHOT_LOAD_PATH);
+    } else if (INIT_FROM_PATH != NULL) {
+        load_initial_seeds(INIT_FROM_PATH);
+    } else {
+        SimConfig config = app_sim_config();
+        sim = init_sim(&config);
+        printf("[INFO]: Random seed %llu, pass [--seed %llu] to generate the same seeds again\n",
+               (unsigned long long)config.rng_seed, (unsigned long long)config.rng_seed);
+    }
+    SIM_MODE = sim_mode(sim);
+    NEXT_MODE = SIM_MODE;
+    if (RECORD_PATH != NULL && REPLAY_PATH == NULL) init_recorder(RECORD_PATH);
 
     GLFWwindow* window;
-    GLuint program;
 
     init_glfw_settings();
     window = init_glfw_window();
     load_gl_extensions();
     init_glfw_callbacks(window);
     init_gl_settings();
+    fit_camera(DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
 
-    init_shaders(&program,
-                 vertex_files[GENERAL_VERTEX],
-                 fragment_files[SIM_MODE]);
-
-    glUseProgram(program);
-    init_gl_uniforms(program);
+    init_mode_programs();
+    init_overlay();
+    init_obstacle_lines();
+    use_mode_program(SIM_MODE, DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    init_stats();
 
     // ---------------------
     render_loop(window);
@@ -72,6 +128,9 @@ void render_loop(GLFWwindow* window) {
 
     glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
     while (!glfwWindowShouldClose(window) && IS_RUNNING) {
+        TRACE_ZONE("frame");
+        double frame_start = now_ms();
+
         glfwGetWindowSize(window, &width, &height);
         if (width != prev_width || height != prev_height) {
             prev_width = width;
@@ -79,25 +138,82 @@ void render_loop(GLFWwindow* window) {
             update_gl_uniforms(width, height);
         }
 
-        float sub_dt = dt / SUB_STEPS;
-        for (size_t i = 0; i < SUB_STEPS; ++i) {
-            render_frame(window, sub_dt, width, height);
+        if (NEXT_MODE != SIM_MODE) {
+            switch_sim_mode(sim, NEXT_MODE);
+            SIM_MODE = NEXT_MODE;
+            use_mode_program(SIM_MODE, width, height);
+        }
+
+        // As many substeps as the fastest seed of the last frame needs, calm scenes take a single one. Only
+        // the last one is drawn, a swap per substep would wait for vsync and stretch the next frame's dt.
+        // A replay plays whole recorded frames, it is stepped once
+        size_t sub_steps = REPLAY_PATH != NULL ? 1 : sim_adaptive_sub_steps(sim, dt);
+        float sub_dt = dt / sub_steps;
+        for (size_t i = 0; i < sub_steps; ++i) {
+            step_frame(window, sub_dt, width, height);
+        }
+
+        // The reorder interval and the recording count rendered frames, whatever their substeps. Paused frames
+        // and steps back add nothing, a replay does not step the simulation
+        if (dt > 0.0 && REPLAY_PATH == NULL) {
+            sim_end_frame(sim);
+            record_frame();
+        }
+
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        draw_seeds(width, height);
+        render_obstacles(width, height);
+        render_selection(width, height);
+        render_overlay(width, height);
+        {
+            TRACE_ZONE("swap_buffers");
             glfwSwapBuffers(window);
+        }
+        {
+            TRACE_ZONE("poll_events");
             glfwPollEvents();
         }
 
+        // Requested from the key callback or SIGUSR1, saved between frames so no step is half applied
+        if (IS_SNAPSHOT_REQUESTED) {
+            IS_SNAPSHOT_REQUESTED = 0;
+            save_snapshot(SNAPSHOT_FILE_PATH);
+        }
+
+        stats_record_frame(now_ms() - frame_start);
+
         double cur_time = glfwGetTime();
-        dt = !IS_PAUSE ? cur_time - prev_time : DELTA_TIME;
+        // Deterministic runs advance by a fixed step, whatever the frame actually took
+        dt = IS_PAUSE ? DELTA_TIME : IS_DETERMINISTIC ? DETERMINISTIC_FRAME_DT : cur_time - prev_time;
         prev_time = cur_time;
     }
 }
 
+// Replays keep no history, there is nothing to step back through
+SimConfig app_sim_config(void) {
+    SimConfig config = default_sim_config();
+    config.mode = SIM_MODE;
+    config.integrator = INTEGRATOR;
+    config.seed_count = SEED_COUNT;
+    config.seed_radius = SEED_RADIUS;
+    config.reorder_interval = REORDER_INTERVAL;
+    config.history_bytes = REPLAY_PATH == NULL ? HISTORY_MB * 1024 * 1024 : 0;
+    config.rng_seed = HAS_RAND_SEED ? RAND_SEED : IS_DETERMINISTIC ? DETERMINISTIC_RAND_SEED : (uint64_t)time(0);
+    config.deterministic = IS_DETERMINISTIC;
+    config.world_width = WORLD_WIDTH;
+    config.world_height = WORLD_HEIGHT;
+    config.bh_theta = BH_THETA;
+    config.obstacles = obstacles;
+    config.obstacle_count = obstacle_count;
+    return config;
+}
+
 void init_signal_handler(void) {
     struct sigaction action;
     action.sa_handler = &_signal_handler;
     sigemptyset(&action.sa_mask);
     action.sa_flags = 0;
-    if (sigaction(SIGINT, &action, NULL) < 0) {
+    if (sigaction(SIGINT, &action, NULL) < 0 || sigaction(SIGUSR1, &action, NULL) < 0) {
         printf("[ERROR]: Failed to set signal action");
         exit(EXIT_FAILURE);
     }
@@ -108,13 +224,26 @@ void _signal_handler(int signal) {
         case SIGINT:
             IS_RUNNING = false;
             break;
+        case SIGUSR1:
+            IS_SNAPSHOT_REQUESTED = 1;
+            break;
         default:
             break;
     }
 }
 
 void _exit_handler(void) {
+#ifdef TRACE
+    trace_dump(TRACE_FILE_PATH);
+#endif
+    if (sim != NULL) print_alloc_stats(sim);
     printf("[INFO]: Goodbye, stranger!\n");
-    free_sim_mode();
+    free_recorder();
+    free_replay();
+    free_sim(sim);
+    sim = NULL;
+    free_thread_pool();
+    free_trace();
+    free_stats();
     glfwTerminate();
 }
\ No newline at end of file
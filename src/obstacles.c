@@ -0,0 +1,100 @@
+#include "obstacles.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// This source inner helpers
+void _parse_obstacle_chain(const char* line, size_t row);
+const char* _parse_obstacle_point(const char* p, size_t row, vec2* point);
+void _add_obstacle(vec2 a, vec2 b, size_t row);
+void _exit_on_obstacle_error(size_t row, const char* message);
+
+const char* OBSTACLES_PATH = NULL;
+
+Segment* obstacles = NULL;
+size_t obstacle_count = 0;
+size_t obstacle_capacity = 0;
+const char* obstacle_path = NULL;  // file being parsed, for the error messages
+
+// Function definitions
+// ---------------------
+// Every line is a chain of points 'x,y x,y ...' in world coordinates, each two neighbouring points make a segment.
+// A polygon repeats its first point at the end. Empty lines and anything after '#' are skipped
+void load_obstacles(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open obstacle file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    obstacle_path = path;
+    char* line = NULL;
+    size_t line_capacity = 0;
+    for (size_t row = 1; getline(&line, &line_capacity, file) != -1; row++) {
+        _parse_obstacle_chain(line, row);
+    }
+    free(line);
+    fclose(file);
+
+    if (obstacle_count == 0) {
+        fprintf(stderr, "[ERROR]: Obstacle file '%s' holds no segments\n", path);
+        exit(EXIT_FAILURE);
+    }
+    printf("[INFO]: %zu obstacle segments loaded from '%s'\n", obstacle_count, path);
+}
+
+// Private function definitions
+// ---------------------
+void _parse_obstacle_chain(const char* line, size_t row) {
+    const char* p = line;
+    vec2 prev = {0.0f, 0.0f};
+    size_t points = 0;
+
+    for (;;) {
+        while (isspace((unsigned char)*p)) p++;
+        if (*p == '\0' || *p == '#') break;
+
+        vec2 point;
+        p = _parse_obstacle_point(p, row, &point);
+        if (points > 0) _add_obstacle(prev, point, row);
+        prev = point;
+        points++;
+    }
+
+    if (points == 1) _exit_on_obstacle_error(row, "a chain needs at least two points");
+}
+
+const char* _parse_obstacle_point(const char* p, size_t row, vec2* point) {
+    char* end;
+    point->x = strtof(p, &end);
+    if (end == p || *end != ',') _exit_on_obstacle_error(row, "expected a point as x,y");
+
+    p = end + 1;
+    point->y = strtof(p, &end);
+    if (end == p || !(*end == '\0' || *end == '#' || isspace((unsigned char)*end))) {
+        _exit_on_obstacle_error(row, "expected a point as x,y");
+    }
+    if (!isfinite(point->x) || !isfinite(point->y)) _exit_on_obstacle_error(row, "coordinates must be finite");
+    return end;
+}
+
+void _add_obstacle(vec2 a, vec2 b, size_t row) {
+    if (obstacle_count == OBSTACLE_MAX_COUNT) _exit_on_obstacle_error(row, "too many segments");
+
+    if (obstacle_count == obstacle_capacity) {
+        obstacle_capacity = obstacle_capacity > 0 ? 2 * obstacle_capacity : 64;
+        obstacles = realloc(obstacles, sizeof(Segment) * obstacle_capacity);
+        if (obstacles == NULL) {
+            printf("[ERROR]: Memory was not allocated\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    obstacles[obstacle_count++] = (Segment){a, b};
+}
+
+void _exit_on_obstacle_error(size_t row, const char* message) {
+    fprintf(stderr, "[ERROR]: Obstacle file '%s' line %zu: %s\n", obstacle_path, row, message);
+    exit(EXIT_FAILURE);
+}
@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <errno.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,6 +8,10 @@
 #include <time.h>
 
 #include "main.h"
+#include "record.h"
+#include "snapshot.h"
+#include "stats.h"
+#include "trace.h"
 
 // This source inner helpers
 const char* _shader_type_as_cstr(GLuint shader);
@@ -20,10 +25,14 @@ void _message_callback(GLenum source, GLenum type, GLuint id, GLenum severity, G
 void _window_resize_callback(GLFWwindow* window, int width, int height);
 void _key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void _mouse_callback(GLFWwindow* window, int button, int action, int mods);
+void _cursor_callback(GLFWwindow* window, double xpos, double ypos);
+void _scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 
-static_assert(COUNT_UNIFORMS == 1, "Update list of uniform names");
+static_assert(COUNT_UNIFORMS == 3, "Update list of uniform names");
 const char* uniform_names[COUNT_UNIFORMS] = {
     [RESOLUTION_UNIFORM] = "resolution",
+    [CAMERA_UNIFORM] = "camera",
+    [ZOOM_UNIFORM] = "zoom",
 };
 
 static_assert(COUNT_VERTICES == 1, "Update list of vertex file paths");
@@ -31,16 +40,25 @@ const char* vertex_files[COUNT_VERTICES] = {
     [GENERAL_VERTEX] =  VERTEX_FILE_PATH,
 };
 
-static_assert(COUNT_FRAGMENTS == 3, "Update list of fragment file paths");
+static_assert(COUNT_FRAGMENTS == 6, "Update list of fragment file paths");
 const char* fragment_files[COUNT_FRAGMENTS] = {
     [VORONOI_FRAGMENT] = VORONOI_FRAGMENT_FILE_PATH,
     [ATOMS_FRAGMENT] = ATOMS_FRAGMENT_FILE_PATH,
     [BUBBLES_FRAGMENT] = BUBBLES_FRAGMENT_FILE_PATH,
+    [SPRINGS_FRAGMENT] = SPRINGS_FRAGMENT_FILE_PATH,
+    [GALAXY_FRAGMENT] = GALAXY_FRAGMENT_FILE_PATH,
+    [FLUID_FRAGMENT] = FLUID_FRAGMENT_FILE_PATH,
 };
 
+static_assert((int)COUNT_FRAGMENTS == (int)COUNT_MODES, "Every mode needs its own fragment file");
+
 GLuint vbo = 0;
 GLuint vao = 0;
 GLint uniforms[COUNT_UNIFORMS];
+GLuint programs[COUNT_MODES];
+
+Camera camera = {{DEFAULT_WORLD_WIDTH / 2, DEFAULT_WORLD_HEIGHT / 2}, 1.0f};
+vec2 pan_cursor;  // window position the pan last moved the camera from
 
 // Function definitions
 // ---------------------
@@ -50,12 +68,30 @@ void init_gl_uniforms(GLuint program) {
     }
 
     glUniform2f(uniforms[RESOLUTION_UNIFORM], DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT);
+    glUniform2f(uniforms[CAMERA_UNIFORM], camera.center.x, camera.center.y);
+    glUniform1f(uniforms[ZOOM_UNIFORM], camera.zoom);
 }
 
 void update_gl_uniforms(int width, int height) {
     glUniform2f(uniforms[RESOLUTION_UNIFORM], width, height);
 }
 
+// Whole world in view, centered
+void fit_camera(int width, int height) {
+    camera.center = (vec2){WORLD_WIDTH / 2.0f, WORLD_HEIGHT / 2.0f};
+    camera.zoom = fminf((float)width / WORLD_WIDTH, (float)height / WORLD_HEIGHT);
+}
+
+vec2 screen_to_world(vec2 screen, int width, int height) {
+    vec2 half = {width / 2.0f, height / 2.0f};
+    return vec2_add(camera.center, vec2_scale(vec2_sub(screen, half), 1.0f / camera.zoom));
+}
+
+vec2 world_to_screen(vec2 world, int width, int height) {
+    vec2 half = {width / 2.0f, height / 2.0f};
+    return vec2_add(vec2_scale(vec2_sub(world, camera.center), camera.zoom), half);
+}
+
 void init_glfw_settings(void) {
     if (!glfwInit()) {
         fprintf(stderr, "[ERROR]: Could not initialize GLFW\n");
@@ -104,6 +140,8 @@ void init_glfw_callbacks(GLFWwindow* window) {
 #endif
     glfwSetKeyCallback(window, _key_callback);
     glfwSetMouseButtonCallback(window, _mouse_callback);
+    glfwSetCursorPosCallback(window, _cursor_callback);
+    glfwSetScrollCallback(window, _scroll_callback);
     glfwSetFramebufferSizeCallback(window, _window_resize_callback);
 }
 
@@ -117,7 +155,7 @@ void init_gl_settings(void) {
 
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(seeds[0]) * SEED_COUNT, seeds, GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Seed) * sim_seed_count(sim), sim_seeds(sim), GL_DYNAMIC_DRAW);
 
     {
         glEnableVertexAttribArray(ATTRIB_POS);
@@ -125,7 +163,7 @@ void init_gl_settings(void) {
                               2,
                               GL_FLOAT,
                               GL_FALSE,
-                              sizeof(seeds[0]),
+                              sizeof(Seed),
                               (void*)0);
         glVertexAttribDivisor(ATTRIB_POS, 1);
     }
@@ -135,7 +173,7 @@ void init_gl_settings(void) {
                               4,
                               GL_FLOAT,
                               GL_FALSE,
-                              sizeof(seeds[0]),
+                              sizeof(Seed),
                               (void*)(sizeof(float) * 2));
         glVertexAttribDivisor(ATTRIB_COLOR, 1);
     }
@@ -144,7 +182,7 @@ void init_gl_settings(void) {
         glVertexAttribIPointer(ATTRIB_RADIUS,
                                1,
                                GL_INT,
-                               sizeof(seeds[0]),
+                               sizeof(Seed),
                                (void*)(sizeof(float) * 6));
         glVertexAttribDivisor(ATTRIB_RADIUS, 1);
     }
@@ -156,6 +194,71 @@ void init_shaders(GLuint* program, const char* vert_file_path, const char* frag_
     }
 }
 
+// Compile every mode program up front so switching modes is just a rebind
+void init_mode_programs(void) {
+    for (Mode mode = 0; mode < COUNT_MODES; mode++) {
+        init_shaders(&programs[mode],
+                     vertex_files[GENERAL_VERTEX],
+                     fragment_files[mode]);
+    }
+}
+
+void use_mode_program(Mode mode, int width, int height) {
+    glUseProgram(programs[mode]);
+    init_gl_uniforms(programs[mode]);
+    update_gl_uniforms(width, height);
+}
+
+// Steps the simulation with the cursor flipped and taken through the camera into world coordinates. The
+// world keeps its size whatever the window
+void step_sim_frame(GLFWwindow* window, double dt, int width, int height) {
+    double xpos, ypos;
+    glfwGetCursorPos(window, &xpos, &ypos);
+    SimInput input = {
+        .cursor = screen_to_world((vec2){(float)xpos, height - (float)ypos}, width, height),
+        .drag = IS_DRAG_MODE,
+        .lasso = IS_LASSO_MODE,
+    };
+    set_sim_input(sim, &input);
+
+    step_sim(sim, dt, WORLD_WIDTH, WORLD_HEIGHT);
+}
+
+// Only the seeds in view are packed into the instance buffer, written in place through a mapping. Voronoi
+// cells of seeds off screen reach into the view, so that mode keeps a margin around it
+void draw_seeds(int width, int height) {
+    SimCounters* counters = sim_counters(sim);
+    size_t seed_count = sim_seed_count(sim);
+
+    vec2 lo = screen_to_world((vec2){0.0f, 0.0f}, width, height);
+    vec2 hi = screen_to_world((vec2){width, height}, width, height);
+    if (SIM_MODE == MODE_VORONOI) {
+        vec2 margin = vec2_scale(vec2_sub(hi, lo), VORONOI_CULL_MARGIN);
+        lo = vec2_sub(lo, margin);
+        hi = vec2_add(hi, margin);
+    }
+
+    double start = now_ms();
+    size_t visible = 0;
+    {
+        TRACE_ZONE("upload");
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        Seed* instances = glMapBufferRange(GL_ARRAY_BUFFER, 0, sizeof(Seed) * seed_count,
+                                           GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (instances != NULL) {
+            visible = sim_seeds_in_rect(sim, lo, hi, instances);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+    }
+    counters->upload_ms += now_ms() - start;
+    {
+        TRACE_ZONE("draw");
+        glUniform2f(uniforms[CAMERA_UNIFORM], camera.center.x, camera.center.y);
+        glUniform1f(uniforms[ZOOM_UNIFORM], camera.zoom);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, visible);
+    }
+}
+
 // Private function definitions
 // ---------------------
 const char* _shader_type_as_cstr(GLuint shader) {
@@ -305,13 +408,28 @@ void _window_resize_callback(GLFWwindow* window, int width, int height) {
 void _key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
     UNUSED(scancode);
     UNUSED(mods);
-    UNUSED(window);
 
     if (action == GLFW_PRESS) {
         if (key == GLFW_KEY_SPACE) {
             IS_PAUSE = !IS_PAUSE;
         } else if (key == GLFW_KEY_Q) {
             IS_RUNNING = false;
+        } else if (key == GLFW_KEY_O) {
+            IS_OVERLAY = !IS_OVERLAY;
+        } else if (key == GLFW_KEY_T) {
+            trace_dump(TRACE_FILE_PATH);
+        } else if (key == GLFW_KEY_S) {
+            IS_SNAPSHOT_REQUESTED = 1;
+        } else if (key == GLFW_KEY_HOME) {
+            int width, height;
+            glfwGetWindowSize(window, &width, &height);
+            fit_camera(width, height);
+        } else if (key >= GLFW_KEY_1 && key < GLFW_KEY_1 + COUNT_MODES && REPLAY_PATH == NULL) {
+            NEXT_MODE = key - GLFW_KEY_1;
+        } else if (key == GLFW_KEY_UP && REPLAY_SPEED < MAX_REPLAY_SPEED) {
+            REPLAY_SPEED *= 2;
+        } else if (key == GLFW_KEY_DOWN && REPLAY_SPEED > 1) {
+            REPLAY_SPEED /= 2;
         }
 
         if (IS_PAUSE) {
@@ -330,14 +448,58 @@ void _key_callback(GLFWwindow* window, int key, int scancode, int action, int mo
 }
 
 void _mouse_callback(GLFWwindow* window, int button, int action, int mods) {
-    UNUSED(mods);
-    UNUSED(window);
-
+    // Shift traces a lasso instead of dragging, the selection is taken when the button comes up
     if (action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_LEFT) {
-        IS_DRAG_MODE = true;
+        if (mods & GLFW_MOD_SHIFT) {
+            IS_LASSO_MODE = true;
+        } else {
+            IS_DRAG_MODE = true;
+        }
     }
 
     if (action == GLFW_RELEASE && button == GLFW_MOUSE_BUTTON_LEFT) {
         IS_DRAG_MODE = false;
+        IS_LASSO_MODE = false;
     }
+
+    if (action == GLFW_PRESS && button == GLFW_MOUSE_BUTTON_RIGHT && !IS_DRAG_MODE) {
+        clear_selection(sim);
+    }
+
+    if (button == GLFW_MOUSE_BUTTON_MIDDLE) {
+        IS_PAN_MODE = action == GLFW_PRESS;
+        double xpos, ypos;
+        glfwGetCursorPos(window, &xpos, &ypos);
+        pan_cursor = (vec2){(float)xpos, (float)ypos};
+    }
+}
+
+// Panning moves the world along with the cursor, window y points down
+void _cursor_callback(GLFWwindow* window, double xpos, double ypos) {
+    UNUSED(window);
+    if (!IS_PAN_MODE) return;
+
+    vec2 cursor = {(float)xpos, (float)ypos};
+    vec2 delta = vec2_sub(cursor, pan_cursor);
+    camera.center.x -= delta.x / camera.zoom;
+    camera.center.y += delta.y / camera.zoom;
+    pan_cursor = cursor;
+}
+
+// Zooms around the cursor, the world point under it stays where it is
+void _scroll_callback(GLFWwindow* window, double xoffset, double yoffset) {
+    UNUSED(xoffset);
+
+    int width, height;
+    double xpos, ypos;
+    glfwGetWindowSize(window, &width, &height);
+    glfwGetCursorPos(window, &xpos, &ypos);
+    vec2 cursor = {(float)xpos, height - (float)ypos};
+    vec2 anchor = screen_to_world(cursor, width, height);
+
+    camera.zoom *= powf(CAMERA_ZOOM_STEP, (float)yoffset);
+    camera.zoom = fminf(fmaxf(camera.zoom, CAMERA_MIN_ZOOM), CAMERA_MAX_ZOOM);
+
+    vec2 half = {width / 2.0f, height / 2.0f};
+    camera.center = vec2_sub(anchor, vec2_scale(vec2_sub(cursor, half), 1.0f / camera.zoom));
 }
\ No newline at end of file
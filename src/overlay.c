@@ -0,0 +1,316 @@
+#include <ctype.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "stats.h"
+
+#define OVERLAY_MAX_RECTS 8192
+#define OVERLAY_MARGIN 10.0f
+#define OVERLAY_PADDING 8.0f
+#define OVERLAY_SUMMARY_FRAMES 60
+
+#define GLYPH_WIDTH 3
+#define GLYPH_HEIGHT 5
+#define GLYPH_SCALE 2.0f
+#define GLYPH_ADVANCE ((GLYPH_WIDTH + 1) * GLYPH_SCALE)
+#define LINE_HEIGHT ((GLYPH_HEIGHT + 2) * GLYPH_SCALE)
+
+#define GRAPH_BAR_WIDTH 2.0f
+#define GRAPH_HEIGHT 80.0f
+#define GRAPH_MAX_MS (2.0 * 1000.0 / 60.0)
+#define GRAPH_BUDGET_MS (1000.0 / 60.0)
+
+#define LASSO_DOT_SIZE 2.0f
+#define SELECTION_PADDING 6.0f
+
+typedef struct {
+    vec2 pos;
+    vec2 size;
+    vec4 color;
+} OverlayRect;
+
+typedef enum {
+    OVERLAY_ATTRIB_POS = 0,
+    OVERLAY_ATTRIB_SIZE,
+    OVERLAY_ATTRIB_COLOR,
+    COUNT_OVERLAY_ATTRIBS
+} OverlayAttrib;
+
+// This source inner helpers
+void _push_rect(float x, float y, float w, float h, vec4 color);
+void _push_text(float x, float y, const char* text, vec4 color);
+void _push_graph(float x, float y);
+void _push_segment(vec2 a, vec2 b, vec4 color);
+void _push_frame(vec2 lo, vec2 hi, vec4 color);
+void _draw_rects(int width, int height);
+
+// 3x5 bitmap font, one row per byte from the top, the leftmost pixel is the highest bit
+const uint8_t glyphs[128][GLYPH_HEIGHT] = {
+    ['0'] = {7, 5, 5, 5, 7}, ['1'] = {2, 6, 2, 2, 7}, ['2'] = {7, 1, 7, 4, 7}, ['3'] = {7, 1, 7, 1, 7},
+    ['4'] = {5, 5, 7, 1, 1}, ['5'] = {7, 4, 7, 1, 7}, ['6'] = {7, 4, 7, 5, 7}, ['7'] = {7, 1, 1, 1, 1},
+    ['8'] = {7, 5, 7, 5, 7}, ['9'] = {7, 5, 7, 1, 7},
+    ['A'] = {2, 5, 7, 5, 5}, ['B'] = {6, 5, 6, 5, 6}, ['C'] = {3, 4, 4, 4, 3}, ['D'] = {6, 5, 5, 5, 6},
+    ['E'] = {7, 4, 6, 4, 7}, ['F'] = {7, 4, 6, 4, 4}, ['G'] = {3, 4, 5, 5, 3}, ['H'] = {5, 5, 7, 5, 5},
+    ['I'] = {7, 2, 2, 2, 7}, ['J'] = {1, 1, 1, 5, 2}, ['K'] = {5, 5, 6, 5, 5}, ['L'] = {4, 4, 4, 4, 7},
+    ['M'] = {5, 7, 7, 5, 5}, ['N'] = {6, 5, 5, 5, 5}, ['O'] = {2, 5, 5, 5, 2}, ['P'] = {6, 5, 6, 4, 4},
+    ['Q'] = {2, 5, 5, 6, 3}, ['R'] = {6, 5, 6, 5, 5}, ['S'] = {3, 4, 2, 1, 6}, ['T'] = {7, 2, 2, 2, 2},
+    ['U'] = {5, 5, 5, 5, 7}, ['V'] = {5, 5, 5, 5, 2}, ['W'] = {5, 5, 7, 7, 5}, ['X'] = {5, 5, 2, 5, 5},
+    ['Y'] = {5, 5, 2, 2, 2}, ['Z'] = {7, 1, 2, 4, 7},
+    ['.'] = {0, 0, 0, 0, 2}, ['/'] = {1, 1, 2, 4, 4}, [':'] = {0, 2, 0, 2, 0}, ['-'] = {0, 0, 7, 0, 0},
+    ['+'] = {0, 2, 7, 2, 0}, ['%'] = {5, 1, 2, 4, 5}, ['\''] = {2, 2, 0, 0, 0},
+};
+
+GLuint overlay_program;
+GLuint overlay_vao;
+GLuint overlay_vbo;
+GLint overlay_resolution;
+
+GLuint obstacle_program;
+GLuint obstacle_vao;
+GLuint obstacle_vbo;
+GLint obstacle_uniforms[COUNT_UNIFORMS];
+size_t obstacle_vertex_count = 0;
+
+OverlayRect overlay_rects[OVERLAY_MAX_RECTS];
+size_t overlay_rect_count = 0;
+
+// Function definitions
+// ---------------------
+void init_overlay(void) {
+    init_shaders(&overlay_program, OVERLAY_VERTEX_FILE_PATH, OVERLAY_FRAGMENT_FILE_PATH);
+    overlay_resolution = glGetUniformLocation(overlay_program, uniform_names[RESOLUTION_UNIFORM]);
+
+    glGenVertexArrays(1, &overlay_vao);
+    glBindVertexArray(overlay_vao);
+
+    glGenBuffers(1, &overlay_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(overlay_rects), NULL, GL_STREAM_DRAW);
+
+    {
+        glEnableVertexAttribArray(OVERLAY_ATTRIB_POS);
+        glVertexAttribPointer(OVERLAY_ATTRIB_POS,
+                              2,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              sizeof(OverlayRect),
+                              (void*)0);
+        glVertexAttribDivisor(OVERLAY_ATTRIB_POS, 1);
+    }
+    {
+        glEnableVertexAttribArray(OVERLAY_ATTRIB_SIZE);
+        glVertexAttribPointer(OVERLAY_ATTRIB_SIZE,
+                              2,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              sizeof(OverlayRect),
+                              (void*)(sizeof(float) * 2));
+        glVertexAttribDivisor(OVERLAY_ATTRIB_SIZE, 1);
+    }
+    {
+        glEnableVertexAttribArray(OVERLAY_ATTRIB_COLOR);
+        glVertexAttribPointer(OVERLAY_ATTRIB_COLOR,
+                              4,
+                              GL_FLOAT,
+                              GL_FALSE,
+                              sizeof(OverlayRect),
+                              (void*)(sizeof(float) * 4));
+        glVertexAttribDivisor(OVERLAY_ATTRIB_COLOR, 1);
+    }
+
+    // The seeds keep their own vertex array bound between frames
+    glBindVertexArray(vao);
+}
+
+// Obstacles never move, their segments are uploaded once and each one drawn as a line of two vertices
+void init_obstacle_lines(void) {
+    size_t count;
+    const Segment* segments = sim_obstacles(sim, &count);
+    if (count == 0) return;
+
+    init_shaders(&obstacle_program, OBSTACLE_VERTEX_FILE_PATH, OVERLAY_FRAGMENT_FILE_PATH);
+    for (int i = 0; i < COUNT_UNIFORMS; i++) {
+        obstacle_uniforms[i] = glGetUniformLocation(obstacle_program, uniform_names[i]);
+    }
+
+    glGenVertexArrays(1, &obstacle_vao);
+    glBindVertexArray(obstacle_vao);
+
+    glGenBuffers(1, &obstacle_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, obstacle_vbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Segment) * count, segments, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vec2), (void*)0);
+    obstacle_vertex_count = 2 * count;
+
+    glBindVertexArray(vao);
+}
+
+// Drawn over the seeds in world coordinates, before the selection and the stats panel
+void render_obstacles(int width, int height) {
+    if (obstacle_vertex_count == 0) return;
+
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(obstacle_program);
+    glUniform2f(obstacle_uniforms[RESOLUTION_UNIFORM], width, height);
+    glUniform2f(obstacle_uniforms[CAMERA_UNIFORM], camera.center.x, camera.center.y);
+    glUniform1f(obstacle_uniforms[ZOOM_UNIFORM], camera.zoom);
+    glBindVertexArray(obstacle_vao);
+    glDrawArrays(GL_LINES, 0, obstacle_vertex_count);
+
+    glBindVertexArray(vao);
+    glUseProgram(programs[SIM_MODE]);
+    glEnable(GL_DEPTH_TEST);
+}
+
+// Draws the stats panel on top of the frame
+void render_overlay(int width, int height) {
+    if (!IS_OVERLAY) return;
+
+    StatsSummary s;
+    stats_summarize(OVERLAY_SUMMARY_FRAMES, &s);
+
+    char lines[7][96];
+    snprintf(lines[0], sizeof(lines[0]), "%s  %zu SEEDS  %s", mode_names[SIM_MODE], SEED_COUNT,
+             integrator_names[INTEGRATOR]);
+    snprintf(lines[1], sizeof(lines[1]), "FRAME %.2f MS  MIN %.2f  MAX %.2f", s.frame_avg_ms, s.frame_min_ms,
+             s.frame_max_ms);
+    snprintf(lines[2], sizeof(lines[2]), "PHYSICS %.2f MS  %.1f STEPS  UPLOAD %.2f MS", s.physics_ms, s.steps,
+             s.upload_ms);
+    snprintf(lines[3], sizeof(lines[3]), "PAIRS %.0f TESTED / %.0f COLLIDING", s.pairs_tested, s.pairs_colliding);
+    snprintf(lines[4], sizeof(lines[4]), "SEEDS %.0f AWAKE / %.0f SLEEPING", s.seeds_awake, s.seeds_sleeping);
+    snprintf(lines[5], sizeof(lines[5]), "%.3g SEEDS/S  MEMORY %.1f MB", s.seeds_per_sec,
+             s.memory_bytes / (1024.0 * 1024.0));
+    snprintf(lines[6], sizeof(lines[6]), "PEAK %.1f MB  RESERVED %.1f MB", s.memory_high_water_bytes / (1024.0 * 1024.0),
+             s.memory_reserved_bytes / (1024.0 * 1024.0));
+
+    size_t line_count = sizeof(lines) / sizeof(lines[0]);
+    float graph_width = STATS_HISTORY * GRAPH_BAR_WIDTH;
+    float panel_w = graph_width + 2.0f * OVERLAY_PADDING;
+    float panel_h = line_count * LINE_HEIGHT + GRAPH_HEIGHT + 3.0f * OVERLAY_PADDING;
+    float panel_x = OVERLAY_MARGIN;
+    float panel_y = height - OVERLAY_MARGIN - panel_h;
+
+    overlay_rect_count = 0;
+    _push_rect(panel_x, panel_y, panel_w, panel_h, (vec4){0.0f, 0.0f, 0.0f, 0.6f});
+
+    float y = panel_y + panel_h - OVERLAY_PADDING - GLYPH_HEIGHT * GLYPH_SCALE;
+    for (size_t i = 0; i < line_count; i++) {
+        _push_text(panel_x + OVERLAY_PADDING, y, lines[i], (vec4){1.0f, 1.0f, 1.0f, 1.0f});
+        y -= LINE_HEIGHT;
+    }
+    _push_graph(panel_x + OVERLAY_PADDING, panel_y + OVERLAY_PADDING);
+
+    _draw_rects(width, height);
+}
+
+// The lasso while it is traced and a frame around the selected seeds, drawn even with the stats panel off
+void render_selection(int width, int height) {
+    const vec2* points = NULL;
+    size_t point_count = sim_lasso(sim, &points);
+    vec2 lo, hi;
+    bool has_selection = sim_selection_bounds(sim, &lo, &hi);
+    if (point_count == 0 && !has_selection) return;
+
+    overlay_rect_count = 0;
+    vec4 color = {1.0f, 1.0f, 1.0f, 0.8f};
+    // Lasso and selection are kept in world coordinates, the padding stays in pixels whatever the zoom
+    for (size_t i = 1; i < point_count; i++) {
+        _push_segment(world_to_screen(points[i - 1], width, height), world_to_screen(points[i], width, height),
+                      color);
+    }
+    if (has_selection) {
+        vec2 pad = {SELECTION_PADDING, SELECTION_PADDING};
+        lo = world_to_screen(lo, width, height);
+        hi = world_to_screen(hi, width, height);
+        _push_frame(vec2_sub(lo, pad), vec2_add(hi, pad), color);
+    }
+
+    _draw_rects(width, height);
+}
+
+// Private function definitions
+// ---------------------
+// Screen space rectangles go over the frame, then the mode program and the seeds vertex array are restored
+void _draw_rects(int width, int height) {
+    glDisable(GL_DEPTH_TEST);
+    glUseProgram(overlay_program);
+    glUniform2f(overlay_resolution, width, height);
+    glBindVertexArray(overlay_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(OverlayRect) * overlay_rect_count, overlay_rects);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, overlay_rect_count);
+
+    glBindVertexArray(vao);
+    glUseProgram(programs[SIM_MODE]);
+    glEnable(GL_DEPTH_TEST);
+}
+
+void _push_rect(float x, float y, float w, float h, vec4 color) {
+    if (overlay_rect_count >= OVERLAY_MAX_RECTS) return;
+    overlay_rects[overlay_rect_count++] = (OverlayRect){{x, y}, {w, h}, color};
+}
+
+// Dots spaced their own size apart, the rectangles cannot be rotated into a line
+void _push_segment(vec2 a, vec2 b, vec4 color) {
+    int steps = (int)ceilf(vec2_dist(a, b) / LASSO_DOT_SIZE);
+    for (int i = 0; i < steps; i++) {
+        vec2 p = vec2_add(a, vec2_scale(vec2_sub(b, a), (float)i / steps));
+        _push_rect(p.x - 0.5f * LASSO_DOT_SIZE, p.y - 0.5f * LASSO_DOT_SIZE, LASSO_DOT_SIZE, LASSO_DOT_SIZE, color);
+    }
+}
+
+void _push_frame(vec2 lo, vec2 hi, vec4 color) {
+    float w = hi.x - lo.x;
+    float h = hi.y - lo.y;
+    _push_rect(lo.x, lo.y, w, 1.0f, color);
+    _push_rect(lo.x, hi.y - 1.0f, w, 1.0f, color);
+    _push_rect(lo.x, lo.y, 1.0f, h, color);
+    _push_rect(hi.x - 1.0f, lo.y, 1.0f, h, color);
+}
+
+// Every lit font pixel is its own rectangle, (x, y) is the bottom left of the line
+void _push_text(float x, float y, const char* text, vec4 color) {
+    for (const char* c = text; *c != '\0'; c++) {
+        unsigned char ch = (unsigned char)toupper((unsigned char)*c);
+        if (ch >= 128) ch = '?';
+
+        for (int row = 0; row < GLYPH_HEIGHT; row++) {
+            for (int col = 0; col < GLYPH_WIDTH; col++) {
+                if (!(glyphs[ch][row] & (1 << (GLYPH_WIDTH - 1 - col)))) continue;
+                _push_rect(x + col * GLYPH_SCALE,
+                           y + (GLYPH_HEIGHT - 1 - row) * GLYPH_SCALE,
+                           GLYPH_SCALE,
+                           GLYPH_SCALE,
+                           color);
+            }
+        }
+        x += GLYPH_ADVANCE;
+    }
+}
+
+// Frame time bars oldest to newest with the physics share drawn over them, the line marks a 60 FPS budget
+void _push_graph(float x, float y) {
+    float ms_to_px = GRAPH_HEIGHT / GRAPH_MAX_MS;
+
+    for (size_t age = 0; age < STATS_HISTORY; age++) {
+        const FrameSample* sample = stats_sample(age);
+        if (sample == NULL) break;
+
+        float bar_x = x + (STATS_HISTORY - 1 - age) * GRAPH_BAR_WIDTH;
+        float frame_h = fminf(sample->frame_ms * ms_to_px, GRAPH_HEIGHT);
+        float physics_h = fminf(sample->physics_ms * ms_to_px, frame_h);
+
+        vec4 color = sample->frame_ms <= GRAPH_BUDGET_MS       ? (vec4){0.3f, 0.8f, 0.3f, 0.9f}
+                     : sample->frame_ms <= 2.0 * GRAPH_BUDGET_MS ? (vec4){0.9f, 0.8f, 0.2f, 0.9f}
+                                                                 : (vec4){0.9f, 0.3f, 0.2f, 0.9f};
+        _push_rect(bar_x, y, GRAPH_BAR_WIDTH, frame_h, color);
+        _push_rect(bar_x, y, GRAPH_BAR_WIDTH, physics_h, (vec4){0.3f, 0.5f, 1.0f, 0.9f});
+    }
+
+    _push_rect(x, y + GRAPH_BUDGET_MS * ms_to_px, STATS_HISTORY * GRAPH_BAR_WIDTH, 1.0f, (vec4){1.0f, 1.0f, 1.0f, 0.5f});
+}
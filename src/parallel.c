@@ -0,0 +1,142 @@
+#include "parallel.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+// This source inner helpers
+void* _worker_main(void* arg);
+void _run_chunk(size_t worker);
+
+size_t THREAD_COUNT = 0;
+
+pthread_t pool_workers[MAX_THREAD_COUNT];
+pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t pool_start_cond = PTHREAD_COND_INITIALIZER;
+pthread_cond_t pool_done_cond = PTHREAD_COND_INITIALIZER;
+
+size_t pool_size = 1;
+size_t pool_generation = 0;
+size_t pool_pending = 0;
+bool pool_busy = false;  // a job is in flight, other callers run theirs serially
+bool pool_shutting_down = false;
+
+ParallelFn pool_job_fn = NULL;
+void* pool_job_ctx = NULL;
+size_t pool_job_count = 0;
+
+// Function definitions
+// ---------------------
+void init_thread_pool(size_t thread_count) {
+    if (thread_count == 0) thread_count = default_thread_count();
+    if (thread_count > MAX_THREAD_COUNT) thread_count = MAX_THREAD_COUNT;
+
+    pool_size = thread_count;
+    THREAD_COUNT = thread_count;
+
+    for (size_t i = 1; i < pool_size; i++) {
+        if (pthread_create(&pool_workers[i], NULL, _worker_main, (void*)i) != 0) {
+            printf("[ERROR]: Failed to start worker thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+void free_thread_pool(void) {
+    pthread_mutex_lock(&pool_lock);
+    pool_shutting_down = true;
+    pthread_cond_broadcast(&pool_start_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (size_t i = 1; i < pool_size; i++) {
+        pthread_join(pool_workers[i], NULL);
+    }
+
+    // Workers count generations from zero, so a restarted pool must not see a stale job
+    pool_size = 1;
+    pool_generation = 0;
+    pool_shutting_down = false;
+}
+
+size_t default_thread_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n < 1 ? 1 : (size_t)n;
+}
+
+// Split [0, count) into one contiguous chunk per worker, the split only depends on the pool size.
+// The pool runs one job at a time, simulations stepping on other threads meanwhile do their work inline
+void parallel_for(size_t count, ParallelFn fn, void* ctx) {
+    if (count == 0) return;
+
+    if (pool_size == 1 || count < PARALLEL_MIN_ITEMS) {
+        fn(0, count, 0, ctx);
+        return;
+    }
+
+    pthread_mutex_lock(&pool_lock);
+    if (pool_busy) {
+        pthread_mutex_unlock(&pool_lock);
+        fn(0, count, 0, ctx);
+        return;
+    }
+    pool_busy = true;
+    pool_job_fn = fn;
+    pool_job_ctx = ctx;
+    pool_job_count = count;
+    pool_pending = pool_size - 1;
+    pool_generation++;
+    pthread_cond_broadcast(&pool_start_cond);
+    pthread_mutex_unlock(&pool_lock);
+
+    _run_chunk(0);
+
+    pthread_mutex_lock(&pool_lock);
+    while (pool_pending > 0) {
+        pthread_cond_wait(&pool_done_cond, &pool_lock);
+    }
+    pool_busy = false;
+    pthread_mutex_unlock(&pool_lock);
+}
+
+// Private function definitions
+// ---------------------
+void* _worker_main(void* arg) {
+    size_t worker = (size_t)arg;
+    size_t seen = 0;
+
+    char name[TRACE_THREAD_NAME_SIZE];
+    snprintf(name, sizeof(name), "worker %zu", worker);
+    TRACE_THREAD(name);
+
+    pthread_mutex_lock(&pool_lock);
+    while (true) {
+        while (pool_generation == seen && !pool_shutting_down) {
+            pthread_cond_wait(&pool_start_cond, &pool_lock);
+        }
+        if (pool_shutting_down) break;
+        seen = pool_generation;
+        pthread_mutex_unlock(&pool_lock);
+
+        _run_chunk(worker);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--pool_pending == 0) pthread_cond_signal(&pool_done_cond);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+void _run_chunk(size_t worker) {
+    TRACE_ZONE("parallel_chunk");
+
+    size_t chunk = (pool_job_count + pool_size - 1) / pool_size;
+    size_t begin = worker * chunk;
+    size_t end = begin + chunk > pool_job_count ? pool_job_count : begin + chunk;
+
+    if (begin < end) pool_job_fn(begin, end, worker, pool_job_ctx);
+}
@@ -0,0 +1,490 @@
+#include "record.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "trace.h"
+
+#define VARINT_MAX_BYTES 5
+
+static_assert(sizeof(RecordHeader) % 8 == 0, "Record header must keep its 64 bit fields aligned");
+
+// This source inner helpers
+void* _alloc_or_exit(size_t size);
+int32_t _quantize(float v);
+uint32_t _predict(const uint32_t* prev0, const uint32_t* prev1, size_t i, uint64_t frame, uint32_t interval);
+void _write_or_fail(const void* data, size_t size);
+void* _writer_main(void* arg);
+void _encode_frame(const int32_t* cur);
+
+bool _decode_next(void);
+bool _seek_replay(uint64_t frame);
+void _build_replay_index(void);
+void _step_replay_frame(GLFWwindow* window, double dt, int width, int height);
+
+const char* RECORD_PATH = NULL;
+const char* REPLAY_PATH = NULL;
+size_t REPLAY_SPEED = 1;
+
+// Recorder, the simulation fills the queue slots and the writer thread encodes and writes them in order
+FILE* recorder_file = NULL;
+pthread_t recorder_thread;
+pthread_mutex_t recorder_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t recorder_cond = PTHREAD_COND_INITIALIZER;
+int32_t* recorder_slots[RECORD_QUEUE_DEPTH] = {NULL};
+size_t recorder_head = 0;  // next slot the writer takes
+size_t recorder_tail = 0;  // next slot the simulation fills
+bool recorder_stopping = false;
+bool recorder_failed = false;
+
+// Owned by the writer thread
+uint32_t* recorder_prev[2] = {NULL, NULL};
+uint8_t* recorder_bytes = NULL;
+uint64_t* recorder_keyframes = NULL;
+size_t recorder_keyframe_count = 0;
+size_t recorder_keyframe_capacity = 0;
+uint64_t recorder_frame_count = 0;
+uint64_t recorder_offset = 0;
+
+// Replay, the mapped file and the last two decoded frames
+const uint8_t* replay_base = NULL;
+size_t replay_size = 0;
+const RecordHeader* replay_header = NULL;
+uint64_t* replay_keyframes = NULL;
+size_t replay_keyframe_count = 0;
+uint64_t replay_frame_count = 0;
+uint64_t replay_frames_end = 0;  // first byte past the frame records
+uint64_t replay_frame = 0;       // frame held in replay_prev[0], replay_cursor points past it
+uint64_t replay_cursor = 0;
+bool replay_started = false;
+uint32_t* replay_prev[2] = {NULL, NULL};
+
+// Function definitions
+// ---------------------
+void init_recorder(const char* path) {
+    recorder_file = fopen(path, "wb");
+    if (recorder_file == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open recording file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    setvbuf(recorder_file, NULL, _IOFBF, RECORD_BUFFER_SIZE);
+
+    for (size_t i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+        recorder_slots[i] = _alloc_or_exit(sizeof(int32_t) * 2 * SEED_COUNT);
+    }
+    for (size_t i = 0; i < 2; i++) {
+        recorder_prev[i] = _alloc_or_exit(sizeof(uint32_t) * 2 * SEED_COUNT);
+    }
+    recorder_bytes = _alloc_or_exit(sizeof(uint32_t) + VARINT_MAX_BYTES * 2 * SEED_COUNT);
+
+    RecordHeader h = {
+        .version = RECORD_VERSION,
+        .header_size = sizeof(RecordHeader),
+        .mode = SIM_MODE,
+        .keyframe_interval = RECORD_KEYFRAME_INTERVAL,
+        .quantum = RECORD_QUANTUM,
+        .seed_count = SEED_COUNT,
+    };
+    memcpy(h.magic, RECORD_MAGIC, sizeof(h.magic));
+    _write_or_fail(&h, sizeof(h));
+
+    // Colors and radii never change, they are stored once in generation order
+    vec4* colors = _alloc_or_exit(sizeof(vec4) * SEED_COUNT);
+    int32_t* radii = _alloc_or_exit(sizeof(int32_t) * SEED_COUNT);
+    const Seed* seeds = sim_seeds(sim);
+    const uint32_t* seed_ids = sim_seed_ids(sim);
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        colors[seed_ids[i]] = seeds[i].color;
+        radii[seed_ids[i]] = seeds[i].radius;
+    }
+    _write_or_fail(colors, sizeof(vec4) * SEED_COUNT);
+    _write_or_fail(radii, sizeof(int32_t) * SEED_COUNT);
+    free(colors);
+    free(radii);
+
+    if (pthread_create(&recorder_thread, NULL, _writer_main, NULL) != 0) {
+        printf("[ERROR]: Failed to start recorder thread\n");
+        exit(EXIT_FAILURE);
+    }
+    printf("[INFO]: Recording to '%s'\n", path);
+}
+
+// Drains the queue, then writes the keyframe index and completes the header
+void free_recorder(void) {
+    if (recorder_file == NULL) return;
+
+    pthread_mutex_lock(&recorder_lock);
+    recorder_stopping = true;
+    pthread_cond_broadcast(&recorder_cond);
+    pthread_mutex_unlock(&recorder_lock);
+    pthread_join(recorder_thread, NULL);
+
+    uint64_t index_offset = recorder_offset;
+    _write_or_fail(recorder_keyframes, sizeof(uint64_t) * recorder_keyframe_count);
+    uint64_t file_size = recorder_offset;
+
+    fseek(recorder_file, offsetof(RecordHeader, frame_count), SEEK_SET);
+    _write_or_fail(&recorder_frame_count, sizeof(uint64_t));
+    _write_or_fail(&index_offset, sizeof(uint64_t));
+
+    if (fclose(recorder_file) != 0 || recorder_failed) {
+        fprintf(stderr, "[ERROR]: Recording could not be written completely\n");
+    } else {
+        printf("[INFO]: Recorded %llu frames, %.1f MB\n",
+               (unsigned long long)recorder_frame_count, file_size / (1024.0 * 1024.0));
+    }
+    recorder_file = NULL;
+
+    for (size_t i = 0; i < RECORD_QUEUE_DEPTH; i++) {
+        free(recorder_slots[i]);
+        recorder_slots[i] = NULL;
+    }
+    for (size_t i = 0; i < 2; i++) {
+        free(recorder_prev[i]);
+        recorder_prev[i] = NULL;
+    }
+    free(recorder_bytes);
+    free(recorder_keyframes);
+    recorder_bytes = NULL;
+    recorder_keyframes = NULL;
+}
+
+// Quantizes the current positions into a free slot in generation order, waits only when the writer is behind
+void record_frame(void) {
+    if (recorder_file == NULL) return;
+    TRACE_ZONE(__func__);
+
+    pthread_mutex_lock(&recorder_lock);
+    while (recorder_tail - recorder_head == RECORD_QUEUE_DEPTH) {
+        pthread_cond_wait(&recorder_cond, &recorder_lock);
+    }
+    int32_t* slot = recorder_slots[recorder_tail % RECORD_QUEUE_DEPTH];
+    pthread_mutex_unlock(&recorder_lock);
+
+    const Seed* seeds = sim_seeds(sim);
+    const uint32_t* seed_ids = sim_seed_ids(sim);
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        slot[2 * seed_ids[i]] = _quantize(seeds[i].pos.x);
+        slot[2 * seed_ids[i] + 1] = _quantize(seeds[i].pos.y);
+    }
+
+    pthread_mutex_lock(&recorder_lock);
+    recorder_tail++;
+    pthread_cond_broadcast(&recorder_cond);
+    pthread_mutex_unlock(&recorder_lock);
+}
+
+// Replaces the simulation: seeds come from the recording and step_frame decodes instead of stepping
+void init_replay(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[ERROR]: Could not open recording file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(RecordHeader)) {
+        fprintf(stderr, "[ERROR]: Recording file '%s' is truncated\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    replay_size = st.st_size;
+    replay_base = mmap(NULL, replay_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (replay_base == MAP_FAILED) {
+        fprintf(stderr, "[ERROR]: Could not map recording file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const RecordHeader* h = (const RecordHeader*)replay_base;
+    uint64_t statics_size = h->seed_count * (sizeof(vec4) + sizeof(int32_t));
+    if (memcmp(h->magic, RECORD_MAGIC, sizeof(h->magic)) != 0 || h->version != RECORD_VERSION ||
+        h->header_size != sizeof(RecordHeader) || h->mode >= COUNT_MODES || h->keyframe_interval == 0 ||
+        h->seed_count < 1 || h->seed_count > SEED_MAX_COUNT || h->quantum <= 0.0f ||
+        statics_size > replay_size - sizeof(RecordHeader)) {
+        fprintf(stderr, "[ERROR]: Recording file '%s' is invalid\n", path);
+        exit(EXIT_FAILURE);
+    }
+    replay_header = h;
+
+    SIM_MODE = h->mode;
+    SEED_COUNT = h->seed_count;
+    SimConfig config = app_sim_config();
+    sim = begin_sim_restore(&config, 0, NULL);
+
+    Seed* seeds = sim_seeds(sim);
+    const vec4* colors = (const vec4*)(replay_base + sizeof(RecordHeader));
+    const int32_t* radii = (const int32_t*)(colors + SEED_COUNT);
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        seeds[i].color = colors[i];
+        seeds[i].radius = radii[i];
+    }
+    for (size_t i = 0; i < 2; i++) {
+        replay_prev[i] = _alloc_or_exit(sizeof(uint32_t) * 2 * SEED_COUNT);
+    }
+
+    _build_replay_index();
+    if (replay_frame_count == 0 || !_seek_replay(0)) {
+        fprintf(stderr, "[ERROR]: Recording file '%s' has no readable frames\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    step_frame = _step_replay_frame;
+    printf("[INFO]: Replaying %llu frames of %zu seeds from '%s'\n",
+           (unsigned long long)replay_frame_count, SEED_COUNT, path);
+}
+
+void free_replay(void) {
+    if (replay_base == NULL) return;
+
+    munmap((void*)replay_base, replay_size);
+    replay_base = NULL;
+    replay_header = NULL;
+
+    free(replay_keyframes);
+    replay_keyframes = NULL;
+    for (size_t i = 0; i < 2; i++) {
+        free(replay_prev[i]);
+        replay_prev[i] = NULL;
+    }
+}
+
+// Private function definitions
+// ---------------------
+void* _alloc_or_exit(size_t size) {
+    void* ptr = malloc(size);
+    if (ptr == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+    return ptr;
+}
+
+int32_t _quantize(float v) {
+    return (int32_t)lrintf(fminf(fmaxf(v * RECORD_QUANTUM, -2.0e9f), 2.0e9f));
+}
+
+// Keyframes predict zero, the frame after one repeats it and the rest extrapolate the last step.
+// Wrapping unsigned arithmetic keeps encoder and decoder exact for any input
+uint32_t _predict(const uint32_t* prev0, const uint32_t* prev1, size_t i, uint64_t frame, uint32_t interval) {
+    uint64_t k = frame % interval;
+    if (k == 0) return 0;
+    if (k == 1) return prev0[i];
+    return 2u * prev0[i] - prev1[i];
+}
+
+// Only the writer thread and free_recorder (after the join) touch the file
+void _write_or_fail(const void* data, size_t size) {
+    if (size == 0) return;
+    if (fwrite(data, 1, size, recorder_file) != size) recorder_failed = true;
+    recorder_offset += size;
+}
+
+void* _writer_main(void* arg) {
+    UNUSED(arg);
+    TRACE_THREAD("recorder");
+
+    for (;;) {
+        pthread_mutex_lock(&recorder_lock);
+        while (recorder_head == recorder_tail && !recorder_stopping) {
+            pthread_cond_wait(&recorder_cond, &recorder_lock);
+        }
+        if (recorder_head == recorder_tail) {
+            pthread_mutex_unlock(&recorder_lock);
+            break;
+        }
+        const int32_t* cur = recorder_slots[recorder_head % RECORD_QUEUE_DEPTH];
+        pthread_mutex_unlock(&recorder_lock);
+
+        _encode_frame(cur);
+
+        pthread_mutex_lock(&recorder_lock);
+        recorder_head++;
+        pthread_cond_broadcast(&recorder_cond);
+        pthread_mutex_unlock(&recorder_lock);
+    }
+    return NULL;
+}
+
+void _encode_frame(const int32_t* cur) {
+    TRACE_ZONE(__func__);
+
+    uint64_t frame = recorder_frame_count;
+    if (frame % RECORD_KEYFRAME_INTERVAL == 0) {
+        if (recorder_keyframe_count == recorder_keyframe_capacity) {
+            recorder_keyframe_capacity = recorder_keyframe_capacity > 0 ? 2 * recorder_keyframe_capacity : 64;
+            recorder_keyframes = realloc(recorder_keyframes, sizeof(uint64_t) * recorder_keyframe_capacity);
+            if (recorder_keyframes == NULL) {
+                printf("[ERROR]: Memory was not allocated\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+        recorder_keyframes[recorder_keyframe_count++] = recorder_offset;
+    }
+
+    uint8_t* out = recorder_bytes + sizeof(uint32_t);
+    uint32_t* prev0 = recorder_prev[0];
+    uint32_t* prev1 = recorder_prev[1];
+
+    for (size_t i = 0; i < 2 * SEED_COUNT; i++) {
+        uint32_t v = (uint32_t)cur[i];
+        uint32_t d = v - _predict(prev0, prev1, i, frame, RECORD_KEYFRAME_INTERVAL);
+        uint32_t zz = (d << 1) ^ (uint32_t)((int32_t)d >> 31);
+        while (zz >= 0x80) {
+            *out++ = (uint8_t)(zz | 0x80);
+            zz >>= 7;
+        }
+        *out++ = (uint8_t)zz;
+
+        // prev1 is dead once read, it becomes the newest frame
+        prev1[i] = v;
+    }
+    recorder_prev[0] = prev1;
+    recorder_prev[1] = prev0;
+
+    uint32_t payload = (uint32_t)(out - recorder_bytes - sizeof(uint32_t));
+    memcpy(recorder_bytes, &payload, sizeof(uint32_t));
+    _write_or_fail(recorder_bytes, sizeof(uint32_t) + payload);
+    recorder_frame_count++;
+}
+
+// Decodes the record at replay_cursor, which must be the frame after the one held
+bool _decode_next(void) {
+    if (replay_cursor + sizeof(uint32_t) > replay_frames_end) return false;
+
+    uint32_t payload;
+    memcpy(&payload, replay_base + replay_cursor, sizeof(uint32_t));
+    const uint8_t* in = replay_base + replay_cursor + sizeof(uint32_t);
+    const uint8_t* end = in + payload;
+    if (payload > replay_frames_end - replay_cursor - sizeof(uint32_t)) return false;
+
+    uint64_t frame = replay_started ? replay_frame + 1 : 0;
+    uint32_t* prev0 = replay_prev[0];
+    uint32_t* prev1 = replay_prev[1];
+
+    for (size_t i = 0; i < 2 * SEED_COUNT; i++) {
+        uint32_t zz = 0;
+        for (int shift = 0;; shift += 7) {
+            if (in == end || shift >= 7 * VARINT_MAX_BYTES) return false;
+            uint8_t byte = *in++;
+            zz |= (uint32_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        uint32_t d = (zz >> 1) ^ (0u - (zz & 1));
+        prev1[i] = _predict(prev0, prev1, i, frame, replay_header->keyframe_interval) + d;
+    }
+    replay_prev[0] = prev1;
+    replay_prev[1] = prev0;
+
+    replay_cursor += sizeof(uint32_t) + payload;
+    replay_frame = frame;
+    replay_started = true;
+    return true;
+}
+
+// Restarts from the closest keyframe at or before the target, at most an interval of frames is decoded
+bool _seek_replay(uint64_t frame) {
+    TRACE_ZONE(__func__);
+
+    uint64_t interval = replay_header->keyframe_interval;
+    if (!replay_started || frame < replay_frame || frame / interval != replay_frame / interval) {
+        size_t k = frame / interval;
+        if (k >= replay_keyframe_count) return false;
+        replay_cursor = replay_keyframes[k];
+        replay_frame = k * interval - 1;
+        replay_started = k > 0;
+        if (!_decode_next()) return false;
+    }
+
+    while (replay_frame < frame) {
+        if (!_decode_next()) return false;
+    }
+    return true;
+}
+
+// Uses the stored index when the recorder closed cleanly, otherwise walks the record sizes
+void _build_replay_index(void) {
+    uint64_t first = sizeof(RecordHeader) + replay_header->seed_count * (sizeof(vec4) + sizeof(int32_t));
+    uint64_t interval = replay_header->keyframe_interval;
+    uint64_t index_offset = replay_header->index_offset;
+    uint64_t frames = replay_header->frame_count;
+    size_t keyframes = (frames + interval - 1) / interval;
+
+    if (index_offset >= first && index_offset <= replay_size &&
+        keyframes <= (replay_size - index_offset) / sizeof(uint64_t)) {
+        replay_keyframes = _alloc_or_exit(sizeof(uint64_t) * (keyframes > 0 ? keyframes : 1));
+        memcpy(replay_keyframes, replay_base + index_offset, sizeof(uint64_t) * keyframes);
+        replay_keyframe_count = keyframes;
+        replay_frame_count = frames;
+        replay_frames_end = index_offset;
+        return;
+    }
+
+    printf("[INFO]: Recording has no index, it was not closed cleanly. Scanning it\n");
+    size_t capacity = 64;
+    replay_keyframes = _alloc_or_exit(sizeof(uint64_t) * capacity);
+    replay_keyframe_count = 0;
+    replay_frame_count = 0;
+
+    uint64_t offset = first;
+    while (offset + sizeof(uint32_t) <= replay_size) {
+        uint32_t payload;
+        memcpy(&payload, replay_base + offset, sizeof(uint32_t));
+        if (payload > replay_size - offset - sizeof(uint32_t)) break;
+
+        if (replay_frame_count % interval == 0) {
+            if (replay_keyframe_count == capacity) {
+                capacity *= 2;
+                replay_keyframes = realloc(replay_keyframes, sizeof(uint64_t) * capacity);
+                if (replay_keyframes == NULL) {
+                    printf("[ERROR]: Memory was not allocated\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            replay_keyframes[replay_keyframe_count++] = offset;
+        }
+        replay_frame_count++;
+        offset += sizeof(uint32_t) + payload;
+    }
+    replay_frames_end = offset;
+}
+
+// Forward time plays REPLAY_SPEED recorded frames per rendered frame, the pace they were recorded at, backward
+// time seeks back as many. Playback pauses on the last frame
+void _step_replay_frame(GLFWwindow* window, double dt, int width, int height) {
+    UNUSED(window);
+    UNUSED(width);
+    UNUSED(height);
+
+    double start = now_ms();
+    uint64_t target = replay_frame;
+    if (dt > 0.0) {
+        target = replay_frame + REPLAY_SPEED < replay_frame_count ? replay_frame + REPLAY_SPEED : replay_frame_count - 1;
+        if (target == replay_frame_count - 1) IS_PAUSE = true;
+    } else if (dt < 0.0) {
+        target = replay_frame > REPLAY_SPEED ? replay_frame - REPLAY_SPEED : 0;
+    }
+
+    if (target != replay_frame && !_seek_replay(target)) {
+        fprintf(stderr, "[ERROR]: Recording is corrupt at frame %llu\n", (unsigned long long)target);
+        replay_frame_count = replay_frame + 1;
+        IS_PAUSE = true;
+    }
+
+    float scale = 1.0f / replay_header->quantum;
+    Seed* seeds = sim_seeds(sim);
+    for (size_t i = 0; i < SEED_COUNT; i++) {
+        seeds[i].pos = (vec2){(int32_t)replay_prev[0][2 * i] * scale, (int32_t)replay_prev[0][2 * i + 1] * scale};
+    }
+    mark_seeds_moved(sim);
+    sim_counters(sim)->physics_ms += now_ms() - start;
+}
@@ -1,192 +1,1252 @@
 #include <assert.h>
+#include <float.h>
 #include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
-
-#include "main.h"
-
-#define GRAVITY ((vec2){0.0f, -20.0f})
-#define GRID_SIZE 32
-#define NUM_BUCKETS (GRID_SIZE * GRID_SIZE)
-
-static_assert(COUNT_MODES == 3, "Update list of mode names");
+#include <string.h>
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+#include "arena.h"
+#include "helpers.h"
+#include "history.h"
+#include "parallel.h"
+#include "sim2d.h"
+#include "trace.h"
+
+#define GRID_SIZE 32  // side of a spatial map cell, fluid mode uses its kernel radius instead
+#define NUM_BUCKETS (1 << 16)  // enough that 100k+ seeds do not pile many cells into one chain
+
+#define SPRING_GRAVITY ((vec2){0.0f, -200.0f})
+#define SPRING_STIFFNESS 1.0e6f
+#define SPRING_SHEAR_STIFFNESS 2.5e5f
+#define SPRING_ITERATIONS 2
+#define SPRING_DAMPING 0.999f
+#define SPRING_MAX_LINKS 6
+
+#define SPRING_RELAXATION 1.5f
+#define VERLET_ITERATIONS 4
+#define VERLET_MAX_CONTACTS 16
+#define BUBBLES_RESTITUTION 0.8f
+
+#define CONTACT_MAX_PER_SEED 4  // voronoi contacts batched per seed on average, the ones past that resolve at once
+#define CONTACT_MAX_COLORS 64   // seed disjoint groups of contacts, the ones left over are resolved one at a time
+#define CONTACT_LANES 4         // contacts of one group resolved together, one SSE register each
+#define CONTACT_ITERATIONS 2    // passes over the groups, only the first exchanges velocities
+
+#define CCD_MOTION_FRACTION 0.5f  // seeds moving more than this part of their contact radius in a step are swept
+#define CCD_MAX_HITS 4             // impacts resolved per seed and step, the seed stops at the next one
+#define CCD_MAX_LISTED 32          // fastest seeds tested one by one, the grid query only reaches the others
+
+#define GALAXY_PERIOD 20.0f        // seconds the generated disc takes to turn once
+#define GALAXY_DISC_FRACTION 0.4f  // radius of the generated disc over the smaller side of the world
+#define GALAXY_SOFTENING 1.0f      // in seed radii, close pairs pull like overlapping discs instead of points
+
+#define BH_LEAF_SIZE 16                   // seeds a quadtree cell holds before it is split
+#define BH_MAX_DEPTH 16                   // one level per bit of the 16 bit axes of a key
+#define BH_NODES_PER_SEED 2               // quadtree capacity, cells past it stay leaves
+#define BH_STACK_SIZE (4 * BH_MAX_DEPTH)  // a visited cell pushes at most 4 children, 3 more per level
+#define BH_LIST_SIZE 512                  // pulls listed for the seeds of a leaf before they are applied
+
+#define FLUID_GRAVITY ((vec2){0.0f, -50.0f})
+#define FLUID_FILL 0.25f          // part of the world the generated block covers
+#define FLUID_BLOCK_WIDTH 0.4f    // of the world, the block stands in the lower left corner like a dam let go
+#define FLUID_SMOOTHING 2.0f      // kernel radius in particle spacings
+#define FLUID_MAX_NEIGHBORS 48    // neighbours listed per particle, one with more walks the map again for its forces
+#define FLUID_QUERY_CELLS 16      // a kernel radius query spans 3 map cells per axis, 4 with rounding
+#define FLUID_SOUND_SPEED 1600.0f  // in world units per second, eight times the speed of the dam break
+#define FLUID_SOUND_CFL 0.4f       // part of the kernel radius a pressure wave may cross in a step
+#define FLUID_VISCOSITY 1000.0f    // kinematic, in world units squared per second
+#define FLUID_VISCOSITY_CFL 0.1f   // part of the kernel radius squared the viscosity may diffuse over in a step
+#define FLUID_WALL_DAMPING 0.5f   // part of the normal velocity kept by a particle bouncing off a wall
+
+#define BVH_LEAF_SIZE 4          // obstacle segments a BVH leaf holds at most
+#define BVH_SAH_BINS 16          // candidate split planes along the longer axis of a node
+#define BVH_SAH_DEPTH 32         // levels split by the heuristic, deeper ranges are halved to bound the depth
+#define BVH_STACK_SIZE 64        // enough for BVH_SAH_DEPTH levels plus halving a million segments
+#define OBSTACLE_LIST_SIZE 256   // segments listed for one map cell, a more crowded cell is queried per seed
+
+#define SLEEP_SPEED 10.0f         // seeds slower than this, in pixels per second, count as resting
+#define SLEEP_TIME 0.5f           // seconds every seed of an island has to rest before the island sleeps
+#define SLEEP_CONTACT_SLOP 1.05f  // sleeping seeds this close to touching wake together
+
+#define HISTORY_WORDS 6  // pos, vel and acc of a seed
+
+#define LASSO_MAX_POINTS 1024
+#define LASSO_SPACING 4.0f  // pixels the cursor moves before the lasso gets another point
+
+#define MORTON_CELL_MAX 0xFFFF
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+static_assert(COUNT_MODES == 6, "Update list of mode names");
 const char* mode_names[COUNT_MODES] = {
     [MODE_VORONOI] = "Voronoi",
     [MODE_ATOMS] = "Atoms",
     [MODE_BUBBLES] = "Bubbles",
+    [MODE_SPRINGS] = "Springs",
+    [MODE_GALAXY] = "Galaxy",
+    [MODE_FLUID] = "Fluid",
 };
 
-// This source inner helpers
-size_t _hash(float x, float y);
-void _map_insert(Seed* s);
-void _map_remove(Seed* s);
-
-void _allocate_memory(void);
-
-void _generate_seed_pos(Seed* s);
-void _generate_seed_color(Seed* s);
-void _generate_seed_dynamics(Seed* s, vec2 acc, float mag);
-
-void _apply_constraints(int width, int height);
-void _apply_gravity(void);
-void _check_drag(GLFWwindow* window, int height, double dt);
-void _update_positions(double dt);
-
-void _find_collisions(Seed* s, float collision_dist, Seed** candidates, size_t* count);
-void _solve_collisions_voronoi(void);
-void _solve_collisions_bubbles(void);
-
-void _generate_voronoi_seeds(void);
-void _generate_bubbles_seeds(void);
-void _render_voronoi_frame(GLFWwindow* window, double dt, int width, int height);
-void _render_bubbles_frame(GLFWwindow* window, double dt, int width, int height);
+static_assert(COUNT_INTEGRATORS == 2, "Update list of integrator names");
+const char* integrator_names[COUNT_INTEGRATORS] = {
+    [INTEGRATOR_IMPULSE] = "Impulse",
+    [INTEGRATOR_VERLET] = "Verlet",
+};
 
-typedef struct Bucket {
+// This source inner helpers
+typedef struct Bucket Bucket;
+typedef struct Contact Contact;
+typedef struct ConstraintSet ConstraintSet;
+typedef struct QuadNode QuadNode;
+typedef struct QuadBody QuadBody;
+typedef struct BvhNode BvhNode;
+typedef struct ObstacleCell ObstacleCell;
+
+Sim2D* _create_sim(const SimConfig* config);
+
+size_t _hash(const Sim2D* sim, float x, float y);
+size_t _hash_cell(int x, int y);
+void _map_insert(Sim2D* sim, Seed* s);
+void _map_remove(Sim2D* sim, Seed* s);
+void _map_move(Sim2D* sim, Seed* s);
+float _grid_size(const Sim2D* sim, Mode mode);
+
+void _rebuild_map(Sim2D* sim);
+void _release_mode_memory(Sim2D* sim);
+void _sync_map(Sim2D* sim);
+uint32_t _morton_key(vec2 pos);
+uint32_t _spread_bits(uint32_t v);
+void _radix_sort_keys(uint32_t* keys[2], uint32_t* order[2], size_t count);
+void _permute_seed_data(Sim2D* sim, void* data, size_t size);
+void _reorder_seeds(Sim2D* sim);
+void _tick_reorder(Sim2D* sim);
+
+void _save_history(Sim2D* sim);
+bool _restore_history(Sim2D* sim);
+
+void _allocate_memory(Sim2D* sim);
+void _bind_sim_mode(Sim2D* sim, Mode mode);
+
+void _generate_seed_pos(Rng* rng, Seed* s, vec2 center);
+void _generate_seed_color(Rng* rng, Seed* s);
+void _generate_seed_dynamics(Rng* rng, Seed* s, vec2 acc, float mag);
+void _scatter_range(size_t begin, size_t end, size_t worker, void* ctx);
+
+void _apply_constraints(Sim2D* sim, int width, int height);
+void _apply_gravity(Sim2D* sim, vec2 gravity);
+void _check_drag(Sim2D* sim, double dt);
+bool _is_held(const Sim2D* sim, const Seed* s);
+Seed* _pick_seed(Sim2D* sim, vec2 pos);
+void _move_seed(Sim2D* sim, Seed* s, vec2 pos, vec2 vel);
+void _extend_lasso(Sim2D* sim, vec2 pos);
+bool _in_lasso(const Sim2D* sim, vec2 pos);
+void _select_lasso(Sim2D* sim);
+void _update_positions(Sim2D* sim, double dt, float contact_scale);
+void _begin_sweeps(Sim2D* sim, double dt, float contact_scale);
+void _classify_sweep(Sim2D* sim, size_t i);
+bool _is_unmoved(const Sim2D* sim, const Seed* other, const Seed* s);
+vec2 _step_motion(const Sim2D* sim, const Seed* s);
+void _advance_seed(Sim2D* sim, Seed* s);
+float _sweep_seed(Sim2D* sim, Seed* s, vec2 motion, float elapsed, Seed** hit);
+float _time_of_impact(Sim2D* sim, const Seed* s, const Seed* other, vec2 motion, float elapsed);
+void _separate_overlaps(Sim2D* sim);
+float _max_seed_radius(const Sim2D* sim);
+void _reset_speed_bound(Sim2D* sim);
+void _store_speed_bound(Sim2D* sim, size_t worker, float max_sqr_speed, float min_radius);
+void _reduce_speed_bound(Sim2D* sim);
+
+void _wake_all(Sim2D* sim);
+void _queue_wake(Sim2D* sim, uint32_t i);
+uint32_t _find_island(Sim2D* sim, uint32_t i);
+void _link_contact(Sim2D* sim, uint32_t a, uint32_t b);
+void _begin_islands(Sim2D* sim);
+void _wake_queued(Sim2D* sim, float contact_scale);
+void _update_sleep(Sim2D* sim, double dt, float contact_scale);
+
+void _find_collisions(Sim2D* sim, Seed* s, float collision_dist, Seed** candidates, size_t* count);
+void _sort_candidates(Seed** candidates, size_t count);
+void _solve_collisions_voronoi(Sim2D* sim);
+void _solve_collisions_voronoi_scalar(Sim2D* sim);
+void _solve_collisions_bubbles(Sim2D* sim);
+bool _collide_bubbles_pair(Sim2D* sim, Seed* s1, Seed* s2, bool asleep);
+void _reserve_voronoi_contacts(Sim2D* sim);
+void _find_voronoi_contacts(Sim2D* sim);
+void _color_contacts(Sim2D* sim);
+void _resolve_contact(Sim2D* sim, const Contact* c, bool exchange);
+void _resolve_contact_lanes(Sim2D* sim, const uint32_t* order, bool exchange);
+void _resolve_contacts(Sim2D* sim);
+
+void _reserve_constraints(Sim2D* sim, ConstraintSet* set, size_t capacity);
+void _add_constraint(ConstraintSet* set, uint32_t p0, uint32_t p1, float k, float rest_len);
+void _add_spring(Sim2D* sim, uint32_t p0, uint32_t p1, float k);
+int _compare_springs(const void* a, const void* b);
+void _finalize_constraints(const Sim2D* sim, ConstraintSet* set);
+void _finalize_springs(Sim2D* sim);
+void _link_springs(Sim2D* sim);
+void _generate_contacts(Sim2D* sim, float scale, bool keep_prev_overlap);
+
+float _pbd_inv_mass(const Sim2D* sim, size_t i);
+void _constraint_corrections(size_t begin, size_t end, size_t worker, void* ctx);
+void _constraint_gather(size_t begin, size_t end, size_t worker, void* ctx);
+void _project_constraints(Sim2D* sim, ConstraintSet* set);
+void _predict_positions(size_t begin, size_t end, size_t worker, void* ctx);
+void _update_velocities(size_t begin, size_t end, size_t worker, void* ctx);
+void _apply_restitution(Sim2D* sim, float restitution);
+void _begin_pbd_step(Sim2D* sim, double dt, float damping, bool clamp, int width, int height);
+void _end_pbd_step(Sim2D* sim);
+void _step_verlet(Sim2D* sim, double dt, float contact_scale, float restitution, int width, int height);
+void _solve_collisions_springs(Sim2D* sim);
+
+void _generate_voronoi_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_bubbles_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _springs_lattice(const Sim2D* sim, size_t* cols, float* spacing, vec2* origin);
+void _generate_springs_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_voronoi_seeds(Sim2D* sim);
+void _generate_bubbles_seeds(Sim2D* sim);
+void _generate_springs_seeds(Sim2D* sim);
+void _step_voronoi_frame(Sim2D* sim, double dt, int width, int height);
+void _step_bubbles_frame(Sim2D* sim, double dt, int width, int height);
+void _step_springs_frame(Sim2D* sim, double dt, int width, int height);
+
+void _reserve_quadtree(Sim2D* sim);
+void _quad_bounds_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _quad_keys_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _quad_bodies_range(size_t begin, size_t end, size_t worker, void* ctx);
+size_t _split_quad(const Sim2D* sim, const QuadNode* n, uint32_t bounds[5]);
+void _count_quad_children(size_t begin, size_t end, size_t worker, void* ctx);
+void _write_quad_children(size_t begin, size_t end, size_t worker, void* ctx);
+void _sum_quad_mass(size_t begin, size_t end, size_t worker, void* ctx);
+void _build_quadtree(Sim2D* sim);
+vec2 _softened_pull(vec2 from, vec2 to, float mass, float sqr_softening);
+const QuadNode* _find_quad_leaf(const Sim2D* sim, uint32_t k);
+void _flush_pulls(Sim2D* sim, const QuadBody* list, size_t count, uint32_t first, uint32_t last);
+void _pull_leaf(Sim2D* sim, const QuadNode* leaf, uint32_t first, uint32_t last, size_t* interactions);
+void _quad_gravity_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _solve_gravity_galaxy(Sim2D* sim);
+void _integrate_galaxy_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_galaxy_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_galaxy_seeds(Sim2D* sim);
+void _step_galaxy_frame(Sim2D* sim, double dt, int width, int height);
+
+float _fluid_spacing(const Sim2D* sim);
+float _fluid_kernel(float sqr_dist, float h);
+float _fluid_kernel_scale(float h);
+float _fluid_rest_density(float spacing, float h);
+double _fluid_max_dt(const Sim2D* sim);
+size_t _fluid_cells(const Sim2D* sim, vec2 pos, size_t cells[FLUID_QUERY_CELLS]);
+vec2 _fluid_pair_acc(const Sim2D* sim, const Seed* s, uint32_t j, float pressure_term, float viscosity);
+void _reserve_fluid(Sim2D* sim);
+void _fluid_density_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _fluid_forces_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _solve_pressure_fluid(Sim2D* sim);
+void _integrate_fluid_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_fluid_range(size_t begin, size_t end, size_t worker, void* ctx);
+void _generate_fluid_seeds(Sim2D* sim);
+void _step_fluid_frame(Sim2D* sim, double dt, int width, int height);
+
+void _build_obstacles(Sim2D* sim);
+void _build_bvh_node(Sim2D* sim, uint32_t* order, uint32_t node, uint32_t begin, uint32_t end, size_t depth);
+vec2 _segment_center(const Segment* seg);
+size_t _query_bvh(const Sim2D* sim, vec2 lo, vec2 hi, uint32_t* list, size_t max);
+bool _push_off_segment(Seed* s, const Segment* seg, bool bounce);
+void _collide_seed_obstacles(Sim2D* sim, Seed* s, ObstacleCell* cell);
+void _collide_bucket_obstacles(size_t begin, size_t end, size_t worker, void* ctx);
+void _collide_seed_range_obstacles(size_t begin, size_t end, size_t worker, void* ctx);
+void _collide_obstacles(Sim2D* sim, bool bounce);
+
+struct Bucket {
     Seed* seed;
     struct Bucket* next;
     struct Bucket* prev;
-} Bucket;
+};
+
+typedef enum {
+    SEED_AWAKE = 0,
+    SEED_ASLEEP,
+    SEED_WAKING,  // still asleep, queued to wake at the end of the step
+} SleepState;
+
+// Overlapping voronoi pair, the masses are folded into the share of the normal velocity each seed takes.
+// Normal and depth are taken again when it is resolved, earlier groups may have moved its seeds
+struct Contact {
+    uint32_t p0;
+    uint32_t p1;
+    float radii_sum;
+    float push;  // part of the depth each seed is moved apart by
+    float w0;
+    float w1;
+};
+
+// Quadtree cell, its children are stored next to each other and its seeds are a range of the key order
+struct QuadNode {
+    vec2 com;  // center of mass
+    float mass;
+    float size;  // side of the cell
+    uint32_t begin;
+    uint32_t end;
+    uint32_t first_child;
+    uint32_t child_count;  // 0 for leaves
+};
 
-typedef struct {
-    float k;
-    float rest_len;
-    Seed* p0;
-    Seed* p1;
-} Spring;
+// Position and mass of a seed in key order, the tree walks read nothing else
+struct QuadBody {
+    vec2 pos;
+    float mass;
+};
+
+// BVH node over the obstacle segments, the two children of an inner node are stored next to each other
+struct BvhNode {
+    vec2 lo;
+    vec2 hi;
+    uint32_t first;  // first child of an inner node, first segment of a leaf
+    uint32_t count;  // segments of a leaf, 0 for inner nodes
+};
 
-int SEED_RADIUS = DEFAULT_SEED_RADIUS;
-size_t SEED_COUNT = DEFAULT_SEED_COUNT;
+// Segments found around the map cell the last seed was in, the next seed in the same cell reuses them
+struct ObstacleCell {
+    uint32_t list[OBSTACLE_LIST_SIZE];
+    size_t found;  // past OBSTACLE_LIST_SIZE the list is incomplete and every seed queries its own bounds
+    int x;
+    int y;
+    bool valid;
+};
 
-Bucket* pos_map[NUM_BUCKETS];
-Seed* seeds = NULL;
+// Constraints between seed pairs plus the per-seed adjacency used by the Jacobi gather
+struct ConstraintSet {
+    Spring* items;
+    size_t count;
+    size_t capacity;
+    uint32_t* offsets;  // constraints of seed i are adj[offsets[i]..offsets[i + 1]]
+    uint32_t* adj;
+    vec2* corr;
+    float relaxation;
+    bool unilateral;
+};
 
-Seed* drag_seed = NULL;
-vec2 last_mouse_pos = {0.0f, 0.0f};
-void (*_solve_collisions)(void) = NULL;
+// Everything one simulation owns, nothing in this file is shared between simulations
+struct Sim2D {
+    SimConfig config;
+    Mode mode;
+    size_t seed_count;
+    Rng rng;  // every seed draws from its own stream of it, see rng_stream
+    vec2 scatter_size;
+
+    Bucket* pos_map[NUM_BUCKETS];
+    uint32_t bucket_visits[NUM_BUCKETS];
+    uint32_t bucket_query;
+    float grid_size;  // side of a map cell
+    bool map_synced;  // every seed sits in the bucket of its position, position based steps leave it behind
+    Bucket** map_nodes;     // node of each seed, removing it does not walk the chain
+    uint32_t* map_buckets;  // bucket each seed is linked into, a sync only moves the seeds that left theirs
+    Seed* seeds;
+
+    Arena arena;
+    ArenaMark mode_mark;  // what every mode shares ends here, buffers of one mode and the buckets follow it
+    Pool bucket_pool;
+    Seed** candidates;
+
+    vec2* prev_pos;
+    float* inv_mass;
+    uint32_t* seed_ids;  // generation order of each seed, stable across reorders
+    History history;
+    uint32_t* history_state;  // HISTORY_WORDS per seed in generation order
+    bool history_saved;       // the frame already saved the state it starts from
+
+    // Resting islands of seeds are put to sleep, only bubbles mode ever does so
+    uint8_t* sleep_state;
+    float* sleep_timers;      // seconds an awake seed has been resting
+    float* island_rest;       // shortest resting time of the island rooted at a seed
+    uint32_t* island_parent;  // union-find over contacts between awake seeds, rebuilt every step
+    uint32_t* wake_queue;
+    size_t wake_count;
+    size_t sleeping_count;
+
+    // Voronoi narrow phase: contacts of the step, the seed disjoint group each falls in and the contacts in
+    // group order. Allocated the first time a voronoi step runs
+    Contact* contacts;
+    size_t contact_count;
+    size_t contact_capacity;
+    uint8_t* contact_colors;
+    uint32_t* contact_order;
+    uint64_t* seed_colors;  // groups a seed already has a contact in
+    size_t color_offsets[CONTACT_MAX_COLORS + 2];
+
+    // Galaxy mode: Barnes-Hut quadtree over the seeds sorted by Morton key inside the bounds of the step, built
+    // one level at a time into a flat array. Allocated the first time a galaxy step runs
+    QuadNode* quad_nodes;
+    size_t quad_node_capacity;
+    size_t quad_levels[BH_MAX_DEPTH + 2];  // level d holds nodes quad_levels[d]..quad_levels[d + 1]
+    size_t quad_depth;                     // level the parallel passes work on
+    uint32_t* quad_keys[2];
+    uint32_t* quad_order[2];
+    QuadBody* quad_bodies;
+    vec2 quad_origin;
+    float quad_size;
+    vec2 worker_lo[MAX_THREAD_COUNT];
+    vec2 worker_hi[MAX_THREAD_COUNT];
+    float galaxy_g;  // picked so the generated disc turns once per GALAXY_PERIOD
+    float galaxy_softening;
+    double galaxy_dt;
+
+    // Fluid mode: the neighbours within the kernel radius of every particle, listed once per step from the
+    // spatial map whose cells are one kernel radius wide. Allocated the first time a fluid step runs
+    uint32_t* fluid_neighbors;  // FLUID_MAX_NEIGHBORS per seed
+    uint8_t* fluid_neighbor_counts;
+    float* fluid_density;
+    float* fluid_pressure;
+    float fluid_spacing;  // of the generated block, particles of other modes are taken as spaced the same
+    float fluid_h;
+    float fluid_rest_density;
+    double fluid_dt;
+    vec2 fluid_bounds;
+
+    // Obstacles: static segments stored in the leaf order of a BVH built once with the surface area heuristic.
+    // Seeds query it once per map cell, the ones pushed off are marked for the map update with where they were
+    Segment* obstacles;
+    size_t obstacle_count;
+    BvhNode* bvh_nodes;
+    size_t bvh_node_count;
+    uint8_t* obstacle_pushed;
+    bool obstacle_bounce;  // pushed seeds reflect their normal velocity instead of losing it
+
+    // Pairs the parallel passes of galaxy and fluid steps looked at and kept, one slot per worker
+    size_t worker_pairs_tested[MAX_THREAD_COUNT];
+    size_t worker_pairs_colliding[MAX_THREAD_COUNT];
+
+    ConstraintSet spring_set;
+    ConstraintSet contact_set;
+    ConstraintSet* pbd_set;  // set being projected, the parallel passes only get the simulation
+    float* contact_vn;
+
+    double pbd_dt;
+    float pbd_damping;
+    vec2 pbd_bounds;
+    bool pbd_clamp;
+
+    // Swept motion of the current impulse step
+    double sweep_dt;
+    float sweep_scale;
+    float sweep_max_radius;
+    float sweep_slow_motion;  // longest move of a seed not on the fast list, widens the broad phase
+    uint8_t* sweep_fast;      // seed is on the fast list
+    uint32_t sweep_list[CCD_MAX_LISTED];
+    float sweep_list_motion[CCD_MAX_LISTED];
+    vec2 sweep_list_lo[CCD_MAX_LISTED];  // box of the whole move, grown by the contact radius
+    vec2 sweep_list_hi[CCD_MAX_LISTED];
+    size_t sweep_list_count;
+
+    // Fastest integrated seed and smallest radius of the last step, they bound the substeps of the next frame.
+    // The integrator passes fill one slot per worker, reduced once the step is done
+    float worker_max_sqr_speed[MAX_THREAD_COUNT];
+    float worker_min_radius[MAX_THREAD_COUNT];
+    float step_max_speed;
+    float step_min_radius;
+    bool has_speed_bound;
+
+    // Morton reorder state, keys and order are double buffered for the radix passes
+    size_t reorder_clock;
+    uint32_t* reorder_keys[2];
+    uint32_t* reorder_order[2];
+    void* reorder_scratch;
+
+    SimCounters counters;
+
+    SimInput input;
+    bool has_input;  // headless simulations never get any, nothing is dragged
+    Seed* drag_seed;
+    vec2 last_mouse_pos;
+    float seed_max_radius;  // reach of a pick around the cursor and of the broad phase queries
+
+    // Shift dragging traces a lasso, the seeds it encloses are selected and dragged together
+    vec2 lasso_points[LASSO_MAX_POINTS];
+    size_t lasso_count;
+    uint32_t* selection;
+    uint8_t* selection_mask;
+    vec2* selection_offsets;  // where each selected seed sits relative to the cursor that grabbed it
+    size_t selection_count;
+    bool is_group_drag;
+    bool was_pressed;
+
+    void (*solve_collisions)(Sim2D*);
+    void (*step_frame)(Sim2D*, double, int, int);
+};
 
 // Function definitions
 // ---------------------
-void init_sim_mode(Mode mode) {
-    _allocate_memory();
+SimConfig default_sim_config(void) {
+    return (SimConfig){
+        .mode = MODE_VORONOI,
+        .integrator = INTEGRATOR_IMPULSE,
+        .seed_count = DEFAULT_SEED_COUNT,
+        .seed_radius = DEFAULT_SEED_RADIUS,
+        .reorder_interval = DEFAULT_REORDER_INTERVAL,
+        .history_bytes = 0,
+        .rng_seed = DETERMINISTIC_RAND_SEED,
+        .deterministic = false,
+        .quiet = false,
+        .scalar_contacts = false,
+        .world_width = DEFAULT_WORLD_WIDTH,
+        .world_height = DEFAULT_WORLD_HEIGHT,
+        .bh_theta = DEFAULT_BH_THETA,
+    };
+}
 
-    switch (mode) {
+Sim2D* init_sim(const SimConfig* config) {
+    Sim2D* sim = _create_sim(config);
+    _allocate_memory(sim);
+
+    switch (config->mode) {
         case MODE_VORONOI:
         case MODE_ATOMS:
-            _generate_voronoi_seeds();
-            _solve_collisions = _solve_collisions_voronoi;
-            render_frame = _render_voronoi_frame;
+            _generate_voronoi_seeds(sim);
             break;
         case MODE_BUBBLES:
-            _generate_bubbles_seeds();
-            _solve_collisions = _solve_collisions_bubbles;
-            render_frame = _render_bubbles_frame;
+            _generate_bubbles_seeds(sim);
+            break;
+        case MODE_SPRINGS:
+            _generate_springs_seeds(sim);
+            break;
+        case MODE_GALAXY:
+            _generate_galaxy_seeds(sim);
+            break;
+        case MODE_FLUID:
+            _generate_fluid_seeds(sim);
             break;
         default:
             UNREACHABLE("Unexpected execution mode");
     }
 
-    assert(_solve_collisions != NULL || "_solve_collisions is NULL");
-    assert(render_frame != NULL || "render_frame is NULL");
+    _bind_sim_mode(sim, config->mode);
+    return sim;
+}
+
+void free_sim(Sim2D* sim) {
+    if (sim == NULL) return;
+
+    free(sim->seeds);
+    arena_free(&sim->arena);
+    free_history(&sim->history);
+    free(sim);
+}
+
+// Swap the solver and frame routines in place, seeds stay resident and the map is rebuilt for the new cells
+void switch_sim_mode(Sim2D* sim, Mode mode) {
+    if (mode == sim->mode) return;
+
+    // Not every mode keeps the spatial map in sync with the seeds, springs mode does not touch it at all.
+    // Fluid mode sizes the cells to its kernel
+    sim->drag_seed = NULL;
+    clear_selection(sim);
+    sim->grid_size = _grid_size(sim, mode);
+    _release_mode_memory(sim);
+    _rebuild_map(sim);
+    if (mode == MODE_SPRINGS) {
+        _link_springs(sim);
+    } else {
+        // The springs lattice pins its top row, every other mode moves all of the seeds
+        for (size_t i = 0; i < sim->seed_count; i++) sim->inv_mass[i] = 1.0f;
+    }
+
+    // Saved states belong to the previous solver, springs and masses may have changed
+    history_clear(&sim->history);
+    _wake_all(sim);
 
-    printf("Running '%s' mode\n", mode_names[mode]);
+    _bind_sim_mode(sim, mode);
 }
 
-void free_sim_mode(void) {
-    free(seeds);
-    seeds = NULL;
+// The first forward step of a frame saves the state the frame starts from, a backward step restores the last
+// one exactly instead of integrating with a negative step, undoing a whole frame. Without a history a
+// backward step runs the integrator with the negative step
+void step_sim(Sim2D* sim, double dt, int width, int height) {
+    double start = now_ms();
 
-    for (int i = 0; i < NUM_BUCKETS; i++) {
-        Bucket* b = pos_map[i];
-        while (b != NULL) {
-            Bucket* b_next = b->next;
-            free(b);
-            b = b_next;
+    if (dt < 0.0 && history_enabled(&sim->history)) {
+        _restore_history(sim);
+    } else {
+        if (dt > 0.0 && !sim->history_saved) {
+            _save_history(sim);
+            sim->history_saved = true;
+        }
+        _reset_speed_bound(sim);
+        sim->step_frame(sim, dt, width, height);
+        _reduce_speed_bound(sim);
+        sim->counters.steps++;
+        sim->counters.seeds_awake += sim->seed_count - sim->sleeping_count;
+        sim->counters.seeds_sleeping += sim->sleeping_count;
+    }
+
+    sim->counters.physics_ms += now_ms() - start;
+}
+
+// Called once the substeps of a frame ran, their count varies with the speed of the seeds so frames are
+// only known to the caller
+void sim_end_frame(Sim2D* sim) {
+    _tick_reorder(sim);
+    sim->history_saved = false;
+}
+
+// Applied by the next step, until the first call a simulation runs without any mouse
+void set_sim_input(Sim2D* sim, const SimInput* input) {
+    sim->input = *input;
+    sim->has_input = true;
+}
+
+// Spread the seeds uniformly over the world, their order in memory ends up as random as after a while of motion
+void scatter_seeds(Sim2D* sim, int width, int height) {
+    sim->scatter_size = (vec2){width, height};
+    parallel_for(sim->seed_count, _scatter_range, sim);
+    sim->rng.counter++;
+
+    _wake_all(sim);
+    _rebuild_map(sim);
+}
+
+void clear_selection(Sim2D* sim) {
+    if (sim->selection_mask != NULL) memset(sim->selection_mask, 0, sizeof(uint8_t) * sim->seed_count);
+    sim->selection_count = 0;
+    sim->is_group_drag = false;
+}
+
+Mode sim_mode(const Sim2D* sim) {
+    return sim->mode;
+}
+
+const SimConfig* sim_config(const Sim2D* sim) {
+    return &sim->config;
+}
+
+size_t sim_seed_count(const Sim2D* sim) {
+    return sim->seed_count;
+}
+
+Seed* sim_seeds(Sim2D* sim) {
+    return sim->seeds;
+}
+
+float* sim_inv_mass(Sim2D* sim) {
+    return sim->inv_mass;
+}
+
+const uint32_t* sim_seed_ids(const Sim2D* sim) {
+    return sim->seed_ids;
+}
+
+SimCounters* sim_counters(Sim2D* sim) {
+    return &sim->counters;
+}
+
+// Energy weighs seeds by radius like the impulse solver, gravity only acts in bubbles mode
+double sim_total_energy(const Sim2D* sim) {
+    double energy = 0.0;
+    vec2 g = sim->mode == MODE_BUBBLES ? GRAVITY : (vec2){0.0f, 0.0f};
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        const Seed* s = &sim->seeds[i];
+        energy += s->radius * (0.5 * vec2_sqr_mag(s->vel) - vec2_dot(g, s->pos));
+    }
+    return energy;
+}
+
+size_t sim_sub_steps(const Sim2D* sim) {
+    // Springs, galaxy and fluid modes always run their own integrator
+    bool verlet = sim->config.integrator == INTEGRATOR_VERLET &&
+                  (sim->mode == MODE_VORONOI || sim->mode == MODE_ATOMS || sim->mode == MODE_BUBBLES);
+    if (verlet) return VERLET_SUB_STEPS;
+    return sim->mode == MODE_BUBBLES ? BUBBLES_SUB_STEPS : SUB_STEPS;
+}
+
+// Fewest substeps of a frame lasting dt that keep the fastest seed of the last step within CFL_FRACTION of the
+// smallest radius per substep, the fixed count until a step was measured. Springs keep the fixed count as a
+// floor since their stiffness depends on the step length and impulse bubbles since their piles sink into each
+// other with fewer passes, fluid also keeps pressure waves and viscosity stable
+size_t sim_adaptive_sub_steps(const Sim2D* sim, double dt) {
+    // A saved state holds a whole frame, one backward step restores it
+    if (dt < 0.0 && history_enabled(&sim->history)) return 1;
+
+    size_t fixed = sim_sub_steps(sim);
+    if (!sim->has_speed_bound) return fixed;
+
+    bool keep_fixed = sim->mode == MODE_SPRINGS ||
+                      (sim->mode == MODE_BUBBLES && sim->config.integrator == INTEGRATOR_IMPULSE);
+    size_t min_steps = keep_fixed ? fixed : 1;
+    double reach = CFL_FRACTION * fmax(sim->step_min_radius, 1.0);
+    double steps = ceil(fabs(dt) * sim->step_max_speed / reach);
+    if (sim->mode == MODE_FLUID) steps = fmax(steps, ceil(fabs(dt) / _fluid_max_dt(sim)));
+    if (steps < min_steps) return min_steps;
+    if (steps > MAX_ADAPTIVE_SUB_STEPS) return MAX_ADAPTIVE_SUB_STEPS;
+    return (size_t)steps;
+}
+
+size_t sim_memory_in_use(const Sim2D* sim) {
+    return sim->arena.in_use + sizeof(Seed) * sim->seed_count;
+}
+
+// The most the arena held at once since init, mode switches drop the buffers of the previous mode but keep the peak
+size_t sim_memory_high_water(const Sim2D* sim) {
+    return sim->arena.high_water + sizeof(Seed) * sim->seed_count;
+}
+
+size_t sim_memory_reserved(const Sim2D* sim) {
+    return sim->arena.reserved + sizeof(Seed) * sim->seed_count;
+}
+
+void print_alloc_stats(const Sim2D* sim) {
+    printf("[INFO]: Arena: %zu bytes in use, %zu bytes high-water, %zu bytes reserved\n",
+           sim->arena.in_use, sim->arena.high_water, sim->arena.reserved);
+}
+
+const Spring* sim_springs(const Sim2D* sim, size_t* count) {
+    *count = sim->spring_set.count;
+    return sim->spring_set.items;
+}
+
+// Obstacles in the order the simulation stores them, which is not the order they were given in
+const Segment* sim_obstacles(const Sim2D* sim, size_t* count) {
+    *count = sim->obstacle_count;
+    return sim->obstacles;
+}
+
+// Lasso being traced, in world coordinates
+size_t sim_lasso(const Sim2D* sim, const vec2** points) {
+    *points = sim->lasso_points;
+    return sim->lasso_count;
+}
+
+bool sim_selection_bounds(const Sim2D* sim, vec2* lo, vec2* hi) {
+    if (sim->selection_count == 0) return false;
+
+    *lo = sim->seeds[sim->selection[0]].pos;
+    *hi = *lo;
+    for (size_t i = 1; i < sim->selection_count; i++) {
+        vec2 p = sim->seeds[sim->selection[i]].pos;
+        lo->x = fminf(lo->x, p.x);
+        lo->y = fminf(lo->y, p.y);
+        hi->x = fmaxf(hi->x, p.x);
+        hi->y = fmaxf(hi->y, p.y);
+    }
+    return true;
+}
+
+// Copies the seeds whose center lies within max radius of [lo, hi] to out, which has room for all seeds.
+// Small regions walk the cells of the spatial map, syncing it first in modes that leave it behind. Regions
+// spanning more cells than seeds or buckets scan every seed
+size_t sim_seeds_in_rect(Sim2D* sim, vec2 lo, vec2 hi, Seed* out) {
+    TRACE_ZONE(__func__);
+
+    vec2 reach = {sim->seed_max_radius, sim->seed_max_radius};
+    lo = vec2_sub(lo, reach);
+    hi = vec2_add(hi, reach);
+    size_t count = 0;
+
+    int min_x = (int)floorf(fmaxf(lo.x, -MAX_WORLD_SIZE) / sim->grid_size);
+    int min_y = (int)floorf(fmaxf(lo.y, -MAX_WORLD_SIZE) / sim->grid_size);
+    int max_x = (int)floorf(fminf(hi.x, 2 * MAX_WORLD_SIZE) / sim->grid_size);
+    int max_y = (int)floorf(fminf(hi.y, 2 * MAX_WORLD_SIZE) / sim->grid_size);
+    double cells = (double)(max_x - min_x + 1) * (max_y - min_y + 1);
+
+    // Walking more cells than there are seeds costs more than the scan, and walking every bucket visits every seed
+    if (cells >= NUM_BUCKETS || cells >= sim->seed_count) {
+        for (size_t i = 0; i < sim->seed_count; i++) {
+            vec2 p = sim->seeds[i].pos;
+            if (p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y) out[count++] = sim->seeds[i];
+        }
+        return count;
+    }
+
+    // Modes that move seeds outside of the map catch it up here at most once per step
+    if (!sim->map_synced) _sync_map(sim);
+    if (++sim->bucket_query == 0) {
+        memset(sim->bucket_visits, 0, sizeof(sim->bucket_visits));
+        sim->bucket_query = 1;
+    }
+    for (int y = min_y; y <= max_y; y++) {
+        for (int x = min_x; x <= max_x; x++) {
+            size_t idx = _hash_cell(x, y);
+            if (sim->bucket_visits[idx] == sim->bucket_query) continue;
+            sim->bucket_visits[idx] = sim->bucket_query;
+
+            // Buckets are shared by distant cells, every seed is still tested against the region
+            for (Bucket* b = sim->pos_map[idx]; b != NULL; b = b->next) {
+                vec2 p = b->seed->pos;
+                if (p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y) out[count++] = *b->seed;
+            }
         }
     }
+    return count;
+}
+
+// Positions written through sim_seeds() are not in the spatial map, the next region query syncs it
+void mark_seeds_moved(Sim2D* sim) {
+    sim->map_synced = false;
+}
+
+// Restoring a saved state: allocate for config->seed_count seeds, the caller fills seeds, inv_mass and the
+// spring storage, then end_sim_restore() links everything up as init_sim() would. springs may be NULL
+// when there are none to fill
+Sim2D* begin_sim_restore(const SimConfig* config, size_t spring_count, Spring** springs) {
+    Sim2D* sim = _create_sim(config);
+    _allocate_memory(sim);
+
+    // The adjacency always exists, springs mode walks it even when no spring survived
+    _reserve_constraints(sim, &sim->spring_set, spring_count > 0 ? spring_count : 1);
+    if (springs != NULL) *springs = sim->spring_set.items;
+    return sim;
+}
+
+void end_sim_restore(Sim2D* sim, size_t spring_count) {
+    sim->spring_set.count = spring_count;
+    if (spring_count > 0) {
+        _finalize_springs(sim);
+    } else {
+        _finalize_constraints(sim, &sim->spring_set);
+    }
+
+    _rebuild_map(sim);
+    _bind_sim_mode(sim, sim->config.mode);
 }
 
 // Private function definitions
 // ---------------------
-size_t _hash(float x, float y) {
-    return (size_t)(x / GRID_SIZE + y / GRID_SIZE) % NUM_BUCKETS;
+// The spatial map and visit table are large, zeroed memory from calloc is what they start as
+Sim2D* _create_sim(const SimConfig* config) {
+    Sim2D* sim = calloc(1, sizeof(Sim2D));
+    if (sim == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    sim->config = *config;
+    sim->mode = config->mode;
+    sim->seed_count = config->seed_count;
+    sim->grid_size = _grid_size(sim, config->mode);
+    seed_rng(&sim->rng, config->rng_seed);
+    init_history(&sim->history, config->history_bytes);
+    return sim;
 }
 
-void _map_insert(Seed* s) {
-    size_t idx = _hash(s->pos.x, s->pos.y);
+// Hash of the grid cell, both axes are floored first so a seed lands in the same bucket a cell query visits.
+// The axes are mixed with large primes, summing them put a whole anti-diagonal of cells into one bucket
+size_t _hash(const Sim2D* sim, float x, float y) {
+    return _hash_cell((int)floorf(x / sim->grid_size), (int)floorf(y / sim->grid_size));
+}
+
+size_t _hash_cell(int x, int y) {
+    return (((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u)) % NUM_BUCKETS;
+}
+
+void _map_insert(Sim2D* sim, Seed* s) {
+    size_t idx = _hash(sim, s->pos.x, s->pos.y);
 
-    Bucket* b = malloc(sizeof(Bucket));
+    Bucket* b = pool_alloc(&sim->bucket_pool);
     b->seed = s;
     b->prev = NULL;
+    sim->map_nodes[s - sim->seeds] = b;
+    sim->map_buckets[s - sim->seeds] = idx;
 
-    b->next = pos_map[idx];
+    b->next = sim->pos_map[idx];
     if (b->next != NULL)
         b->next->prev = b;
-    pos_map[idx] = b;
+    sim->pos_map[idx] = b;
 }
 
-void _map_remove(Seed* s) {
-    size_t idx = _hash(s->pos.x, s->pos.y);
+void _map_remove(Sim2D* sim, Seed* s) {
+    size_t i = s - sim->seeds;
+    Bucket* b = sim->map_nodes[i];
+    if (b->prev != NULL) {
+        b->prev->next = b->next;
+    } else {
+        sim->pos_map[sim->map_buckets[i]] = b->next;
+    }
 
-    Bucket* b = pos_map[idx];
-    while (b != NULL) {
-        if (b->seed == s) {
-            if (b->prev != NULL) {
-                b->prev->next = b->next;
-            } else {
-                pos_map[idx] = b->next;
-            }
+    if (b->next != NULL) {
+        b->next->prev = b->prev;
+    }
+    pool_free(&sim->bucket_pool, b);
+}
 
-            if (b->next != NULL) {
-                b->next->prev = b->prev;
-            }
-            free(b);
-            break;
+// Seeds that stayed in their cell keep their place in its chain
+void _map_move(Sim2D* sim, Seed* s) {
+    if (_hash(sim, s->pos.x, s->pos.y) == sim->map_buckets[s - sim->seeds]) return;
+
+    _map_remove(sim, s);
+    _map_insert(sim, s);
+}
+
+float _grid_size(const Sim2D* sim, Mode mode) {
+    return mode == MODE_FLUID ? FLUID_SMOOTHING * _fluid_spacing(sim) : GRID_SIZE;
+}
+
+void _rebuild_map(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        Bucket* b = sim->pos_map[i];
+        while (b != NULL) {
+            Bucket* b_next = b->next;
+            pool_free(&sim->bucket_pool, b);
+            b = b_next;
         }
+        sim->pos_map[i] = NULL;
+    }
 
-        b = b->next;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        _map_insert(sim, &sim->seeds[i]);
     }
+    sim->map_synced = true;
 }
 
-void _allocate_memory(void) {
+// Contacts, the quadtree, the fluid lists and the springs are allocated by the first step of their mode and
+// the buckets as seeds get inserted, all of them after the mark. Rewinding drops them, the map is emptied
+// without freeing its buckets and the next mode allocates its own buffers again
+void _release_mode_memory(Sim2D* sim) {
+    arena_rewind(&sim->arena, sim->mode_mark);
+    pool_init(&sim->bucket_pool, &sim->arena, sizeof(Bucket));
     for (int i = 0; i < NUM_BUCKETS; i++) {
-        pos_map[i] = NULL;
+        sim->pos_map[i] = NULL;
+    }
+
+    sim->contacts = NULL;
+    sim->quad_nodes = NULL;
+    sim->fluid_neighbors = NULL;
+    sim->spring_set = (ConstraintSet){.relaxation = SPRING_RELAXATION};
+}
+
+// Catch the map up after seeds moved without it. Most seeds stay in their cell between steps, so this is
+// a pass of hashes with few relinks where a rebuild frees and inserts every bucket
+void _sync_map(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        _map_move(sim, &sim->seeds[i]);
+    }
+    sim->map_synced = true;
+}
+
+// Interleave the bits of the grid cell coordinates, cells close in space get close keys
+uint32_t _morton_key(vec2 pos) {
+    uint32_t cell[2] = {
+        (uint32_t)fminf(fmaxf(floorf(pos.x / GRID_SIZE), 0.0f), MORTON_CELL_MAX),
+        (uint32_t)fminf(fmaxf(floorf(pos.y / GRID_SIZE), 0.0f), MORTON_CELL_MAX),
+    };
+
+    return _spread_bits(cell[0]) | (_spread_bits(cell[1]) << 1);
+}
+
+// Spread the low 16 bits of v to the even bits
+uint32_t _spread_bits(uint32_t v) {
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+// LSD radix sort of keys[0] carrying order[0] along, both are double buffered and the result ends up in
+// slot 0. Digits every key shares are skipped, on screen sized worlds only the low two passes do any work
+void _radix_sort_keys(uint32_t* keys_buf[2], uint32_t* order_buf[2], size_t count) {
+    for (int shift = 0; shift < 32; shift += RADIX_BITS) {
+        uint32_t* keys = keys_buf[0];
+        uint32_t* order = order_buf[0];
+        size_t histogram[RADIX_BUCKETS] = {0};
+
+        for (size_t i = 0; i < count; i++) {
+            histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+        if (histogram[(keys[0] >> shift) & (RADIX_BUCKETS - 1)] == count) continue;
+
+        size_t sum = 0;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            size_t n = histogram[b];
+            histogram[b] = sum;
+            sum += n;
+        }
+
+        for (size_t i = 0; i < count; i++) {
+            size_t dst = histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+            keys_buf[1][dst] = keys[i];
+            order_buf[1][dst] = order[i];
+        }
+
+        keys_buf[0] = keys_buf[1];
+        keys_buf[1] = keys;
+        order_buf[0] = order_buf[1];
+        order_buf[1] = order;
+    }
+}
+
+// Gather a per-seed array into the new order, reorder_order[0][i] is the old index of seed i
+void _permute_seed_data(Sim2D* sim, void* data, size_t size) {
+    const uint32_t* order = sim->reorder_order[0];
+    char* src = data;
+    char* dst = sim->reorder_scratch;
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        memcpy(dst + i * size, src + order[i] * size, size);
+    }
+    memcpy(data, sim->reorder_scratch, size * sim->seed_count);
+}
+
+// Sort seeds along a Z-order curve of their cells so spatial neighbours share cache lines.
+// Everything indexed by seed follows the permutation, the spatial map is rebuilt in the new order
+void _reorder_seeds(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    if (sim->seed_count < 2) return;
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        sim->reorder_keys[0][i] = _morton_key(sim->seeds[i].pos);
+        sim->reorder_order[0][i] = i;
+    }
+    _radix_sort_keys(sim->reorder_keys, sim->reorder_order, sim->seed_count);
+
+    const uint32_t* order = sim->reorder_order[0];
+    size_t drag_idx = sim->drag_seed != NULL ? (size_t)(sim->drag_seed - sim->seeds) : sim->seed_count;
+
+    _permute_seed_data(sim, sim->seeds, sizeof(Seed));
+    _permute_seed_data(sim, sim->prev_pos, sizeof(vec2));
+    _permute_seed_data(sim, sim->inv_mass, sizeof(float));
+    _permute_seed_data(sim, sim->seed_ids, sizeof(uint32_t));
+    _permute_seed_data(sim, sim->sleep_state, sizeof(uint8_t));
+    _permute_seed_data(sim, sim->sleep_timers, sizeof(float));
+    _permute_seed_data(sim, sim->selection_mask, sizeof(uint8_t));
+
+    // Inverse permutation, reuses the spare key buffer
+    uint32_t* new_index = sim->reorder_keys[1];
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        new_index[order[i]] = i;
+    }
+
+    if (drag_idx < sim->seed_count) sim->drag_seed = &sim->seeds[new_index[drag_idx]];
+    for (size_t i = 0; i < sim->selection_count; i++) {
+        sim->selection[i] = new_index[sim->selection[i]];
+    }
+
+    // Springs stay sorted by their lower index so the constraint passes keep streaming
+    if (sim->spring_set.count > 0) {
+        for (size_t i = 0; i < sim->spring_set.count; i++) {
+            Spring* sp = &sim->spring_set.items[i];
+            uint32_t p0 = new_index[sp->p0];
+            uint32_t p1 = new_index[sp->p1];
+            sp->p0 = p0 < p1 ? p0 : p1;
+            sp->p1 = p0 < p1 ? p1 : p0;
+        }
+        qsort(sim->spring_set.items, sim->spring_set.count, sizeof(Spring), _compare_springs);
+        _finalize_constraints(sim, &sim->spring_set);
+    }
+
+    _rebuild_map(sim);
+}
+
+void _tick_reorder(Sim2D* sim) {
+    if (sim->config.reorder_interval == 0) return;
+
+    // The interval is in frames ended by sim_end_frame, the first one sorts the freshly generated seeds
+    if (sim->reorder_clock++ % sim->config.reorder_interval != 0) return;
+    _reorder_seeds(sim);
+}
+
+// States are kept in generation order so a reorder in between does not matter on restore
+void _save_history(Sim2D* sim) {
+    if (!history_enabled(&sim->history)) return;
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        uint32_t* state = &sim->history_state[HISTORY_WORDS * sim->seed_ids[i]];
+        memcpy(state, &sim->seeds[i].pos, sizeof(vec2));
+        memcpy(state + 2, &sim->seeds[i].vel, sizeof(vec2));
+        memcpy(state + 4, &sim->seeds[i].acc, sizeof(vec2));
+    }
+    history_push(&sim->history, sim->history_state, HISTORY_WORDS * sim->seed_count);
+}
+
+bool _restore_history(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    if (!history_pop(&sim->history, sim->history_state, HISTORY_WORDS * sim->seed_count)) return false;
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        const uint32_t* state = &sim->history_state[HISTORY_WORDS * sim->seed_ids[i]];
+        memcpy(&sim->seeds[i].pos, state, sizeof(vec2));
+        memcpy(&sim->seeds[i].vel, state + 2, sizeof(vec2));
+        memcpy(&sim->seeds[i].acc, state + 4, sizeof(vec2));
+    }
+
+    // Sleep is not part of the saved state, every seed resumes awake and settles again. The substeps of the
+    // next frame follow the restored velocities
+    _wake_all(sim);
+    _rebuild_map(sim);
+
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        max_sqr_speed = fmaxf(max_sqr_speed, vec2_sqr_mag(sim->seeds[i].vel));
+        min_radius = fminf(min_radius, (float)sim->seeds[i].radius);
+    }
+    _reset_speed_bound(sim);
+    _store_speed_bound(sim, 0, max_sqr_speed, min_radius);
+    _reduce_speed_bound(sim);
+    return true;
+}
+
+void _bind_sim_mode(Sim2D* sim, Mode mode) {
+    switch (mode) {
+        case MODE_VORONOI:
+        case MODE_ATOMS:
+            sim->solve_collisions =
+                sim->config.scalar_contacts ? _solve_collisions_voronoi_scalar : _solve_collisions_voronoi;
+            sim->step_frame = _step_voronoi_frame;
+            break;
+        case MODE_BUBBLES:
+            sim->solve_collisions = _solve_collisions_bubbles;
+            sim->step_frame = _step_bubbles_frame;
+            break;
+        case MODE_SPRINGS:
+            sim->solve_collisions = _solve_collisions_springs;
+            sim->step_frame = _step_springs_frame;
+            break;
+        case MODE_GALAXY:
+            sim->solve_collisions = _solve_gravity_galaxy;
+            sim->step_frame = _step_galaxy_frame;
+            break;
+        case MODE_FLUID:
+            sim->solve_collisions = _solve_pressure_fluid;
+            sim->step_frame = _step_fluid_frame;
+            break;
+        default:
+            UNREACHABLE("Unexpected execution mode");
     }
 
-    if (seeds != NULL)
-        free_sim_mode();
+    // Radii only change when seeds are generated or restored, both bind the mode afterwards
+    sim->seed_max_radius = _max_seed_radius(sim);
+
+    // The whole mass pulls a seed on the rim of the generated disc around in GALAXY_PERIOD seconds
+    double total_mass = 0.0;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        total_mass += sim->seeds[i].radius;
+    }
+    double disc_radius = GALAXY_DISC_FRACTION * fmin(sim->config.world_width, sim->config.world_height);
+    double omega = 2.0 * M_PI / GALAXY_PERIOD;
+    sim->galaxy_g = total_mass > 0.0 ? omega * omega * disc_radius * disc_radius * disc_radius / total_mass : 0.0;
+    sim->galaxy_softening = fmaxf(GALAXY_SOFTENING * sim->seed_max_radius, 1.0f);
+
+    sim->fluid_spacing = _fluid_spacing(sim);
+    sim->fluid_h = FLUID_SMOOTHING * sim->fluid_spacing;
+    sim->fluid_rest_density = _fluid_rest_density(sim->fluid_spacing, sim->fluid_h);
+
+    assert(sim->solve_collisions != NULL || "sim->solve_collisions is NULL");
+    assert(sim->step_frame != NULL || "sim->step_frame is NULL");
+
+    sim->mode = mode;
+    if (!sim->config.quiet) printf("Running '%s' mode\n", mode_names[mode]);
+}
+
+void _allocate_memory(Sim2D* sim) {
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        sim->pos_map[i] = NULL;
+    }
 
-    seeds = (Seed*)calloc(SEED_COUNT, sizeof(Seed));
+    free(sim->seeds);
+    sim->seeds = (Seed*)calloc(sim->seed_count, sizeof(Seed));
 
-    if (seeds == NULL) {
+    if (sim->seeds == NULL) {
         printf("[ERROR]: Memory was not allocated\n");
         exit(EXIT_FAILURE);
     }
+
+    // Buckets and scratch lists live in the arena, dropping them is a single rewind
+    arena_reset(&sim->arena);
+    pool_init(&sim->bucket_pool, &sim->arena, sizeof(Bucket));
+    sim->candidates = arena_alloc(&sim->arena, sizeof(Seed*) * sim->seed_count);
+    sim->map_nodes = arena_alloc(&sim->arena, sizeof(Bucket*) * sim->seed_count);
+    sim->map_buckets = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    sim->prev_pos = arena_alloc(&sim->arena, sizeof(vec2) * sim->seed_count);
+    sim->inv_mass = arena_alloc(&sim->arena, sizeof(float) * sim->seed_count);
+    sim->seed_ids = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    sim->history_state = arena_alloc(&sim->arena, sizeof(uint32_t) * HISTORY_WORDS * sim->seed_count);
+    sim->history_saved = false;
+    history_clear(&sim->history);
+    sim->sleep_state = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->seed_count);
+    sim->sleep_timers = arena_alloc(&sim->arena, sizeof(float) * sim->seed_count);
+    sim->island_rest = arena_alloc(&sim->arena, sizeof(float) * sim->seed_count);
+    sim->island_parent = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    sim->wake_queue = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    sim->sweep_fast = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->seed_count);
+    _wake_all(sim);
+    sim->selection = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    sim->selection_mask = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->seed_count);
+    sim->selection_offsets = arena_alloc(&sim->arena, sizeof(vec2) * sim->seed_count);
+    clear_selection(sim);
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        sim->inv_mass[i] = 1.0f;
+        sim->seed_ids[i] = i;
+    }
+
+    sim->spring_set = (ConstraintSet){.relaxation = SPRING_RELAXATION};
+
+    // Contacts are rebuilt every substep, a seed keeps at most a handful of them.
+    // Over-relaxing a one sided contact pushes seeds past each other and pumps energy in
+    sim->contact_set = (ConstraintSet){.relaxation = 1.0f, .unilateral = true};
+    _reserve_constraints(sim, &sim->contact_set, sim->seed_count * VERLET_MAX_CONTACTS / 2);
+    sim->contact_vn = arena_alloc(&sim->arena, sizeof(float) * sim->contact_set.capacity);
+    sim->contacts = NULL;
+    sim->quad_nodes = NULL;
+    sim->fluid_neighbors = NULL;
+    _build_obstacles(sim);
+
+    sim->reorder_clock = 0;
+    if (sim->config.reorder_interval > 0) {
+        for (int i = 0; i < 2; i++) {
+            sim->reorder_keys[i] = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+            sim->reorder_order[i] = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+        }
+        sim->reorder_scratch = arena_alloc(&sim->arena, sizeof(Seed) * sim->seed_count);
+    }
+    sim->mode_mark = arena_mark(&sim->arena);
 }
 
-void _generate_seed_pos(Seed* s) {
-    s->pos.x = DEFAULT_SCREEN_WIDTH / 2 + rand_float() * 100 - 50;
-    s->pos.y = DEFAULT_SCREEN_HEIGHT / 2 + rand_float() * 100 - 50;
+void _generate_seed_pos(Rng* rng, Seed* s, vec2 center) {
+    s->pos.x = center.x + rand_float(rng) * 100 - 50;
+    s->pos.y = center.y + rand_float(rng) * 100 - 50;
 }
 
-void _generate_seed_color(Seed* s) {
-    s->color.x = rand_float();
-    s->color.y = rand_float();
-    s->color.z = rand_float();
+void _generate_seed_color(Rng* rng, Seed* s) {
+    s->color.x = rand_float(rng);
+    s->color.y = rand_float(rng);
+    s->color.z = rand_float(rng);
     s->color.w = 1.0f;
 }
 
-void _generate_seed_dynamics(Seed* s, vec2 acc, float mag) {
-    float angle = rand_float() * 2.0f * M_PI;
+void _generate_seed_dynamics(Rng* rng, Seed* s, vec2 acc, float mag) {
+    float angle = rand_float(rng) * 2.0f * M_PI;
     s->vel.x = cosf(angle) * mag;
     s->vel.y = sinf(angle) * mag;
 
     s->acc = acc;
 }
 
-void _apply_constraints(int width, int height) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s = &seeds[i];
+void _scatter_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    for (size_t i = begin; i < end; i++) {
+        Rng rng = rng_stream(&sim->rng, i);
+        float x = rand_float(&rng) * sim->scatter_size.x;
+        float y = rand_float(&rng) * sim->scatter_size.y;
+        sim->seeds[i].pos = (vec2){x, y};
+    }
+}
+
+void _apply_constraints(Sim2D* sim, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s = &sim->seeds[i];
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
 
         // Bounce off walls
         if ((s->pos.x < 0.0f && s->vel.x < 0) || (s->pos.x > width && s->vel.x > 0)) {
@@ -198,27 +1258,34 @@ void _apply_constraints(int width, int height) {
     }
 }
 
-void _apply_gravity(void) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s = &seeds[i];
-        s->acc = vec2_add(s->acc, GRAVITY);
+void _apply_gravity(Sim2D* sim, vec2 gravity) {
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
+        sim->seeds[i].acc = vec2_add(sim->seeds[i].acc, gravity);
     }
 }
 
-void _find_collisions(Seed* s, float collision_dist, Seed** candidates, size_t* count) {
+void _find_collisions(Sim2D* sim, Seed* s, float collision_dist, Seed** candidates, size_t* count) {
     *count = 0;
-    bool visited[NUM_BUCKETS] = {0};
-    int min_x = (int)((s->pos.x - collision_dist) / GRID_SIZE);
-    int min_y = (int)((s->pos.y - collision_dist) / GRID_SIZE);
-    int max_x = (int)((s->pos.x + collision_dist) / GRID_SIZE);
-    int max_y = (int)((s->pos.y + collision_dist) / GRID_SIZE);
+
+    // Buckets are marked with the query number instead of clearing a visited table on every call
+    if (++sim->bucket_query == 0) {
+        memset(sim->bucket_visits, 0, sizeof(sim->bucket_visits));
+        sim->bucket_query = 1;
+    }
+    int min_x = (int)floorf((s->pos.x - collision_dist) / sim->grid_size);
+    int min_y = (int)floorf((s->pos.y - collision_dist) / sim->grid_size);
+    int max_x = (int)floorf((s->pos.x + collision_dist) / sim->grid_size);
+    int max_y = (int)floorf((s->pos.y + collision_dist) / sim->grid_size);
 
     for (int x = min_x; x <= max_x; x++) {
         for (int y = min_y; y <= max_y; y++) {
-            size_t idx = _hash(x * GRID_SIZE, y * GRID_SIZE);
-            if (visited[idx]) continue;
-            visited[idx] = true;
-            Bucket* b = pos_map[idx];
+            size_t idx = _hash_cell(x, y);
+            if (sim->bucket_visits[idx] == sim->bucket_query) continue;
+            sim->bucket_visits[idx] = sim->bucket_query;
+            Bucket* b = sim->pos_map[idx];
 
             while (b != NULL) {
                 float dist = vec2_dist(s->pos, b->seed->pos);
@@ -229,30 +1296,63 @@ void _find_collisions(Seed* s, float collision_dist, Seed** candidates, size_t*
             }
         }
     }
+
+    // Chain order depends on the history of map updates, seed order only on the state
+    if (sim->config.deterministic) _sort_candidates(candidates, *count);
+}
+
+// Insertion sort, candidate lists are short and mostly sorted already
+void _sort_candidates(Seed** candidates, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        Seed* c = candidates[i];
+        size_t j = i;
+        for (; j > 0 && candidates[j - 1] > c; j--) {
+            candidates[j] = candidates[j - 1];
+        }
+        candidates[j] = c;
+    }
+}
+
+// Two stages: the broad phase emits every overlapping pair once, then the pairs are resolved in groups where no
+// seed appears twice, CONTACT_LANES at a time
+void _solve_collisions_voronoi(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    _reserve_voronoi_contacts(sim);
+    _find_voronoi_contacts(sim);
+    _color_contacts(sim);
+    _resolve_contacts(sim);
 }
 
-void _solve_collisions_voronoi(void) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s1 = &seeds[i];
+// Resolves each pair as soon as the broad phase finds it, later pairs see the moved seeds
+void _solve_collisions_voronoi_scalar(Sim2D* sim) {
+    TRACE_ZONE(__func__);
 
-        _map_remove(s1);
-        Seed* candidates[SEED_COUNT];
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s1 = &sim->seeds[i];
+
+        _map_remove(sim, s1);
         size_t cand_count = 0;
-        _find_collisions(s1, 3.0f * s1->radius, candidates, &cand_count);
+        _find_collisions(sim, s1, 3.0f * s1->radius, sim->candidates, &cand_count);
+        sim->counters.pairs_tested += cand_count;
 
         for (size_t j = 0; j < cand_count; j++) {
-            Seed* s2 = candidates[j];
+            Seed* s2 = sim->candidates[j];
 
             float dist = vec2_dist(s1->pos, s2->pos);
             float radii_sum = s1->radius + s2->radius;
 
             if (dist < radii_sum) {
-                _map_remove(s2);
+                int c1 = _is_held(sim, s1);
+                int c2 = _is_held(sim, s2);
+                if (c1 && c2) continue;  // a dragged group keeps its shape
+
+                // A pair still overlapping when its higher seed comes up was counted by the lower one already
+                sim->counters.pairs_colliding += s2 > s1;
+                _map_remove(sim, s2);
 
                 int rad1 = s1->radius;
                 int rad2 = s2->radius;
-                int c1 = s1 == drag_seed;
-                int c2 = s2 == drag_seed;
                 rad1 = INT_MAX * (c1 && vec2_is_zero(s1->vel)) + rad1 * !(c1 && vec2_is_zero(s1->vel));
                 rad2 = INT_MAX * (c2 && vec2_is_zero(s2->vel)) + rad2 * !(c2 && vec2_is_zero(s2->vel));
 
@@ -260,137 +1360,2232 @@ void _solve_collisions_voronoi(void) {
 
                 // Move the current seed apart
                 float delta = radii_sum - dist;
-                vec2 n = vec2_scale(vec2_sub(s1->pos, s2->pos), 1 / dist);
+                vec2 n = dist > 0.0f ? vec2_scale(vec2_sub(s1->pos, s2->pos), 1 / dist) : (vec2){1.0f, 0.0f};
                 float delta1 = !(c1 || c2) * (delta * 0.5f) + (c1 || c2) * delta;
                 float delta2 = delta1 * -1.0f;
                 s1->pos = vec2_add(s1->pos, vec2_scale(n, delta1));
                 s2->pos = vec2_add(s2->pos, vec2_scale(n, delta2));
 
-                _map_insert(s2);
+                _map_insert(sim, s2);
             }
         }
-        _map_insert(s1);
+        _map_insert(sim, s1);
     }
 }
 
-void _solve_collisions_bubbles(void) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s1 = &seeds[i];
+void _reserve_voronoi_contacts(Sim2D* sim) {
+    if (sim->contacts != NULL) return;
 
-        for (size_t j = i + 1; j < SEED_COUNT; j++) {
-            Seed* s2 = &seeds[j];
+    sim->contact_capacity = sim->seed_count * CONTACT_MAX_PER_SEED;
+    sim->contacts = arena_alloc(&sim->arena, sizeof(Contact) * sim->contact_capacity);
+    sim->contact_colors = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->contact_capacity);
+    sim->contact_order = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->contact_capacity);
+    sim->seed_colors = arena_alloc(&sim->arena, sizeof(uint64_t) * sim->seed_count);
+}
 
-            float dist = vec2_dist(s1->pos, s2->pos);
-            float radii_sum = s1->radius + s2->radius;
+// Each pair is emitted by its lower seed, so the query has to reach the largest neighbour. Nothing moves here
+// unless the buffer overflows, dragged seeds at rest get an infinite mass like in the scalar path
+void _find_voronoi_contacts(Sim2D* sim) {
+    TRACE_ZONE(__func__);
 
-            if (dist < radii_sum / 1.5f) {
+    sim->contact_count = 0;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s1 = &sim->seeds[i];
 
-                collision_sim_1(s1->pos, s2->pos, s1->radius, s2->radius, &s1->vel, &s2->vel);
+        size_t cand_count = 0;
+        _find_collisions(sim, s1, s1->radius + sim->seed_max_radius, sim->candidates, &cand_count);
+        if (cand_count > 0) sim->counters.pairs_tested += cand_count - 1;  // the seed itself is still in the map
 
-                // Move the current seed apart
-                float delta = radii_sum / 1.5f - dist;
-                vec2 n = vec2_scale(vec2_sub(s1->pos, s2->pos), 1 / dist);
-                s1->pos = vec2_add(s1->pos, vec2_scale(n, delta * 0.5f));
-                s2->pos = vec2_add(s2->pos, vec2_scale(n, delta * -0.5f));
-            }
-        }
-    }
-}
+        for (size_t j = 0; j < cand_count; j++) {
+            Seed* s2 = sim->candidates[j];
+            if (s2 <= s1) continue;
 
-void _update_positions(double dt) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s = &seeds[i];
+            float radii_sum = s1->radius + s2->radius;
+            float sqr_dist = vec2_sqr_dist(s1->pos, s2->pos);
+            if (sqr_dist >= radii_sum * radii_sum) continue;
+
+            bool c1 = _is_held(sim, s1);
+            bool c2 = _is_held(sim, s2);
+            if (c1 && c2) continue;  // a dragged group keeps its shape
+
+            float m1 = c1 && vec2_is_zero(s1->vel) ? (float)INT_MAX : s1->radius;
+            float m2 = c2 && vec2_is_zero(s2->vel) ? (float)INT_MAX : s2->radius;
+            float inv_mass_sum = 1.0f / (m1 + m2);
+
+            Contact c = {
+                .p0 = i,
+                .p1 = s2 - sim->seeds,
+                .radii_sum = radii_sum,
+                .push = c1 || c2 ? 1.0f : 0.5f,
+                .w0 = 2.0f * m2 * inv_mass_sum,
+                .w1 = 2.0f * m1 * inv_mass_sum,
+            };
+            sim->counters.pairs_colliding++;
+            if (sim->contact_count < sim->contact_capacity) {
+                sim->contacts[sim->contact_count++] = c;
+                continue;
+            }
 
-        if (drag_seed != s) {
-            _map_remove(s);
-            s->vel = vec2_add(s->vel, vec2_scale(s->acc, dt));
-            s->pos = vec2_add(s->pos, vec2_scale(s->vel, dt));
-            s->acc = (vec2){0.0f, 0.0f};
-            _map_insert(s);
+            // The buffer is full, the pair is resolved right away like the scalar path does
+            _map_remove(sim, s1);
+            _map_remove(sim, s2);
+            _resolve_contact(sim, &c, true);
+            _map_insert(sim, s1);
+            _map_insert(sim, s2);
+            sim->counters.contacts_overflowed++;
         }
     }
 }
 
-void _check_drag(GLFWwindow* window, int height, double dt) {
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
-    vec2 cur_mouse_pos = (vec2){(float)xpos, height - (float)ypos};
-
-    if (IS_DRAG_MODE) {
-        for (size_t i = 0; i < SEED_COUNT && drag_seed == NULL; i++) {
-            float dist = vec2_dist(seeds[i].pos, cur_mouse_pos);
-            if (dist < seeds[i].radius) {
-                drag_seed = &seeds[i];
-                break;
-            }
+// Greedy coloring in emission order, a contact joins the first group neither of its seeds is in yet. The
+// contacts are then counting sorted by group, the ones that found no group go last
+void _color_contacts(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    memset(sim->seed_colors, 0, sizeof(uint64_t) * sim->seed_count);
+    memset(sim->color_offsets, 0, sizeof(sim->color_offsets));
+
+    for (size_t k = 0; k < sim->contact_count; k++) {
+        const Contact* c = &sim->contacts[k];
+        uint64_t used = sim->seed_colors[c->p0] | sim->seed_colors[c->p1];
+        uint8_t color = CONTACT_MAX_COLORS;
+        if (used != UINT64_MAX) {
+            color = __builtin_ctzll(~used);
+            sim->seed_colors[c->p0] |= 1ull << color;
+            sim->seed_colors[c->p1] |= 1ull << color;
+        } else {
+            // Both seeds count as being in every group, their later contacts are left over as well
+            sim->seed_colors[c->p0] = UINT64_MAX;
+            sim->seed_colors[c->p1] = UINT64_MAX;
         }
+        sim->contact_colors[k] = color;
+        sim->color_offsets[color + 1]++;
+    }
 
-        if (drag_seed != NULL) {            
-            _map_remove(drag_seed);
-            drag_seed->pos = cur_mouse_pos;
-            _map_insert(drag_seed);
+    for (size_t color = 0; color <= CONTACT_MAX_COLORS; color++) {
+        sim->color_offsets[color + 1] += sim->color_offsets[color];
+    }
+    for (size_t k = 0; k < sim->contact_count; k++) {
+        sim->contact_order[sim->color_offsets[sim->contact_colors[k]]++] = k;
+    }
 
-            vec2 delta_cursor = vec2_sub(cur_mouse_pos, last_mouse_pos);
-            drag_seed->vel = vec2_scale(delta_cursor, 1 / (dt * 2.0f));
-            last_mouse_pos = cur_mouse_pos;
-        }
-    } else {
-        drag_seed = NULL;
-        last_mouse_pos = cur_mouse_pos;
+    // The scatter advanced every offset to the end of its group, shift them back to the starts
+    for (size_t color = CONTACT_MAX_COLORS + 1; color > 0; color--) {
+        sim->color_offsets[color] = sim->color_offsets[color - 1];
     }
+    sim->color_offsets[0] = 0;
 }
 
-void _generate_voronoi_seeds(void) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s = &seeds[i];
+// Exchanges the normal velocities like collision_sim_1 and moves both seeds apart, unless earlier groups
+// already separated them. The normal points from p1 to p0
+void _resolve_contact(Sim2D* sim, const Contact* c, bool exchange) {
+    Seed* s1 = &sim->seeds[c->p0];
+    Seed* s2 = &sim->seeds[c->p1];
+
+    float dx = s1->pos.x - s2->pos.x;
+    float dy = s1->pos.y - s2->pos.y;
+    float dist = sqrtf(dx * dx + dy * dy);
+    float delta = c->radii_sum - dist;
+    if (!(delta > 0.0f)) return;
+
+    // Seeds pushed onto the same point, by obstacles for one, are taken apart along x
+    float nx = dist > 0.0f ? dx / dist : 1.0f;
+    float ny = dist > 0.0f ? dy / dist : 0.0f;
+    float dn = exchange ? (s1->vel.x - s2->vel.x) * nx + (s1->vel.y - s2->vel.y) * ny : 0.0f;
+    float j1 = c->w0 * dn;
+    float j2 = c->w1 * dn;
+    float push = c->push * delta;
+    s1->vel.x -= nx * j1;
+    s1->vel.y -= ny * j1;
+    s2->vel.x += nx * j2;
+    s2->vel.y += ny * j2;
+
+    s1->pos.x += nx * push;
+    s1->pos.y += ny * push;
+    s2->pos.x -= nx * push;
+    s2->pos.y -= ny * push;
+}
 
-        s->radius = SEED_RADIUS;
+// The same arithmetic as _resolve_contact on CONTACT_LANES contacts of one group. SSE has no gather, the
+// fields are loaded lane by lane and the math runs on whole registers
+void _resolve_contact_lanes(Sim2D* sim, const uint32_t* order, bool exchange) {
+#ifdef __SSE__
+    const Contact* c[CONTACT_LANES];
+    Seed* s1[CONTACT_LANES];
+    Seed* s2[CONTACT_LANES];
+    for (size_t l = 0; l < CONTACT_LANES; l++) {
+        c[l] = &sim->contacts[order[l]];
+        s1[l] = &sim->seeds[c[l]->p0];
+        s2[l] = &sim->seeds[c[l]->p1];
+    }
 
-        _generate_seed_pos(s);
-        _generate_seed_color(s);
-        _generate_seed_dynamics(s, (vec2){0.0f, 0.0f}, lerpf(100, 300, rand_float()));
+    __m128 radii_sum = _mm_setr_ps(c[0]->radii_sum, c[1]->radii_sum, c[2]->radii_sum, c[3]->radii_sum);
+    __m128 push = _mm_setr_ps(c[0]->push, c[1]->push, c[2]->push, c[3]->push);
+    __m128 w0 = _mm_setr_ps(c[0]->w0, c[1]->w0, c[2]->w0, c[3]->w0);
+    __m128 w1 = _mm_setr_ps(c[0]->w1, c[1]->w1, c[2]->w1, c[3]->w1);
+
+    __m128 v1x = _mm_setr_ps(s1[0]->vel.x, s1[1]->vel.x, s1[2]->vel.x, s1[3]->vel.x);
+    __m128 v1y = _mm_setr_ps(s1[0]->vel.y, s1[1]->vel.y, s1[2]->vel.y, s1[3]->vel.y);
+    __m128 v2x = _mm_setr_ps(s2[0]->vel.x, s2[1]->vel.x, s2[2]->vel.x, s2[3]->vel.x);
+    __m128 v2y = _mm_setr_ps(s2[0]->vel.y, s2[1]->vel.y, s2[2]->vel.y, s2[3]->vel.y);
+    __m128 p1x = _mm_setr_ps(s1[0]->pos.x, s1[1]->pos.x, s1[2]->pos.x, s1[3]->pos.x);
+    __m128 p1y = _mm_setr_ps(s1[0]->pos.y, s1[1]->pos.y, s1[2]->pos.y, s1[3]->pos.y);
+    __m128 p2x = _mm_setr_ps(s2[0]->pos.x, s2[1]->pos.x, s2[2]->pos.x, s2[3]->pos.x);
+    __m128 p2y = _mm_setr_ps(s2[0]->pos.y, s2[1]->pos.y, s2[2]->pos.y, s2[3]->pos.y);
+
+    // Lanes whose seeds were already separated get zero impulse and push, the masked out division is discarded.
+    // Lanes whose seeds sit on the same point take the x axis as their normal
+    __m128 dx = _mm_sub_ps(p1x, p2x);
+    __m128 dy = _mm_sub_ps(p1y, p2y);
+    __m128 dist = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    __m128 delta = _mm_sub_ps(radii_sum, dist);
+    __m128 overlap = _mm_cmpgt_ps(delta, _mm_setzero_ps());
+    __m128 apart = _mm_cmpgt_ps(dist, _mm_setzero_ps());
+    __m128 nx = _mm_or_ps(_mm_and_ps(apart, _mm_div_ps(dx, dist)), _mm_andnot_ps(apart, _mm_set1_ps(1.0f)));
+    __m128 ny = _mm_and_ps(apart, _mm_div_ps(dy, dist));
+    nx = _mm_and_ps(overlap, nx);
+    ny = _mm_and_ps(overlap, ny);
+
+    __m128 dn = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(v1x, v2x), nx), _mm_mul_ps(_mm_sub_ps(v1y, v2y), ny));
+    if (!exchange) dn = _mm_setzero_ps();
+    __m128 j1 = _mm_mul_ps(w0, dn);
+    __m128 j2 = _mm_mul_ps(w1, dn);
+    push = _mm_mul_ps(push, delta);
+    v1x = _mm_sub_ps(v1x, _mm_mul_ps(nx, j1));
+    v1y = _mm_sub_ps(v1y, _mm_mul_ps(ny, j1));
+    v2x = _mm_add_ps(v2x, _mm_mul_ps(nx, j2));
+    v2y = _mm_add_ps(v2y, _mm_mul_ps(ny, j2));
+
+    p1x = _mm_add_ps(p1x, _mm_mul_ps(nx, push));
+    p1y = _mm_add_ps(p1y, _mm_mul_ps(ny, push));
+    p2x = _mm_sub_ps(p2x, _mm_mul_ps(nx, push));
+    p2y = _mm_sub_ps(p2y, _mm_mul_ps(ny, push));
+
+    float out[8][CONTACT_LANES];
+    _mm_storeu_ps(out[0], v1x);
+    _mm_storeu_ps(out[1], v1y);
+    _mm_storeu_ps(out[2], v2x);
+    _mm_storeu_ps(out[3], v2y);
+    _mm_storeu_ps(out[4], p1x);
+    _mm_storeu_ps(out[5], p1y);
+    _mm_storeu_ps(out[6], p2x);
+    _mm_storeu_ps(out[7], p2y);
+    for (size_t l = 0; l < CONTACT_LANES; l++) {
+        s1[l]->vel = (vec2){out[0][l], out[1][l]};
+        s2[l]->vel = (vec2){out[2][l], out[3][l]};
+        s1[l]->pos = (vec2){out[4][l], out[5][l]};
+        s2[l]->pos = (vec2){out[6][l], out[7][l]};
+    }
+#else
+    for (size_t l = 0; l < CONTACT_LANES; l++) {
+        _resolve_contact(sim, &sim->contacts[order[l]], exchange);
+    }
+#endif
+}
+
+// Groups run one after another, so a seed sees the responses of its earlier groups. Seeds with contacts leave
+// the map while they move and go back in at their new position
+void _resolve_contacts(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->seed_colors[i] != 0) _map_remove(sim, &sim->seeds[i]);
+    }
+
+    for (int it = 0; it < CONTACT_ITERATIONS; it++) {
+        bool exchange = it == 0;
+        for (size_t color = 0; color < CONTACT_MAX_COLORS; color++) {
+            size_t k = sim->color_offsets[color];
+            size_t end = sim->color_offsets[color + 1];
+            for (; k + CONTACT_LANES <= end; k += CONTACT_LANES) {
+                _resolve_contact_lanes(sim, &sim->contact_order[k], exchange);
+            }
+            for (; k < end; k++) {
+                _resolve_contact(sim, &sim->contacts[sim->contact_order[k]], exchange);
+            }
+        }
+
+        // Contacts of seeds already in every group, one at a time
+        for (size_t k = sim->color_offsets[CONTACT_MAX_COLORS]; k < sim->contact_count; k++) {
+            _resolve_contact(sim, &sim->contacts[sim->contact_order[k]], exchange);
+        }
+    }
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->seed_colors[i] != 0) _map_insert(sim, &sim->seeds[i]);
+    }
+}
+
+// Awake seeds are tested against each other and against the sleeping ones, sleeping pairs are skipped.
+// A sleeping seed does not move until it wakes at the end of the step, the awake one takes the whole response
+void _solve_collisions_bubbles(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    // Every awake seed queries the spatial map, an awake pair is taken by its lower seed. Contacts push seeds
+    // as they are found, so the ones that moved are put back in the bucket of their new position
+    if (!sim->map_synced) _sync_map(sim);
+
+    float reach = sim->seed_max_radius * BUBBLES_CONTACT_SCALE;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
+        Seed* s1 = &sim->seeds[i];
+
+        size_t cand_count = 0;
+        _find_collisions(sim, s1, s1->radius * BUBBLES_CONTACT_SCALE + reach, sim->candidates, &cand_count);
+        for (size_t j = 0; j < cand_count; j++) {
+            Seed* s2 = sim->candidates[j];
+            bool asleep = sim->sleep_state[s2 - sim->seeds] != SEED_AWAKE;
+            if (!asleep && s2 <= s1) continue;
+            if (_collide_bubbles_pair(sim, s1, s2, asleep) && !asleep) _map_move(sim, s2);
+        }
+        _map_move(sim, s1);
+    }
+}
+
+// A sleeping seed takes the hit like a wall, only the awake one bounces and moves. True when they touched
+bool _collide_bubbles_pair(Sim2D* sim, Seed* s1, Seed* s2, bool asleep) {
+    float contact_dist = (s1->radius + s2->radius) * BUBBLES_CONTACT_SCALE;
+    sim->counters.pairs_tested++;
+
+    // Most pairs are far apart, the square root is only taken for touching ones
+    if (vec2_sqr_dist(s1->pos, s2->pos) >= contact_dist * contact_dist) return false;
+
+    sim->counters.pairs_colliding++;
+    _link_contact(sim, s1 - sim->seeds, s2 - sim->seeds);
+
+    vec2 vel2 = s2->vel;
+    collision_sim_1(s1->pos, s2->pos, s1->radius, asleep ? INT_MAX : s2->radius, &s1->vel, asleep ? &vel2 : &s2->vel);
+
+    // Move the current seed apart
+    float dist = vec2_dist(s1->pos, s2->pos);
+    float delta = contact_dist - dist;
+    vec2 n = dist > 0.0f ? vec2_scale(vec2_sub(s1->pos, s2->pos), 1 / dist) : (vec2){1.0f, 0.0f};
+    s1->pos = vec2_add(s1->pos, vec2_scale(n, asleep ? delta : delta * 0.5f));
+    if (!asleep) s2->pos = vec2_add(s2->pos, vec2_scale(n, delta * -0.5f));
+    return true;
+}
+
+void _update_positions(Sim2D* sim, double dt, float contact_scale) {
+    TRACE_ZONE(__func__);
+
+    _begin_sweeps(sim, dt, contact_scale);
+
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s = &sim->seeds[i];
+
+        if (!_is_held(sim, s) && sim->sleep_state[i] == SEED_AWAKE) {
+            _map_remove(sim, s);
+            s->vel = vec2_add(s->vel, vec2_scale(s->acc, dt));
+            _advance_seed(sim, s);
+            s->acc = (vec2){0.0f, 0.0f};
+            _map_insert(sim, s);
+
+            max_sqr_speed = fmaxf(max_sqr_speed, vec2_sqr_mag(s->vel));
+            min_radius = fminf(min_radius, (float)s->radius);
+        }
+    }
+    _store_speed_bound(sim, 0, max_sqr_speed, min_radius);
+    _collide_obstacles(sim, true);
+}
+
+// A seed flung across the world would widen every query of the step, the fastest ones are listed instead and
+// each sweep tests them by their own motion. The grid query only has to reach the longest move of the others
+void _begin_sweeps(Sim2D* sim, double dt, float contact_scale) {
+    sim->sweep_dt = dt;
+    sim->sweep_scale = contact_scale;
+    sim->sweep_max_radius = sim->seed_max_radius;
+    sim->sweep_slow_motion = 0.0f;
+    sim->sweep_list_count = 0;
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        sim->sweep_fast[i] = 0;
+        _classify_sweep(sim, i);
+    }
+}
+
+// Only seeds past their sweep threshold are listed, a full list gives up its slowest one to the grid query.
+// Called again when an impact changes the velocity of a seed that has not moved yet. Held and sleeping seeds
+// stay where they are, the grid finds them like the seeds that already moved
+void _classify_sweep(Sim2D* sim, size_t i) {
+    const Seed* s = &sim->seeds[i];
+    if (_is_held(sim, s) || sim->sleep_state[i] != SEED_AWAKE) return;
+
+    vec2 step = _step_motion(sim, s);
+    float motion = vec2_mag(step);
+    size_t k = 0;
+    if (sim->sweep_fast[i]) {
+        while (sim->sweep_list[k] != i) k++;
+    } else if (motion <= CCD_MOTION_FRACTION * s->radius * sim->sweep_scale) {
+        sim->sweep_slow_motion = fmaxf(sim->sweep_slow_motion, motion);
+        return;
+    } else if (sim->sweep_list_count < CCD_MAX_LISTED) {
+        k = sim->sweep_list_count++;
+    } else {
+        for (size_t j = 1; j < CCD_MAX_LISTED; j++) {
+            if (sim->sweep_list_motion[j] < sim->sweep_list_motion[k]) k = j;
+        }
+        if (sim->sweep_list_motion[k] >= motion) {
+            sim->sweep_slow_motion = fmaxf(sim->sweep_slow_motion, motion);
+            return;
+        }
+        sim->sweep_fast[sim->sweep_list[k]] = 0;
+        sim->sweep_slow_motion = fmaxf(sim->sweep_slow_motion, sim->sweep_list_motion[k]);
+    }
+
+    float r = s->radius * sim->sweep_scale;
+    vec2 end = vec2_add(s->pos, step);
+    sim->sweep_fast[i] = 1;
+    sim->sweep_list[k] = i;
+    sim->sweep_list_motion[k] = motion;
+    sim->sweep_list_lo[k] = (vec2){fminf(s->pos.x, end.x) - r, fminf(s->pos.y, end.y) - r};
+    sim->sweep_list_hi[k] = (vec2){fmaxf(s->pos.x, end.x) + r, fmaxf(s->pos.y, end.y) + r};
+}
+
+// Seeds move in index order, later ones are still where the step started
+bool _is_unmoved(const Sim2D* sim, const Seed* other, const Seed* s) {
+    return other > s && !_is_held(sim, other) && sim->sleep_state[other - sim->seeds] == SEED_AWAKE;
+}
+
+vec2 _step_motion(const Sim2D* sim, const Seed* s) {
+    return vec2_scale(vec2_add(s->vel, vec2_scale(s->acc, sim->sweep_dt)), sim->sweep_dt);
+}
+
+// Slow seeds just move, a step too short to carry them past the centre of a neighbour leaves any overlap to
+// the solver. Fast ones are swept: a hit moves the seed to the time of impact, exchanges the impulse there
+// and carries on with the rest of the step and the new velocity
+void _advance_seed(Sim2D* sim, Seed* s) {
+    float threshold = CCD_MOTION_FRACTION * s->radius * sim->sweep_scale;
+    float elapsed = 0.0f;  // fraction of the step already covered
+
+    for (int hits = 0;; hits++) {
+        vec2 motion = vec2_scale(s->vel, (1.0f - elapsed) * sim->sweep_dt);
+        if (vec2_sqr_mag(motion) <= threshold * threshold) {
+            s->pos = vec2_add(s->pos, motion);
+            return;
+        }
+
+        Seed* other = NULL;
+        float t = _sweep_seed(sim, s, motion, elapsed, &other);
+        s->pos = vec2_add(s->pos, vec2_scale(motion, t));
+        if (other == NULL || hits == CCD_MAX_HITS) return;
+
+        elapsed += (1.0f - elapsed) * t;
+        vec2 other_pos = other->pos;
+        if (_is_unmoved(sim, other, s)) other_pos = vec2_add(other_pos, vec2_scale(_step_motion(sim, other), elapsed));
+
+        // Dragged and sleeping seeds do not give way, like a dragged seed in the voronoi solver
+        bool immovable = _is_held(sim, other) || sim->sleep_state[other - sim->seeds] != SEED_AWAKE;
+        vec2 other_vel = other->vel;
+        collision_sim_1(s->pos, other_pos, s->radius, immovable ? INT_MAX : other->radius, &s->vel,
+                        immovable ? &other_vel : &other->vel);
+        _queue_wake(sim, other - sim->seeds);
+        if (_is_unmoved(sim, other, s)) _classify_sweep(sim, other - sim->seeds);
+
+        sim->counters.pairs_colliding++;
+    }
+}
+
+// Time of impact as a fraction of the motion, 1 when the swept circle touches nothing. The broad phase walks
+// the grid cells under the swept box grown by the longest slow move of the step, fast seeds that have not
+// moved yet are skipped there and tested from the fast list when their own swept box overlaps this one
+float _sweep_seed(Sim2D* sim, Seed* s, vec2 motion, float elapsed, Seed** hit) {
+    // Stop a hair before contact so the impulse and the next sweep see the pair apart
+    const float skin = 1e-3f;
+
+    vec2 end = vec2_add(s->pos, motion);
+    vec2 lo = {fminf(s->pos.x, end.x), fminf(s->pos.y, end.y)};
+    vec2 hi = {fmaxf(s->pos.x, end.x), fmaxf(s->pos.y, end.y)};
+    float reach = (s->radius + sim->sweep_max_radius) * sim->sweep_scale + sim->sweep_slow_motion;
+    int min_x = (int)floorf((lo.x - reach) / sim->grid_size);
+    int min_y = (int)floorf((lo.y - reach) / sim->grid_size);
+    int max_x = (int)floorf((hi.x + reach) / sim->grid_size);
+    int max_y = (int)floorf((hi.y + reach) / sim->grid_size);
+
+    if (++sim->bucket_query == 0) {
+        memset(sim->bucket_visits, 0, sizeof(sim->bucket_visits));
+        sim->bucket_query = 1;
+    }
+
+    float best = 1.0f;
+    *hit = NULL;
+
+    for (int x = min_x; x <= max_x; x++) {
+        for (int y = min_y; y <= max_y; y++) {
+            size_t idx = _hash_cell(x, y);
+            if (sim->bucket_visits[idx] == sim->bucket_query) continue;
+            sim->bucket_visits[idx] = sim->bucket_query;
+
+            for (Bucket* b = sim->pos_map[idx]; b != NULL; b = b->next) {
+                Seed* other = b->seed;
+                if (sim->sweep_fast[other - sim->seeds] && _is_unmoved(sim, other, s)) continue;
+
+                float t = _time_of_impact(sim, s, other, motion, elapsed);
+                if (t < best) {
+                    best = t;
+                    *hit = other;
+                }
+            }
+        }
+    }
+
+    // Box of its own move against the box of this one
+    float r = s->radius * sim->sweep_scale;
+    for (size_t k = 0; k < sim->sweep_list_count; k++) {
+        if (sim->sweep_list_lo[k].x > hi.x + r || sim->sweep_list_hi[k].x < lo.x - r ||
+            sim->sweep_list_lo[k].y > hi.y + r || sim->sweep_list_hi[k].y < lo.y - r) {
+            continue;
+        }
+
+        Seed* other = &sim->seeds[sim->sweep_list[k]];
+        if (!_is_unmoved(sim, other, s)) continue;
+
+        float t = _time_of_impact(sim, s, other, motion, elapsed);
+        if (t < best) {
+            best = t;
+            *hit = other;
+        }
+    }
+
+    return *hit != NULL ? fmaxf(best - skin, 0.0f) : 1.0f;
+}
+
+// Solves |p + d * t| = r1 + r2 on the motion relative to a neighbour that has not moved yet, the others stay
+// put. Larger than 1 when they do not meet. Pairs overlapping already are the solver's, sweeping them would
+// pin the seed in place
+float _time_of_impact(Sim2D* sim, const Seed* s, const Seed* other, vec2 motion, float elapsed) {
+    sim->counters.pairs_tested++;
+
+    vec2 other_pos = other->pos;
+    vec2 d = motion;
+    if (_is_unmoved(sim, other, s)) {
+        vec2 other_motion = _step_motion(sim, other);
+        other_pos = vec2_add(other_pos, vec2_scale(other_motion, elapsed));
+        d = vec2_sub(d, vec2_scale(other_motion, 1.0f - elapsed));
+    }
+
+    vec2 p = vec2_sub(s->pos, other_pos);
+    float r = (s->radius + other->radius) * sim->sweep_scale;
+    float a = vec2_dot(d, d);
+    float half_b = vec2_dot(p, d);
+    float c = vec2_dot(p, p) - r * r;
+    if (c <= 0.0f || half_b >= 0.0f) return FLT_MAX;
+
+    float disc = half_b * half_b - a * c;
+    if (disc < 0.0f) return FLT_MAX;
+
+    return (-half_b - sqrtf(disc)) / a;
+}
+
+// Integrating pushes touching seeds into each other by up to a step of their motion, which grows as there are
+// fewer substeps. One pass that only moves overlapping pairs apart keeps four substeps as tight as ten were,
+// velocities are left to the next solve. Dragged seeds stay put like in the solver
+void _separate_overlaps(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s1 = &sim->seeds[i];
+        bool c1 = _is_held(sim, s1);
+
+        size_t cand_count = 0;
+        _find_collisions(sim, s1, s1->radius + sim->seed_max_radius, sim->candidates, &cand_count);
+        for (size_t j = 0; j < cand_count; j++) {
+            Seed* s2 = sim->candidates[j];
+            if (s2 <= s1) continue;
+
+            bool c2 = _is_held(sim, s2);
+            float radii_sum = s1->radius + s2->radius;
+            float sqr_dist = vec2_sqr_dist(s1->pos, s2->pos);
+            if ((c1 && c2) || sqr_dist >= radii_sum * radii_sum || sqr_dist == 0.0f) continue;
+
+            float dist = sqrtf(sqr_dist);
+            vec2 push = vec2_scale(vec2_sub(s1->pos, s2->pos), (radii_sum - dist) / dist);
+            float share = c1 ? 0.0f : c2 ? 1.0f : 0.5f;
+            s1->pos = vec2_add(s1->pos, vec2_scale(push, share));
+            s2->pos = vec2_sub(s2->pos, vec2_scale(push, 1.0f - share));
+            _map_move(sim, s2);
+        }
+        _map_move(sim, s1);
+    }
+}
+
+float _max_seed_radius(const Sim2D* sim) {
+    int max_radius = 0;
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->seeds[i].radius > max_radius) max_radius = sim->seeds[i].radius;
+    }
+    return max_radius;
+}
+
+void _reset_speed_bound(Sim2D* sim) {
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        sim->worker_max_sqr_speed[w] = 0.0f;
+        sim->worker_min_radius[w] = FLT_MAX;
+    }
+}
+
+// A worker may get several ranges of one pass, its slot keeps the extremes over all of them
+void _store_speed_bound(Sim2D* sim, size_t worker, float max_sqr_speed, float min_radius) {
+    sim->worker_max_sqr_speed[worker] = fmaxf(sim->worker_max_sqr_speed[worker], max_sqr_speed);
+    sim->worker_min_radius[worker] = fminf(sim->worker_min_radius[worker], min_radius);
+}
+
+// Steps that integrate nothing, all asleep or a position based step with a zero step, leave a bound of 0
+void _reduce_speed_bound(Sim2D* sim) {
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        max_sqr_speed = fmaxf(max_sqr_speed, sim->worker_max_sqr_speed[w]);
+        min_radius = fminf(min_radius, sim->worker_min_radius[w]);
+    }
+    sim->step_max_speed = sqrtf(max_sqr_speed);
+    sim->step_min_radius = min_radius;
+    sim->has_speed_bound = true;
+}
+
+void _wake_all(Sim2D* sim) {
+    memset(sim->sleep_state, SEED_AWAKE, sizeof(uint8_t) * sim->seed_count);
+    memset(sim->sleep_timers, 0, sizeof(float) * sim->seed_count);
+    sim->wake_count = 0;
+    sim->sleeping_count = 0;
+}
+
+void _queue_wake(Sim2D* sim, uint32_t i) {
+    if (sim->sleep_state[i] != SEED_ASLEEP) return;
+
+    sim->sleep_state[i] = SEED_WAKING;
+    sim->wake_queue[sim->wake_count++] = i;
+}
+
+// Path halving, islands are rebuilt every step so the trees never get deep
+uint32_t _find_island(Sim2D* sim, uint32_t i) {
+    while (sim->island_parent[i] != i) {
+        sim->island_parent[i] = sim->island_parent[sim->island_parent[i]];
+        i = sim->island_parent[i];
+    }
+    return i;
+}
+
+// Touching awake seeds join one island. An awake seed moving into a sleeping one wakes it, a resting one
+// just leans on it and may fall asleep on top of it
+void _link_contact(Sim2D* sim, uint32_t a, uint32_t b) {
+    bool a_awake = sim->sleep_state[a] == SEED_AWAKE;
+    bool b_awake = sim->sleep_state[b] == SEED_AWAKE;
+
+    if (a_awake && b_awake) {
+        uint32_t ra = _find_island(sim, a);
+        uint32_t rb = _find_island(sim, b);
+        if (ra != rb) sim->island_parent[ra > rb ? ra : rb] = ra < rb ? ra : rb;
+    } else if (a_awake || b_awake) {
+        uint32_t awake = a_awake ? a : b;
+        if (vec2_sqr_mag(sim->seeds[awake].vel) >= SLEEP_SPEED * SLEEP_SPEED) _queue_wake(sim, a_awake ? b : a);
+    }
+}
+
+void _begin_islands(Sim2D* sim) {
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        sim->island_parent[i] = i;
+    }
+}
+
+// Waking spreads to every sleeping seed touching a woken one, the sleeping ones have not moved since
+// they fell asleep so the spatial map still holds them where they are
+void _wake_queued(Sim2D* sim, float contact_scale) {
+    if (sim->wake_count == 0) return;
+    TRACE_ZONE(__func__);
+
+    float max_radius = sim->seed_max_radius;
+
+    for (size_t q = 0; q < sim->wake_count; q++) {
+        uint32_t i = sim->wake_queue[q];
+        Seed* s1 = &sim->seeds[i];
+        sim->sleep_state[i] = SEED_AWAKE;
+        sim->sleep_timers[i] = 0.0f;
+        sim->sleeping_count--;
+
+        size_t cand_count = 0;
+        float reach = (s1->radius + max_radius) * contact_scale * SLEEP_CONTACT_SLOP;
+        _find_collisions(sim, s1, reach, sim->candidates, &cand_count);
+
+        for (size_t j = 0; j < cand_count; j++) {
+            Seed* s2 = sim->candidates[j];
+            float touch_dist = (s1->radius + s2->radius) * contact_scale * SLEEP_CONTACT_SLOP;
+            if (vec2_dist(s1->pos, s2->pos) < touch_dist) _queue_wake(sim, s2 - sim->seeds);
+        }
+    }
+    sim->wake_count = 0;
+}
+
+// An island falls asleep once its least rested seed has been resting for SLEEP_TIME
+void _update_sleep(Sim2D* sim, double dt, float contact_scale) {
+    TRACE_ZONE(__func__);
+
+    _wake_queued(sim, contact_scale);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
+
+        bool resting = vec2_sqr_mag(sim->seeds[i].vel) < SLEEP_SPEED * SLEEP_SPEED;
+        sim->sleep_timers[i] = resting ? sim->sleep_timers[i] + (float)dt : 0.0f;
+        sim->island_rest[i] = INFINITY;
+    }
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
+
+        uint32_t root = _find_island(sim, i);
+        sim->island_rest[root] = fminf(sim->island_rest[root], sim->sleep_timers[i]);
+    }
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (sim->sleep_state[i] != SEED_AWAKE || sim->island_rest[_find_island(sim, i)] < SLEEP_TIME) continue;
+
+        sim->sleep_state[i] = SEED_ASLEEP;
+        sim->seeds[i].vel = (vec2){0.0f, 0.0f};
+        sim->seeds[i].acc = (vec2){0.0f, 0.0f};
+        sim->sleeping_count++;
+    }
+}
+
+void _reserve_constraints(Sim2D* sim, ConstraintSet* set, size_t capacity) {
+    set->count = 0;
+    if (capacity <= set->capacity) return;
+
+    set->items = arena_alloc(&sim->arena, sizeof(Spring) * capacity);
+    set->adj = arena_alloc(&sim->arena, sizeof(uint32_t) * capacity * 2);
+    set->corr = arena_alloc(&sim->arena, sizeof(vec2) * capacity);
+    if (set->offsets == NULL) {
+        set->offsets = arena_alloc(&sim->arena, sizeof(uint32_t) * (sim->seed_count + 1));
+    }
+    set->capacity = capacity;
+}
+
+void _add_constraint(ConstraintSet* set, uint32_t p0, uint32_t p1, float k, float rest_len) {
+    assert(set->count < set->capacity);
+
+    Spring* sp = &set->items[set->count++];
+    sp->k = k;
+    sp->rest_len = rest_len;
+    sp->p0 = p0 < p1 ? p0 : p1;
+    sp->p1 = p0 < p1 ? p1 : p0;
+}
+
+void _add_spring(Sim2D* sim, uint32_t p0, uint32_t p1, float k) {
+    _add_constraint(&sim->spring_set, p0, p1, k, vec2_dist(sim->seeds[p0].pos, sim->seeds[p1].pos));
+}
+
+int _compare_springs(const void* a, const void* b) {
+    const Spring* s1 = a;
+    const Spring* s2 = b;
+    if (s1->p0 != s2->p0) return s1->p0 < s2->p0 ? -1 : 1;
+    if (s1->p1 != s2->p1) return s1->p1 < s2->p1 ? -1 : 1;
+    return 0;
+}
+
+// Build the per-seed adjacency the gather pass walks, items are expected to be sorted by p0
+void _finalize_constraints(const Sim2D* sim, ConstraintSet* set) {
+    uint32_t* offsets = set->offsets;
+
+    for (size_t i = 0; i <= sim->seed_count; i++) {
+        offsets[i] = 0;
+    }
+    for (size_t i = 0; i < set->count; i++) {
+        offsets[set->items[i].p0 + 1]++;
+        offsets[set->items[i].p1 + 1]++;
+    }
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        offsets[i + 1] += offsets[i];
+    }
+
+    // Fill using the offsets as write cursors, then shift them back to the range starts
+    for (size_t i = 0; i < set->count; i++) {
+        set->adj[offsets[set->items[i].p0]++] = i;
+        set->adj[offsets[set->items[i].p1]++] = i;
+    }
+    for (size_t i = sim->seed_count; i > 0; i--) {
+        offsets[i] = offsets[i - 1];
+    }
+    offsets[0] = 0;
+}
+
+void _finalize_springs(Sim2D* sim) {
+    qsort(sim->spring_set.items, sim->spring_set.count, sizeof(Spring), _compare_springs);
+    _finalize_constraints(sim, &sim->spring_set);
+
+    if (!sim->config.quiet) {
+        printf("[INFO]: %zu springs between %zu seeds\n", sim->spring_set.count, sim->seed_count);
+    }
+}
+
+// Tie every seed to a few of its current neighbours, used when switching into springs mode
+void _link_springs(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    _reserve_constraints(sim, &sim->spring_set, sim->seed_count * SPRING_MAX_LINKS);
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s1 = &sim->seeds[i];
+        sim->inv_mass[i] = 1.0f;
+
+        size_t cand_count = 0;
+        size_t links = 0;
+        _find_collisions(sim, s1, 2.5f * s1->radius, sim->candidates, &cand_count);
+
+        for (size_t j = 0; j < cand_count && links < SPRING_MAX_LINKS; j++) {
+            Seed* s2 = sim->candidates[j];
+            if (s2 <= s1) continue;
+            if (vec2_dist(s1->pos, s2->pos) > 1.25f * (s1->radius + s2->radius)) continue;
+
+            _add_spring(sim, i, s2 - sim->seeds, SPRING_STIFFNESS);
+            links++;
+        }
+    }
+
+    _finalize_springs(sim);
+}
+
+// Contacts are rigid constraints that only push apart, emitted in seed order so they come out sorted by p0,
+// apart from those with a sleeping seed: sleeping seeds do not query, their contacts come from the awake side.
+// With keep_prev_overlap a contact never pushes further than the distance at the start of the step,
+// overlap older than the step is left to pre-stabilization so it does not turn into velocity
+void _generate_contacts(Sim2D* sim, float scale, bool keep_prev_overlap) {
+    TRACE_ZONE(__func__);
+
+    ConstraintSet* set = &sim->contact_set;
+    set->count = 0;
+
+    float max_radius = sim->seed_max_radius;
+
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        Seed* s1 = &sim->seeds[i];
+        if (sim->sleep_state[i] != SEED_AWAKE) continue;
+
+        size_t cand_count = 0;
+        _find_collisions(sim, s1, (s1->radius + max_radius) * scale, sim->candidates, &cand_count);
+        sim->counters.pairs_tested += cand_count;
+
+        for (size_t j = 0; j < cand_count && set->count < set->capacity; j++) {
+            Seed* s2 = sim->candidates[j];
+            size_t k = s2 - sim->seeds;
+            if (s2 <= s1 && sim->sleep_state[k] == SEED_AWAKE) continue;
+
+            float rest_len = (s1->radius + s2->radius) * scale;
+            if (vec2_sqr_dist(s1->pos, s2->pos) >= rest_len * rest_len) continue;
+            if (keep_prev_overlap) rest_len = fminf(rest_len, vec2_dist(sim->prev_pos[i], sim->prev_pos[k]));
+
+            // Normal velocity before projection, the restitution pass restores it afterwards
+            vec2 n = vec2_sub(s2->pos, s1->pos);
+            float len = vec2_mag(n);
+            sim->contact_vn[set->count] = len > 0.0f ? vec2_dot(vec2_sub(s2->vel, s1->vel), n) / len : 0.0f;
+
+            _add_constraint(set, i, k, 0.0f, rest_len);
+        }
+    }
+
+    sim->counters.pairs_colliding += set->count;
+    _finalize_constraints(sim, set);
+}
+
+// Dragged and sleeping seeds are immovable
+float _pbd_inv_mass(const Sim2D* sim, size_t i) {
+    return _is_held(sim, &sim->seeds[i]) || sim->sleep_state[i] != SEED_AWAKE ? 0.0f : sim->inv_mass[i];
+}
+
+// Jacobi pass 1: every constraint computes its XPBD correction from the current positions
+void _constraint_corrections(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+    ConstraintSet* set = sim->pbd_set;
+
+    float dt2 = (float)(sim->pbd_dt * sim->pbd_dt);
+    for (size_t i = begin; i < end; i++) {
+        Spring* sp = &set->items[i];
+        vec2 d = vec2_sub(sim->seeds[sp->p1].pos, sim->seeds[sp->p0].pos);
+        float len = vec2_mag(d);
+        float w = _pbd_inv_mass(sim, sp->p0) + _pbd_inv_mass(sim, sp->p1);
+
+        if (w == 0.0f || (set->unilateral && len >= sp->rest_len)) {
+            set->corr[i] = (vec2){0.0f, 0.0f};
+            continue;
+        }
+
+        // Coincident seeds still need a direction to separate along
+        vec2 n = len > 1e-6f ? vec2_scale(d, 1.0f / len) : (vec2){1.0f, 0.0f};
+        float alpha = sp->k > 0.0f ? 1.0f / (sp->k * dt2) : 0.0f;
+        float dlambda = -(len - sp->rest_len) / (w + alpha);
+        set->corr[i] = vec2_scale(n, dlambda);
+    }
+}
+
+// Jacobi pass 2: every seed averages the corrections of its own constraints, no two threads write the same seed
+void _constraint_gather(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+    ConstraintSet* set = sim->pbd_set;
+
+    for (size_t i = begin; i < end; i++) {
+        uint32_t first = set->offsets[i];
+        uint32_t last = set->offsets[i + 1];
+        float w = _pbd_inv_mass(sim, i);
+        if (first == last || w == 0.0f) continue;
+
+        vec2 sum = {0.0f, 0.0f};
+        for (uint32_t k = first; k < last; k++) {
+            uint32_t c = set->adj[k];
+            float sign = set->items[c].p0 == i ? -1.0f : 1.0f;
+            sum = vec2_add(sum, vec2_scale(set->corr[c], sign));
+        }
+
+        float scale = w * set->relaxation / (float)(last - first);
+        sim->seeds[i].pos = vec2_add(sim->seeds[i].pos, vec2_scale(sum, scale));
+    }
+}
+
+void _project_constraints(Sim2D* sim, ConstraintSet* set) {
+    TRACE_ZONE(__func__);
+
+    sim->pbd_set = set;
+    parallel_for(set->count, _constraint_corrections, sim);
+    parallel_for(sim->seed_count, _constraint_gather, sim);
+}
+
+void _predict_positions(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    float dt = (float)sim->pbd_dt;
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        sim->prev_pos[i] = s->pos;
+        if (_pbd_inv_mass(sim, i) == 0.0f) continue;
+
+        s->vel = vec2_scale(vec2_add(s->vel, vec2_scale(s->acc, dt)), sim->pbd_damping);
+        s->pos = vec2_add(s->pos, vec2_scale(s->vel, dt));
+    }
+}
+
+void _update_velocities(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    float dt = (float)sim->pbd_dt;
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        s->acc = (vec2){0.0f, 0.0f};
+        if (_is_held(sim, s)) continue;
+
+        if (sim->pbd_clamp) {
+            s->pos.x = fminf(fmaxf(s->pos.x, 0.0f), sim->pbd_bounds.x);
+            s->pos.y = fminf(fmaxf(s->pos.y, 0.0f), sim->pbd_bounds.y);
+        }
+        s->vel = vec2_scale(vec2_sub(s->pos, sim->prev_pos[i]), 1.0f / dt);
+
+        max_sqr_speed = fmaxf(max_sqr_speed, vec2_sqr_mag(s->vel));
+        min_radius = fminf(min_radius, (float)s->radius);
+    }
+    _store_speed_bound(sim, worker, max_sqr_speed, min_radius);
+}
+
+// Velocity a contact gets from pushing seeds apart is not physical, reset every contact's normal velocity
+// to the reflected pre-step one when approaching, or to the unchanged pre-step one when already separating
+void _apply_restitution(Sim2D* sim, float restitution) {
+    TRACE_ZONE(__func__);
+
+    ConstraintSet* set = &sim->contact_set;
+
+    for (size_t i = 0; i < set->count; i++) {
+        Spring* c = &set->items[i];
+        Seed* s1 = &sim->seeds[c->p0];
+        Seed* s2 = &sim->seeds[c->p1];
+        float w1 = _pbd_inv_mass(sim, c->p0);
+        float w2 = _pbd_inv_mass(sim, c->p1);
+        if (w1 + w2 == 0.0f) continue;
+
+        vec2 n = vec2_sub(s2->pos, s1->pos);
+        float len = vec2_mag(n);
+        if (len < 1e-6f) continue;
+        n = vec2_scale(n, 1.0f / len);
+
+        float vn = vec2_dot(vec2_sub(s2->vel, s1->vel), n);
+        float target = sim->contact_vn[i] < 0.0f ? -restitution * sim->contact_vn[i] : sim->contact_vn[i];
+        float dv = target - vn;
+
+        s1->vel = vec2_sub(s1->vel, vec2_scale(n, dv * w1 / (w1 + w2)));
+        s2->vel = vec2_add(s2->vel, vec2_scale(n, dv * w2 / (w1 + w2)));
+    }
+}
+
+// Without clamping the walls are left to _apply_constraints, clamping would stack seeds in the corners
+void _begin_pbd_step(Sim2D* sim, double dt, float damping, bool clamp, int width, int height) {
+    sim->pbd_dt = dt;
+    sim->pbd_damping = damping;
+    sim->pbd_clamp = clamp;
+    sim->pbd_bounds = (vec2){(float)width, (float)height};
+
+    parallel_for(sim->seed_count, _predict_positions, sim);
+}
+
+void _end_pbd_step(Sim2D* sim) {
+    parallel_for(sim->seed_count, _update_velocities, sim);
+    sim->map_synced = false;
+}
+
+// Position based alternative to the impulse path: predict, project contacts in Jacobi batches, derive velocities
+void _step_verlet(Sim2D* sim, double dt, float contact_scale, float restitution, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    // Pre-stabilization: resolve overlap left from earlier steps before the previous positions are
+    // recorded, so pushing seeds apart does not turn into velocity
+    _sync_map(sim);
+    _generate_contacts(sim, contact_scale, false);
+    _project_constraints(sim, &sim->contact_set);
+
+    _begin_pbd_step(sim, dt, 1.0f, false, width, height);
+
+    _sync_map(sim);
+    _generate_contacts(sim, contact_scale, true);
+    for (int i = 0; i < VERLET_ITERATIONS; i++) {
+        _project_constraints(sim, &sim->contact_set);
+    }
+
+    _end_pbd_step(sim);
+    _apply_restitution(sim, restitution);
+    _collide_obstacles(sim, false);
+}
+
+void _solve_collisions_springs(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (int i = 0; i < SPRING_ITERATIONS; i++) {
+        _project_constraints(sim, &sim->spring_set);
+    }
+}
+
+// Picks query the spatial map around the cursor instead of testing every seed. Modes that do not keep the map in
+// sync rebuild it once when the button goes down
+void _check_drag(Sim2D* sim, double dt) {
+    TRACE_ZONE(__func__);
+
+    if (!sim->has_input) return;
+
+    vec2 cur_mouse_pos = sim->input.cursor;
+
+    bool is_pressed = sim->input.drag || sim->input.lasso;
+    if (is_pressed && !sim->was_pressed && !sim->map_synced) _sync_map(sim);
+    sim->was_pressed = is_pressed;
+
+    if (sim->input.lasso) {
+        _extend_lasso(sim, cur_mouse_pos);
+    } else if (sim->lasso_count > 0) {
+        _select_lasso(sim);
+        sim->lasso_count = 0;
+    }
+
+    if (sim->input.drag) {
+        if (sim->drag_seed == NULL && !sim->is_group_drag) {
+            Seed* picked = _pick_seed(sim, cur_mouse_pos);
+            if (picked != NULL && sim->selection_mask[picked - sim->seeds]) {
+                sim->is_group_drag = true;
+                for (size_t i = 0; i < sim->selection_count; i++) {
+                    sim->selection_offsets[i] = vec2_sub(sim->seeds[sim->selection[i]].pos, cur_mouse_pos);
+                }
+            } else {
+                sim->drag_seed = picked;
+            }
+        }
+
+        vec2 delta_cursor = vec2_sub(cur_mouse_pos, sim->last_mouse_pos);
+        vec2 vel = dt > 0.0 ? vec2_scale(delta_cursor, 1 / (dt * 2.0f)) : (vec2){0.0f, 0.0f};
+
+        if (sim->is_group_drag) {
+            for (size_t i = 0; i < sim->selection_count; i++) {
+                vec2 pos = vec2_add(cur_mouse_pos, sim->selection_offsets[i]);
+                _move_seed(sim, &sim->seeds[sim->selection[i]], pos, vel);
+            }
+        } else if (sim->drag_seed != NULL) {
+            _move_seed(sim, sim->drag_seed, cur_mouse_pos, vel);
+        }
+    } else {
+        sim->drag_seed = NULL;
+        sim->is_group_drag = false;
+    }
+    sim->last_mouse_pos = cur_mouse_pos;
+}
+
+// Seeds under the cursor are moved by it, the solvers treat them as they always treated the dragged seed
+bool _is_held(const Sim2D* sim, const Seed* s) {
+    return s == sim->drag_seed || (sim->is_group_drag && sim->selection_mask[s - sim->seeds]);
+}
+
+// Nearest seed whose disc holds the point, NULL over empty space
+Seed* _pick_seed(Sim2D* sim, vec2 pos) {
+    Seed probe = {.pos = pos};
+    size_t cand_count = 0;
+    _find_collisions(sim, &probe, sim->seed_max_radius, sim->candidates, &cand_count);
+
+    Seed* picked = NULL;
+    float best = INFINITY;
+    for (size_t i = 0; i < cand_count; i++) {
+        float dist = vec2_dist(sim->candidates[i]->pos, pos);
+        if (dist < sim->candidates[i]->radius && dist < best) {
+            picked = sim->candidates[i];
+            best = dist;
+        }
+    }
+    return picked;
+}
+
+void _move_seed(Sim2D* sim, Seed* s, vec2 pos, vec2 vel) {
+    if (!sim->map_synced) {
+        s->pos = pos;
+    } else {
+        _map_remove(sim, s);
+        s->pos = pos;
+        _map_insert(sim, s);
+    }
+    s->vel = vel;
+}
+
+void _extend_lasso(Sim2D* sim, vec2 pos) {
+    if (sim->lasso_count == LASSO_MAX_POINTS) return;
+    if (sim->lasso_count > 0 && vec2_dist(sim->lasso_points[sim->lasso_count - 1], pos) < LASSO_SPACING) return;
+    sim->lasso_points[sim->lasso_count++] = pos;
+}
+
+// Even-odd rule, the lasso closes from its last point back to the first
+bool _in_lasso(const Sim2D* sim, vec2 pos) {
+    bool inside = false;
+    for (size_t i = 0, j = sim->lasso_count - 1; i < sim->lasso_count; j = i++) {
+        vec2 a = sim->lasso_points[i];
+        vec2 b = sim->lasso_points[j];
+        if ((a.y > pos.y) != (b.y > pos.y) && pos.x < a.x + (pos.y - a.y) * (b.x - a.x) / (b.y - a.y)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+// Only the cells under the bounds of the lasso are visited, a new lasso replaces the selection
+void _select_lasso(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    clear_selection(sim);
+    if (sim->lasso_count < 3) return;
+
+    vec2 lo = sim->lasso_points[0];
+    vec2 hi = sim->lasso_points[0];
+    for (size_t i = 1; i < sim->lasso_count; i++) {
+        lo.x = fminf(lo.x, sim->lasso_points[i].x);
+        lo.y = fminf(lo.y, sim->lasso_points[i].y);
+        hi.x = fmaxf(hi.x, sim->lasso_points[i].x);
+        hi.y = fmaxf(hi.y, sim->lasso_points[i].y);
+    }
+
+    if (++sim->bucket_query == 0) {
+        memset(sim->bucket_visits, 0, sizeof(sim->bucket_visits));
+        sim->bucket_query = 1;
+    }
+    int min_x = (int)floorf(lo.x / sim->grid_size);
+    int min_y = (int)floorf(lo.y / sim->grid_size);
+    int max_x = (int)floorf(hi.x / sim->grid_size);
+    int max_y = (int)floorf(hi.y / sim->grid_size);
+
+    for (int x = min_x; x <= max_x; x++) {
+        for (int y = min_y; y <= max_y; y++) {
+            size_t idx = _hash_cell(x, y);
+            if (sim->bucket_visits[idx] == sim->bucket_query) continue;
+            sim->bucket_visits[idx] = sim->bucket_query;
+
+            for (Bucket* b = sim->pos_map[idx]; b != NULL; b = b->next) {
+                if (!_in_lasso(sim, b->seed->pos)) continue;
+                size_t i = b->seed - sim->seeds;
+                sim->selection_mask[i] = 1;
+                sim->selection[sim->selection_count++] = i;
+            }
+        }
+    }
+}
+
+// Seeds are generated in parallel, each from its own stream, and inserted into the map in order afterwards.
+// The result only depends on the random seed, not on the thread count
+void _generate_voronoi_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    vec2 center = {sim->config.world_width / 2, sim->config.world_height / 2};
+
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        Rng rng = rng_stream(&sim->rng, i);
+
+        s->radius = sim->config.seed_radius;
+
+        _generate_seed_pos(&rng, s, center);
+        _generate_seed_color(&rng, s);
+        _generate_seed_dynamics(&rng, s, (vec2){0.0f, 0.0f}, lerpf(100, 300, rand_float(&rng)));
+    }
+}
+
+void _generate_bubbles_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    vec2 center = {sim->config.world_width / 2, sim->config.world_height / 2};
+
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        Rng rng = rng_stream(&sim->rng, i);
+
+        s->radius = rand_float(&rng) * (SEED_MAX_RADIUS - SEED_MIN_RADIUS + 20) + SEED_MIN_RADIUS + 20;
+
+        _generate_seed_pos(&rng, s, center);
+        _generate_seed_color(&rng, s);
+        _generate_seed_dynamics(&rng, s, GRAVITY, lerpf(100, 150, rand_float(&rng)));
+    }
+}
+
+// Regular lattice with structural and shear springs, the top row is pinned like a curtain rod
+void _springs_lattice(const Sim2D* sim, size_t* cols, float* spacing, vec2* origin) {
+    *cols = (size_t)ceilf(sqrtf(sim->seed_count * 16.0f / 9.0f));
+    size_t rows = (sim->seed_count + *cols - 1) / *cols;
+
+    *spacing = 2.0f * sim->config.seed_radius;
+    int width = sim->config.world_width;
+    int height = sim->config.world_height;
+    if (*cols > 1) *spacing = fminf(*spacing, 0.8f * width / (*cols - 1));
+    if (rows > 1) *spacing = fminf(*spacing, 0.6f * height / (rows - 1));
+
+    *origin = (vec2){width / 2 - (*cols - 1) * *spacing / 2, height * 0.9f};
+}
+
+void _generate_springs_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    size_t cols;
+    float spacing;
+    vec2 origin;
+    _springs_lattice(sim, &cols, &spacing, &origin);
+
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        Rng rng = rng_stream(&sim->rng, i);
+        size_t r = i / cols;
+        size_t c = i % cols;
+
+        s->radius = sim->config.seed_radius;
+        s->pos = (vec2){origin.x + c * spacing, origin.y - r * spacing};
+        _generate_seed_color(&rng, s);
+        _generate_seed_dynamics(&rng, s, (vec2){0.0f, 0.0f}, 0.0f);
+
+        sim->inv_mass[i] = r == 0 ? 0.0f : 1.0f;
+    }
+}
+
+void _generate_voronoi_seeds(Sim2D* sim) {
+    parallel_for(sim->seed_count, _generate_voronoi_range, sim);
+    sim->rng.counter++;
+    _rebuild_map(sim);
+}
+
+void _generate_bubbles_seeds(Sim2D* sim) {
+    parallel_for(sim->seed_count, _generate_bubbles_range, sim);
+    sim->rng.counter++;
+    _rebuild_map(sim);
+}
+
+void _generate_springs_seeds(Sim2D* sim) {
+    parallel_for(sim->seed_count, _generate_springs_range, sim);
+    sim->rng.counter++;
+    _rebuild_map(sim);
+
+    size_t cols;
+    float spacing;
+    vec2 origin;
+    _springs_lattice(sim, &cols, &spacing, &origin);
+
+    _reserve_constraints(sim, &sim->spring_set, sim->seed_count * 4);
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        size_t c = i % cols;
+        size_t down = i + cols;
+
+        if (c + 1 < cols && i + 1 < sim->seed_count) _add_spring(sim, i, i + 1, SPRING_STIFFNESS);
+        if (down < sim->seed_count) _add_spring(sim, i, down, SPRING_STIFFNESS);
+        if (c + 1 < cols && down + 1 < sim->seed_count) _add_spring(sim, i, down + 1, SPRING_SHEAR_STIFFNESS);
+        if (c > 0 && down - 1 < sim->seed_count) _add_spring(sim, i, down - 1, SPRING_SHEAR_STIFFNESS);
+    }
+
+    _finalize_springs(sim);
+}
+
+void _step_voronoi_frame(Sim2D* sim, double dt, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    _apply_constraints(sim, width, height);
+    _check_drag(sim, dt);
+
+    if (sim->config.integrator == INTEGRATOR_VERLET && dt > 0.0) {
+        _step_verlet(sim, dt, 1.0f, 1.0f, width, height);
+        return;
+    }
+
+    double start = now_ms();
+    sim->solve_collisions(sim);
+    sim->counters.contacts_ms += now_ms() - start;
+    _update_positions(sim, dt, 1.0f);
+    _separate_overlaps(sim);
+}
+
+void _step_bubbles_frame(Sim2D* sim, double dt, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    _apply_constraints(sim, width, height);
+    _apply_gravity(sim, GRAVITY);
+
+    // Backward and zero steps leave the islands as they are
+    if (dt > 0.0) _begin_islands(sim);
+
+    if (sim->config.integrator == INTEGRATOR_VERLET && dt > 0.0) {
+        _step_verlet(sim, dt, BUBBLES_CONTACT_SCALE, BUBBLES_RESTITUTION, width, height);
+        for (size_t i = 0; i < sim->contact_set.count; i++) {
+            _link_contact(sim, sim->contact_set.items[i].p0, sim->contact_set.items[i].p1);
+        }
+    } else {
+        double start = now_ms();
+        sim->solve_collisions(sim);
+        sim->counters.contacts_ms += now_ms() - start;
+        _update_positions(sim, dt, BUBBLES_CONTACT_SCALE);
+    }
+
+    if (dt > 0.0) _update_sleep(sim, dt, BUBBLES_CONTACT_SCALE);
+}
+
+void _step_springs_frame(Sim2D* sim, double dt, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    _check_drag(sim, dt);
+
+    // Position based steps cannot run backwards or with a zero step
+    if (dt > 0.0) {
+        _apply_gravity(sim, SPRING_GRAVITY);
+        _begin_pbd_step(sim, dt, SPRING_DAMPING, true, width, height);
+        sim->solve_collisions(sim);
+        _end_pbd_step(sim);
+        _collide_obstacles(sim, false);
+    }
+}
+
+// Every seed the step integrates sits in the root cell, so a frame whose seeds spread out still gets one tree
+void _reserve_quadtree(Sim2D* sim) {
+    if (sim->quad_nodes != NULL) return;
+
+    sim->quad_node_capacity = sim->seed_count * BH_NODES_PER_SEED + BH_MAX_DEPTH + 1;
+    sim->quad_nodes = arena_alloc(&sim->arena, sizeof(QuadNode) * sim->quad_node_capacity);
+    for (int i = 0; i < 2; i++) {
+        sim->quad_keys[i] = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+        sim->quad_order[i] = arena_alloc(&sim->arena, sizeof(uint32_t) * sim->seed_count);
+    }
+    sim->quad_bodies = arena_alloc(&sim->arena, sizeof(QuadBody) * sim->seed_count);
+}
+
+void _quad_bounds_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    vec2 lo = sim->worker_lo[worker];
+    vec2 hi = sim->worker_hi[worker];
+    for (size_t i = begin; i < end; i++) {
+        vec2 p = sim->seeds[i].pos;
+        lo = (vec2){fminf(lo.x, p.x), fminf(lo.y, p.y)};
+        hi = (vec2){fmaxf(hi.x, p.x), fmaxf(hi.y, p.y)};
+    }
+    sim->worker_lo[worker] = lo;
+    sim->worker_hi[worker] = hi;
+}
+
+// Keys interleave 16 bits per axis of the position in the root cell, each tree level splits on the next 2
+void _quad_keys_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    float scale = (MORTON_CELL_MAX + 1) / sim->quad_size;
+    for (size_t i = begin; i < end; i++) {
+        vec2 p = vec2_sub(sim->seeds[i].pos, sim->quad_origin);
+        uint32_t x = (uint32_t)fminf(p.x * scale, MORTON_CELL_MAX);
+        uint32_t y = (uint32_t)fminf(p.y * scale, MORTON_CELL_MAX);
+        sim->quad_keys[0][i] = _spread_bits(x) | (_spread_bits(y) << 1);
+        sim->quad_order[0][i] = i;
+    }
+}
+
+void _quad_bodies_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    for (size_t k = begin; k < end; k++) {
+        const Seed* s = &sim->seeds[sim->quad_order[0][k]];
+        sim->quad_bodies[k] = (QuadBody){s->pos, s->radius};
+    }
+}
+
+// Where the seeds of each quadrant start, the keys of a cell share every bit above its level so the quadrants
+// follow each other in key order. Returns the number of children, 0 when the cell stays a leaf
+size_t _split_quad(const Sim2D* sim, const QuadNode* n, uint32_t bounds[5]) {
+    if (n->end - n->begin <= BH_LEAF_SIZE || sim->quad_depth == BH_MAX_DEPTH) return 0;
+
+    const uint32_t* keys = sim->quad_keys[0];
+    int shift = 2 * (BH_MAX_DEPTH - 1 - sim->quad_depth);
+    size_t children = 0;
+
+    bounds[0] = n->begin;
+    bounds[4] = n->end;
+    for (uint32_t q = 1; q < 4; q++) {
+        uint32_t lo = bounds[q - 1];
+        uint32_t hi = n->end;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            if (((keys[mid] >> shift) & 3) < q) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        bounds[q] = lo;
+    }
+    for (int q = 0; q < 4; q++) {
+        if (bounds[q + 1] > bounds[q]) children++;
+    }
+    return children;
+}
+
+void _count_quad_children(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    uint32_t bounds[5];
+    QuadNode* level = &sim->quad_nodes[sim->quad_levels[sim->quad_depth]];
+    for (size_t i = begin; i < end; i++) {
+        level[i].child_count = _split_quad(sim, &level[i], bounds);
+    }
+}
+
+void _write_quad_children(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    uint32_t bounds[5];
+    QuadNode* level = &sim->quad_nodes[sim->quad_levels[sim->quad_depth]];
+    for (size_t i = begin; i < end; i++) {
+        QuadNode* n = &level[i];
+        if (n->child_count == 0) continue;
+
+        _split_quad(sim, n, bounds);
+        QuadNode* child = &sim->quad_nodes[n->first_child];
+        for (int q = 0; q < 4; q++) {
+            if (bounds[q + 1] == bounds[q]) continue;
+            *child++ = (QuadNode){.size = n->size / 2.0f, .begin = bounds[q], .end = bounds[q + 1]};
+        }
+    }
+}
+
+// Leaves sum their seeds, inner cells their children, which sit one level deeper and are done already
+void _sum_quad_mass(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    QuadNode* level = &sim->quad_nodes[sim->quad_levels[sim->quad_depth]];
+    for (size_t i = begin; i < end; i++) {
+        QuadNode* n = &level[i];
+        float mass = 0.0f;
+        vec2 moment = {0.0f, 0.0f};
+
+        if (n->child_count == 0) {
+            for (uint32_t k = n->begin; k < n->end; k++) {
+                const QuadBody* b = &sim->quad_bodies[k];
+                mass += b->mass;
+                moment = vec2_add(moment, vec2_scale(b->pos, b->mass));
+            }
+        } else {
+            for (uint32_t c = 0; c < n->child_count; c++) {
+                const QuadNode* child = &sim->quad_nodes[n->first_child + c];
+                mass += child->mass;
+                moment = vec2_add(moment, vec2_scale(child->com, child->mass));
+            }
+        }
+
+        n->mass = mass;
+        n->com = mass > 0.0f ? vec2_scale(moment, 1.0f / mass) : moment;
+    }
+}
+
+// Seeds are sorted along a Z-order curve of the square around them, every cell is then a range of that order.
+// A level counts the children of its cells in parallel, places them after one scan and writes them in
+// parallel, so the tree only depends on the positions. Masses are summed back up the same way
+void _build_quadtree(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        sim->worker_lo[w] = (vec2){FLT_MAX, FLT_MAX};
+        sim->worker_hi[w] = (vec2){-FLT_MAX, -FLT_MAX};
+    }
+    parallel_for(sim->seed_count, _quad_bounds_range, sim);
+
+    vec2 lo = {FLT_MAX, FLT_MAX};
+    vec2 hi = {-FLT_MAX, -FLT_MAX};
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        lo = (vec2){fminf(lo.x, sim->worker_lo[w].x), fminf(lo.y, sim->worker_lo[w].y)};
+        hi = (vec2){fmaxf(hi.x, sim->worker_hi[w].x), fmaxf(hi.y, sim->worker_hi[w].y)};
+    }
+    sim->quad_origin = lo;
+    sim->quad_size = fmaxf(fmaxf(hi.x - lo.x, hi.y - lo.y), 1.0f);
+
+    parallel_for(sim->seed_count, _quad_keys_range, sim);
+    _radix_sort_keys(sim->quad_keys, sim->quad_order, sim->seed_count);
+    parallel_for(sim->seed_count, _quad_bodies_range, sim);
+
+    sim->quad_nodes[0] = (QuadNode){.size = sim->quad_size, .begin = 0, .end = sim->seed_count};
+    sim->quad_levels[0] = 0;
+    sim->quad_levels[1] = 1;
+
+    size_t depth = 0;
+    for (; depth <= BH_MAX_DEPTH; depth++) {
+        size_t level_begin = sim->quad_levels[depth];
+        size_t level_end = sim->quad_levels[depth + 1];
+        sim->quad_depth = depth;
+        parallel_for(level_end - level_begin, _count_quad_children, sim);
+
+        // Cells whose children no longer fit stay leaves, the walk then sums their seeds one by one
+        size_t next = level_end;
+        for (size_t i = level_begin; i < level_end; i++) {
+            QuadNode* n = &sim->quad_nodes[i];
+            if (next + n->child_count > sim->quad_node_capacity) n->child_count = 0;
+            n->first_child = next;
+            next += n->child_count;
+        }
+        if (next == level_end) break;
+
+        parallel_for(level_end - level_begin, _write_quad_children, sim);
+        sim->quad_levels[depth + 2] = next;
+    }
+
+    for (size_t d = depth + 1; d-- > 0;) {
+        sim->quad_depth = d;
+        parallel_for(sim->quad_levels[d + 1] - sim->quad_levels[d], _sum_quad_mass, sim);
+    }
+}
+
+// Plummer softened pull towards a mass, without the gravitational constant
+vec2 _softened_pull(vec2 from, vec2 to, float mass, float sqr_softening) {
+    vec2 d = vec2_sub(to, from);
+    float inv_dist = 1.0f / sqrtf(vec2_sqr_mag(d) + sqr_softening);
+    return vec2_scale(d, mass * inv_dist * inv_dist * inv_dist);
+}
+
+const QuadNode* _find_quad_leaf(const Sim2D* sim, uint32_t k) {
+    const QuadNode* n = &sim->quad_nodes[0];
+    while (n->child_count > 0) {
+        const QuadNode* child = &sim->quad_nodes[n->first_child];
+        while (k >= child->end) child++;
+        n = child;
+    }
+    return n;
+}
+
+// Adds the pull of the listed masses to the seeds first..last of a leaf. A seed listed itself pulls with 0
+void _flush_pulls(Sim2D* sim, const QuadBody* list, size_t count, uint32_t first, uint32_t last) {
+    float sqr_softening = sim->galaxy_softening * sim->galaxy_softening;
+
+    for (uint32_t k = first; k < last; k++) {
+        vec2 pos = sim->quad_bodies[k].pos;
+        vec2 acc = {0.0f, 0.0f};
+        for (size_t j = 0; j < count; j++) {
+            acc = vec2_add(acc, _softened_pull(pos, list[j].pos, list[j].mass, sqr_softening));
+        }
+
+        Seed* s = &sim->seeds[sim->quad_order[0][k]];
+        s->acc = vec2_add(s->acc, vec2_scale(acc, sim->galaxy_g));
+    }
+}
+
+// The seeds of a leaf share one walk: cells seen from anywhere in the box around them under an angle below
+// bh_theta pull with their whole mass from their center of mass, closer ones are opened and the seeds of the
+// leaves reached are listed one by one. Only the leaf decides the list, so any part of it gets the same pulls
+void _pull_leaf(Sim2D* sim, const QuadNode* leaf, uint32_t first, uint32_t last, size_t* interactions) {
+    vec2 lo = {FLT_MAX, FLT_MAX};
+    vec2 hi = {-FLT_MAX, -FLT_MAX};
+    for (uint32_t k = leaf->begin; k < leaf->end; k++) {
+        vec2 p = sim->quad_bodies[k].pos;
+        lo = (vec2){fminf(lo.x, p.x), fminf(lo.y, p.y)};
+        hi = (vec2){fmaxf(hi.x, p.x), fmaxf(hi.y, p.y)};
+    }
+    float sqr_theta = sim->config.bh_theta * sim->config.bh_theta;
+
+    QuadBody list[BH_LIST_SIZE];
+    size_t count = 0;
+    uint32_t stack[BH_STACK_SIZE];
+    size_t top = 0;
+    stack[top++] = 0;
+
+    while (top > 0) {
+        const QuadNode* n = &sim->quad_nodes[stack[--top]];
+        bool holds_leaf = n->begin <= leaf->begin && leaf->end <= n->end;
+
+        float dx = fmaxf(fmaxf(lo.x - n->com.x, n->com.x - hi.x), 0.0f);
+        float dy = fmaxf(fmaxf(lo.y - n->com.y, n->com.y - hi.y), 0.0f);
+        if (!holds_leaf && n->size * n->size < sqr_theta * (dx * dx + dy * dy)) {
+            if (count == BH_LIST_SIZE) {
+                _flush_pulls(sim, list, count, first, last);
+                *interactions += count * (last - first);
+                count = 0;
+            }
+            list[count++] = (QuadBody){n->com, n->mass};
+        } else if (n->child_count == 0) {
+            for (uint32_t j = n->begin; j < n->end; j++) {
+                if (count == BH_LIST_SIZE) {
+                    _flush_pulls(sim, list, count, first, last);
+                    *interactions += count * (last - first);
+                    count = 0;
+                }
+                list[count++] = sim->quad_bodies[j];
+            }
+        } else {
+            for (uint32_t c = 0; c < n->child_count; c++) {
+                stack[top++] = n->first_child + c;
+            }
+        }
+    }
+
+    _flush_pulls(sim, list, count, first, last);
+    *interactions += count * (last - first);
+}
+
+// Seeds are walked in key order one leaf at a time, a leaf split between two workers is walked by both
+void _quad_gravity_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    size_t interactions = 0;
+    for (uint32_t k = begin; k < end;) {
+        const QuadNode* leaf = _find_quad_leaf(sim, k);
+        uint32_t last = leaf->end < end ? leaf->end : end;
+        _pull_leaf(sim, leaf, k, last, &interactions);
+        k = last;
+    }
+    sim->worker_pairs_tested[worker] += interactions;
+}
 
-        _map_insert(s);
+// Galaxy seeds never collide, the solver computes the pull of every seed on every other instead. Each pull
+// counts as a tested pair
+void _solve_gravity_galaxy(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    if (sim->seed_count < 2) return;
+    _reserve_quadtree(sim);
+    _build_quadtree(sim);
+
+    memset(sim->worker_pairs_tested, 0, sizeof(sim->worker_pairs_tested));
+    parallel_for(sim->seed_count, _quad_gravity_range, sim);
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        sim->counters.pairs_tested += sim->worker_pairs_tested[w];
+    }
+}
+
+void _integrate_galaxy_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    float dt = (float)sim->galaxy_dt;
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        if (!_is_held(sim, s)) {
+            s->vel = vec2_add(s->vel, vec2_scale(s->acc, dt));
+            s->pos = vec2_add(s->pos, vec2_scale(s->vel, dt));
+
+            max_sqr_speed = fmaxf(max_sqr_speed, vec2_sqr_mag(s->vel));
+            min_radius = fminf(min_radius, (float)s->radius);
+        }
+        s->acc = (vec2){0.0f, 0.0f};
+    }
+    _store_speed_bound(sim, worker, max_sqr_speed, min_radius);
+}
+
+// Uniform disc turning as a whole, fast enough at every radius to balance the pull of the mass inside it
+void _generate_galaxy_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    vec2 center = {sim->config.world_width / 2, sim->config.world_height / 2};
+    float disc_radius = GALAXY_DISC_FRACTION * fminf(sim->config.world_width, sim->config.world_height);
+    float omega = 2.0f * M_PI / GALAXY_PERIOD;
+
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        Rng rng = rng_stream(&sim->rng, i);
+
+        float r = disc_radius * sqrtf(rand_float(&rng));
+        float angle = rand_float(&rng) * 2.0f * M_PI;
+        vec2 offset = {r * cosf(angle), r * sinf(angle)};
+
+        s->radius = sim->config.seed_radius;
+        s->pos = vec2_add(center, offset);
+        s->vel = (vec2){-omega * offset.y, omega * offset.x};
+        s->acc = (vec2){0.0f, 0.0f};
+        _generate_seed_color(&rng, s);
+    }
+}
+
+void _generate_galaxy_seeds(Sim2D* sim) {
+    parallel_for(sim->seed_count, _generate_galaxy_range, sim);
+    sim->rng.counter++;
+    _rebuild_map(sim);
+}
+
+// Kick and drift, the walls still bounce seeds back. Nothing moves through the spatial map, it is synced
+// when a drag or lasso starts or a region of it is drawn
+void _step_galaxy_frame(Sim2D* sim, double dt, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    _apply_constraints(sim, width, height);
+    _check_drag(sim, dt);
+
+    sim->solve_collisions(sim);
+    sim->galaxy_dt = dt;
+    parallel_for(sim->seed_count, _integrate_galaxy_range, sim);
+    sim->map_synced = false;
+    _collide_obstacles(sim, true);
+}
+
+// Spacing of the generated block, as wide as the seed diameter unless that would not fit the world
+float _fluid_spacing(const Sim2D* sim) {
+    float area = FLUID_FILL * sim->config.world_width * sim->config.world_height;
+    return fminf(2.0f * sim->config.seed_radius, sqrtf(area / fmax(sim->seed_count, 1)));
+}
+
+// Poly6 kernel in 2D without its scale, every particle has a mass of 1
+float _fluid_kernel(float sqr_dist, float h) {
+    float sqr_h = h * h;
+    if (sqr_dist >= sqr_h) return 0.0f;
+
+    float diff = sqr_h - sqr_dist;
+    return diff * diff * diff;
+}
+
+float _fluid_kernel_scale(float h) {
+    float sqr_h = h * h;
+    return 4.0f / (M_PI * sqr_h * sqr_h * sqr_h * sqr_h);
+}
+
+// Density inside the generated block, its particles start at rest
+float _fluid_rest_density(float spacing, float h) {
+    int reach = (int)ceilf(h / spacing);
+    float density = 0.0f;
+    for (int y = -reach; y <= reach; y++) {
+        for (int x = -reach; x <= reach; x++) {
+            density += _fluid_kernel((x * x + y * y) * spacing * spacing, h);
+        }
+    }
+    return _fluid_kernel_scale(h) * density;
+}
+
+// Longest step a pressure wave or the viscosity stays stable over, both only depend on the kernel radius
+double _fluid_max_dt(const Sim2D* sim) {
+    float h = sim->fluid_h;
+    return fmin(FLUID_SOUND_CFL * h / FLUID_SOUND_SPEED, FLUID_VISCOSITY_CFL * h * h / FLUID_VISCOSITY);
+}
+
+void _reserve_fluid(Sim2D* sim) {
+    if (sim->fluid_neighbors != NULL) return;
+
+    sim->fluid_neighbors = arena_alloc(&sim->arena, sizeof(uint32_t) * FLUID_MAX_NEIGHBORS * sim->seed_count);
+    sim->fluid_neighbor_counts = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->seed_count);
+    sim->fluid_density = arena_alloc(&sim->arena, sizeof(float) * sim->seed_count);
+    sim->fluid_pressure = arena_alloc(&sim->arena, sizeof(float) * sim->seed_count);
+}
+
+// Distinct buckets of the cells around a particle, which are a kernel radius wide. They are collected locally
+// instead of in the shared visit table of _find_collisions, so workers can query at once
+size_t _fluid_cells(const Sim2D* sim, vec2 pos, size_t cells[FLUID_QUERY_CELLS]) {
+    float h = sim->fluid_h;
+    int min_x = (int)floorf((pos.x - h) / sim->grid_size);
+    int min_y = (int)floorf((pos.y - h) / sim->grid_size);
+    int max_x = (int)floorf((pos.x + h) / sim->grid_size);
+    int max_y = (int)floorf((pos.y + h) / sim->grid_size);
+
+    size_t count = 0;
+    for (int x = min_x; x <= max_x; x++) {
+        for (int y = min_y; y <= max_y && count < FLUID_QUERY_CELLS; y++) {
+            size_t idx = _hash_cell(x, y);
+            bool seen = false;
+            for (size_t v = 0; v < count; v++) {
+                seen = seen || cells[v] == idx;
+            }
+            if (!seen) cells[count++] = idx;
+        }
+    }
+    return count;
+}
+
+// A particle with more neighbours than its list holds is marked with FLUID_MAX_NEIGHBORS + 1, the density
+// counts all of them either way
+void _fluid_density_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    float h = sim->fluid_h;
+    float sqr_h = h * h;
+    float kernel_scale = _fluid_kernel_scale(h);
+    size_t tested = 0;
+    size_t colliding = 0;
+
+    for (size_t i = begin; i < end; i++) {
+        const Seed* s = &sim->seeds[i];
+        uint32_t* neighbors = &sim->fluid_neighbors[FLUID_MAX_NEIGHBORS * i];
+        size_t count = 0;
+        float density = _fluid_kernel(0.0f, h);
+
+        size_t cells[FLUID_QUERY_CELLS];
+        size_t cell_count = _fluid_cells(sim, s->pos, cells);
+        for (size_t c = 0; c < cell_count; c++) {
+            for (Bucket* b = sim->pos_map[cells[c]]; b != NULL; b = b->next) {
+                if (b->seed == s) continue;
+                tested++;
+
+                float sqr_dist = vec2_sqr_dist(s->pos, b->seed->pos);
+                if (sqr_dist >= sqr_h) continue;
+                density += _fluid_kernel(sqr_dist, h);
+                if (count < FLUID_MAX_NEIGHBORS) neighbors[count] = b->seed - sim->seeds;
+                count++;
+            }
+        }
+
+        // Stretched fluid does not pull back, that would clump the particles
+        density *= kernel_scale;
+        sim->fluid_neighbor_counts[i] = count <= FLUID_MAX_NEIGHBORS ? count : FLUID_MAX_NEIGHBORS + 1;
+        sim->fluid_density[i] = density;
+        sim->fluid_pressure[i] =
+            FLUID_SOUND_SPEED * FLUID_SOUND_SPEED * fmaxf(density - sim->fluid_rest_density, 0.0f);
+        colliding += count;
+    }
+
+    sim->worker_pairs_tested[worker] += tested;
+    sim->worker_pairs_colliding[worker] += colliding;
+}
+
+// Symmetric pressure gradient with the spiky kernel and viscosity with its laplacian, both in 2D
+vec2 _fluid_pair_acc(const Sim2D* sim, const Seed* s, uint32_t j, float pressure_term, float viscosity) {
+    float h = sim->fluid_h;
+    float h5 = h * h * h * h * h;
+    float spiky = -30.0f / (M_PI * h5);
+    float laplacian = 40.0f / (M_PI * h5);
+
+    const Seed* other = &sim->seeds[j];
+    vec2 d = vec2_sub(s->pos, other->pos);
+    float dist = vec2_mag(d);
+    float falloff = h - dist;
+
+    vec2 acc = {0.0f, 0.0f};
+    float density_j = sim->fluid_density[j];
+    if (dist > 0.0f) {
+        float pressure = pressure_term + sim->fluid_pressure[j] / (density_j * density_j);
+        acc = vec2_scale(d, -pressure * spiky * falloff * falloff / dist);
+    }
+    return vec2_add(acc, vec2_scale(vec2_sub(other->vel, s->vel), viscosity * laplacian * falloff / density_j));
+}
+
+// Every pair is seen from both sides, so a particle whose list overflowed walks the map again. Cutting its list
+// short would leave pairs that push only one way
+void _fluid_forces_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    float sqr_h = sim->fluid_h * sim->fluid_h;
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        const uint32_t* neighbors = &sim->fluid_neighbors[FLUID_MAX_NEIGHBORS * i];
+        float sqr_density = sim->fluid_density[i] * sim->fluid_density[i];
+        float pressure_term = sim->fluid_pressure[i] / sqr_density;
+        size_t count = sim->fluid_neighbor_counts[i];
+        vec2 acc = FLUID_GRAVITY;
+
+        if (count <= FLUID_MAX_NEIGHBORS) {
+            for (size_t n = 0; n < count; n++) {
+                acc = vec2_add(acc, _fluid_pair_acc(sim, s, neighbors[n], pressure_term, FLUID_VISCOSITY));
+            }
+        } else {
+            size_t cells[FLUID_QUERY_CELLS];
+            size_t cell_count = _fluid_cells(sim, s->pos, cells);
+            for (size_t c = 0; c < cell_count; c++) {
+                for (Bucket* b = sim->pos_map[cells[c]]; b != NULL; b = b->next) {
+                    if (b->seed == s || vec2_sqr_dist(s->pos, b->seed->pos) >= sqr_h) continue;
+                    acc = vec2_add(acc, _fluid_pair_acc(sim, s, b->seed - sim->seeds, pressure_term, FLUID_VISCOSITY));
+                }
+            }
+        }
+        s->acc = vec2_add(s->acc, acc);
+    }
+}
+
+// Fluid particles never collide, the solver lists their neighbours and turns density into pressure instead
+void _solve_pressure_fluid(Sim2D* sim) {
+    TRACE_ZONE(__func__);
+
+    _reserve_fluid(sim);
+    memset(sim->worker_pairs_tested, 0, sizeof(sim->worker_pairs_tested));
+    memset(sim->worker_pairs_colliding, 0, sizeof(sim->worker_pairs_colliding));
+
+    parallel_for(sim->seed_count, _fluid_density_range, sim);
+    parallel_for(sim->seed_count, _fluid_forces_range, sim);
+
+    for (size_t w = 0; w < MAX_THREAD_COUNT; w++) {
+        sim->counters.pairs_tested += sim->worker_pairs_tested[w];
+        sim->counters.pairs_colliding += sim->worker_pairs_colliding[w];
+    }
+}
+
+// The walls hold the fluid in, a particle past one is put back on it and loses part of its normal velocity
+void _integrate_fluid_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    Sim2D* sim = ctx;
+
+    float dt = (float)sim->fluid_dt;
+    float max_sqr_speed = 0.0f;
+    float min_radius = FLT_MAX;
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        if (!_is_held(sim, s)) {
+            s->vel = vec2_add(s->vel, vec2_scale(s->acc, dt));
+            s->pos = vec2_add(s->pos, vec2_scale(s->vel, dt));
+
+            if (s->pos.x < 0.0f || s->pos.x > sim->fluid_bounds.x) {
+                s->pos.x = fminf(fmaxf(s->pos.x, 0.0f), sim->fluid_bounds.x);
+                s->vel.x *= -FLUID_WALL_DAMPING;
+            }
+            if (s->pos.y < 0.0f || s->pos.y > sim->fluid_bounds.y) {
+                s->pos.y = fminf(fmaxf(s->pos.y, 0.0f), sim->fluid_bounds.y);
+                s->vel.y *= -FLUID_WALL_DAMPING;
+            }
+
+            max_sqr_speed = fmaxf(max_sqr_speed, vec2_sqr_mag(s->vel));
+            min_radius = fminf(min_radius, (float)s->radius);
+        }
+        s->acc = (vec2){0.0f, 0.0f};
+    }
+    _store_speed_bound(sim, worker, max_sqr_speed, min_radius);
+}
+
+// Block of particles on a square lattice, slightly shaken so it does not collapse in perfect columns
+void _generate_fluid_range(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    float spacing = _fluid_spacing(sim);
+    size_t cols = (size_t)fmaxf(FLUID_BLOCK_WIDTH * sim->config.world_width / spacing, 1.0f);
+
+    for (size_t i = begin; i < end; i++) {
+        Seed* s = &sim->seeds[i];
+        Rng rng = rng_stream(&sim->rng, i);
+        size_t r = i / cols;
+        size_t c = i % cols;
+
+        float jitter_x = (rand_float(&rng) - 0.5f) * 0.1f * spacing;
+        float jitter_y = (rand_float(&rng) - 0.5f) * 0.1f * spacing;
+        float shade = rand_float(&rng);
+
+        s->radius = (int)fmaxf(roundf(0.5f * spacing), 1.0f);
+        s->pos = (vec2){(c + 0.5f) * spacing + jitter_x, (r + 0.5f) * spacing + jitter_y};
+        s->vel = (vec2){0.0f, 0.0f};
+        s->acc = (vec2){0.0f, 0.0f};
+        s->color = (vec4){0.1f + 0.1f * shade, 0.4f + 0.2f * shade, 0.8f + 0.2f * shade, 1.0f};
+    }
+}
+
+void _generate_fluid_seeds(Sim2D* sim) {
+    parallel_for(sim->seed_count, _generate_fluid_range, sim);
+    sim->rng.counter++;
+    _rebuild_map(sim);
+}
+
+// The map stays in sync like in the impulse modes, only particles that changed cell move in it. A zero step
+// moves nothing
+void _step_fluid_frame(Sim2D* sim, double dt, int width, int height) {
+    TRACE_ZONE(__func__);
+
+    if (!sim->map_synced) _sync_map(sim);
+    _check_drag(sim, dt);
+    if (dt == 0.0) return;
+
+    // Callers with a fixed substep count may step longer than the fluid stays stable over, such a step is
+    // split. The adaptive substeps of the window already stay below the limit
+    size_t splits = (size_t)ceil(fabs(dt) / _fluid_max_dt(sim));
+    sim->fluid_dt = dt / splits;
+    sim->fluid_bounds = (vec2){width, height};
+    for (size_t k = 0; k < splits; k++) {
+        sim->solve_collisions(sim);
+        parallel_for(sim->seed_count, _integrate_fluid_range, sim);
+
+        for (size_t i = 0; i < sim->seed_count; i++) {
+            _map_move(sim, &sim->seeds[i]);
+        }
+        _collide_obstacles(sim, true);
+    }
+}
+
+// The simulation keeps its own copy of the obstacles, reordered into the leaves of the BVH
+void _build_obstacles(Sim2D* sim) {
+    sim->obstacle_count = sim->config.obstacle_count;
+    sim->obstacles = NULL;
+    sim->bvh_node_count = 0;
+    if (sim->obstacle_count == 0) {
+        sim->config.obstacles = NULL;
+        return;
+    }
+
+    size_t count = sim->obstacle_count;
+    uint32_t* order = arena_alloc(&sim->arena, sizeof(uint32_t) * count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    sim->bvh_nodes = arena_alloc(&sim->arena, sizeof(BvhNode) * (2 * count - 1));
+    sim->bvh_node_count = 1;
+    _build_bvh_node(sim, order, 0, 0, count, 0);
+
+    sim->obstacles = arena_alloc(&sim->arena, sizeof(Segment) * count);
+    for (size_t i = 0; i < count; i++) {
+        sim->obstacles[i] = sim->config.obstacles[order[i]];
     }
+    sim->config.obstacles = sim->obstacles;
+    sim->obstacle_pushed = arena_alloc(&sim->arena, sizeof(uint8_t) * sim->seed_count);
+    memset(sim->obstacle_pushed, 0, sizeof(uint8_t) * sim->seed_count);
 }
 
-void _generate_bubbles_seeds(void) {
-    for (size_t i = 0; i < SEED_COUNT; i++) {
-        Seed* s = &seeds[i];
+// The segments order[begin..end) go under the node. A range too large for a leaf is binned by the centers of its
+// segments along the longer axis and split at the plane where the children cost the least, every child costing
+// its segment count times its half perimeter, the 2D surface area. Past BVH_SAH_DEPTH levels the range is just
+// halved, a chain of lopsided splits cannot grow the tree past the query stack
+void _build_bvh_node(Sim2D* sim, uint32_t* order, uint32_t node, uint32_t begin, uint32_t end, size_t depth) {
+    const Segment* segments = sim->config.obstacles;
+    BvhNode* n = &sim->bvh_nodes[node];
+
+    vec2 lo = {FLT_MAX, FLT_MAX};
+    vec2 hi = {-FLT_MAX, -FLT_MAX};
+    vec2 center_lo = {FLT_MAX, FLT_MAX};
+    vec2 center_hi = {-FLT_MAX, -FLT_MAX};
+    for (uint32_t i = begin; i < end; i++) {
+        const Segment* seg = &segments[order[i]];
+        vec2 center = _segment_center(seg);
+        lo = (vec2){fminf(lo.x, fminf(seg->a.x, seg->b.x)), fminf(lo.y, fminf(seg->a.y, seg->b.y))};
+        hi = (vec2){fmaxf(hi.x, fmaxf(seg->a.x, seg->b.x)), fmaxf(hi.y, fmaxf(seg->a.y, seg->b.y))};
+        center_lo = (vec2){fminf(center_lo.x, center.x), fminf(center_lo.y, center.y)};
+        center_hi = (vec2){fmaxf(center_hi.x, center.x), fmaxf(center_hi.y, center.y)};
+    }
+    n->lo = lo;
+    n->hi = hi;
+    n->first = begin;
+    n->count = end - begin;
+    if (n->count <= BVH_LEAF_SIZE) return;
+
+    bool split_x = center_hi.x - center_lo.x >= center_hi.y - center_lo.y;
+    float axis_lo = split_x ? center_lo.x : center_lo.y;
+    float extent = split_x ? center_hi.x - center_lo.x : center_hi.y - center_lo.y;
+    uint32_t mid = begin + (end - begin) / 2;
+
+    if (depth < BVH_SAH_DEPTH && extent > 0.0f) {
+        size_t bin_counts[BVH_SAH_BINS] = {0};
+        vec2 bin_lo[BVH_SAH_BINS];
+        vec2 bin_hi[BVH_SAH_BINS];
+        for (int b = 0; b < BVH_SAH_BINS; b++) {
+            bin_lo[b] = (vec2){FLT_MAX, FLT_MAX};
+            bin_hi[b] = (vec2){-FLT_MAX, -FLT_MAX};
+        }
+        for (uint32_t i = begin; i < end; i++) {
+            const Segment* seg = &segments[order[i]];
+            vec2 center = _segment_center(seg);
+            int b = (int)(((split_x ? center.x : center.y) - axis_lo) / extent * BVH_SAH_BINS);
+            b = b < BVH_SAH_BINS ? b : BVH_SAH_BINS - 1;
+            bin_counts[b]++;
+            bin_lo[b] = (vec2){fminf(bin_lo[b].x, fminf(seg->a.x, seg->b.x)),
+                               fminf(bin_lo[b].y, fminf(seg->a.y, seg->b.y))};
+            bin_hi[b] = (vec2){fmaxf(bin_hi[b].x, fmaxf(seg->a.x, seg->b.x)),
+                               fmaxf(bin_hi[b].y, fmaxf(seg->a.y, seg->b.y))};
+        }
+
+        // Cost of the bins left of every plane from a sweep to the right, then the right side sweeping back
+        float left_cost[BVH_SAH_BINS];
+        size_t left_count = 0;
+        vec2 side_lo = {FLT_MAX, FLT_MAX};
+        vec2 side_hi = {-FLT_MAX, -FLT_MAX};
+        for (int b = 0; b < BVH_SAH_BINS - 1; b++) {
+            left_count += bin_counts[b];
+            side_lo = (vec2){fminf(side_lo.x, bin_lo[b].x), fminf(side_lo.y, bin_lo[b].y)};
+            side_hi = (vec2){fmaxf(side_hi.x, bin_hi[b].x), fmaxf(side_hi.y, bin_hi[b].y)};
+            left_cost[b] = left_count * (side_hi.x - side_lo.x + side_hi.y - side_lo.y);
+        }
+
+        float best_cost = FLT_MAX;
+        int best_plane = 0;
+        size_t right_count = 0;
+        side_lo = (vec2){FLT_MAX, FLT_MAX};
+        side_hi = (vec2){-FLT_MAX, -FLT_MAX};
+        for (int b = BVH_SAH_BINS - 1; b > 0; b--) {
+            right_count += bin_counts[b];
+            side_lo = (vec2){fminf(side_lo.x, bin_lo[b].x), fminf(side_lo.y, bin_lo[b].y)};
+            side_hi = (vec2){fmaxf(side_hi.x, bin_hi[b].x), fmaxf(side_hi.y, bin_hi[b].y)};
+            if (right_count == 0 || right_count == n->count) continue;
+
+            float cost = left_cost[b - 1] + right_count * (side_hi.x - side_lo.x + side_hi.y - side_lo.y);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_plane = b;
+            }
+        }
 
-        s->radius = rand_float() * (SEED_MAX_RADIUS - SEED_MIN_RADIUS + 20) + SEED_MIN_RADIUS + 20;
+        // Segments left of the plane are swapped to the front of the range
+        if (best_plane > 0) {
+            mid = begin;
+            for (uint32_t i = begin; i < end; i++) {
+                vec2 center = _segment_center(&segments[order[i]]);
+                int b = (int)(((split_x ? center.x : center.y) - axis_lo) / extent * BVH_SAH_BINS);
+                if (b >= best_plane) continue;
+
+                uint32_t swap = order[i];
+                order[i] = order[mid];
+                order[mid++] = swap;
+            }
+        }
+    }
+
+    n->first = sim->bvh_node_count;
+    n->count = 0;
+    sim->bvh_node_count += 2;
+    _build_bvh_node(sim, order, n->first, begin, mid, depth + 1);
+    _build_bvh_node(sim, order, n->first + 1, mid, end, depth + 1);
+}
 
-        _generate_seed_pos(s);
-        _generate_seed_color(s);
-        _generate_seed_dynamics(s, GRAVITY, lerpf(100, 150, rand_float()));
+vec2 _segment_center(const Segment* seg) {
+    return vec2_scale(vec2_add(seg->a, seg->b), 0.5f);
+}
 
-        _map_insert(s);
+// Segments whose bounds overlap the box. Returns how many there are, past max of them the list stops short
+size_t _query_bvh(const Sim2D* sim, vec2 lo, vec2 hi, uint32_t* list, size_t max) {
+    uint32_t stack[BVH_STACK_SIZE];
+    size_t stack_count = 0;
+    size_t found = 0;
+
+    stack[stack_count++] = 0;
+    while (stack_count > 0) {
+        const BvhNode* n = &sim->bvh_nodes[stack[--stack_count]];
+        if (n->lo.x > hi.x || n->hi.x < lo.x || n->lo.y > hi.y || n->hi.y < lo.y) continue;
+
+        if (n->count == 0) {
+            stack[stack_count++] = n->first;
+            stack[stack_count++] = n->first + 1;
+            continue;
+        }
+        for (uint32_t i = n->first; i < n->first + n->count; i++) {
+            if (found < max) list[found] = i;
+            found++;
+        }
     }
+    return found;
 }
 
-void _render_voronoi_frame(GLFWwindow* window, double dt, int width, int height) {
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// A seed overlapping the segment is moved out along the normal at the closest point and may bounce off it like
+// off the walls of the world, a center right on the segment leaves to its left
+bool _push_off_segment(Seed* s, const Segment* seg, bool bounce) {
+    vec2 ab = vec2_sub(seg->b, seg->a);
+    float sqr_len = vec2_sqr_mag(ab);
+    float t = sqr_len > 0.0f ? fminf(fmaxf(vec2_dot(vec2_sub(s->pos, seg->a), ab) / sqr_len, 0.0f), 1.0f) : 0.0f;
+    vec2 d = vec2_sub(s->pos, vec2_add(seg->a, vec2_scale(ab, t)));
+
+    float sqr_dist = vec2_sqr_mag(d);
+    float radius = (float)s->radius;
+    if (sqr_dist >= radius * radius) return false;
+
+    float dist = sqrtf(sqr_dist);
+    vec2 normal = dist > 0.0f    ? vec2_scale(d, 1.0f / dist)
+                  : sqr_len > 0.0f ? vec2_normalize(vec2_perp(ab))
+                                   : (vec2){0.0f, 1.0f};
+    s->pos = vec2_add(s->pos, vec2_scale(normal, radius - dist));
+
+    float vn = vec2_dot(s->vel, normal);
+    if (vn < 0.0f) s->vel = vec2_sub(s->vel, vec2_scale(normal, bounce ? 2.0f * vn : vn));
+    return true;
+}
+
+// The segments around the cell of the seed, widened by the largest radius, are listed when the seed is the first
+// one in that cell. A seed in a crowded cell lists the segments around itself instead
+void _collide_seed_obstacles(Sim2D* sim, Seed* s, ObstacleCell* cell) {
+    size_t i = s - sim->seeds;
+    if (sim->sleep_state[i] != SEED_AWAKE || _is_held(sim, s)) return;
+
+    int x = (int)floorf(s->pos.x / sim->grid_size);
+    int y = (int)floorf(s->pos.y / sim->grid_size);
+    if (!cell->valid || x != cell->x || y != cell->y) {
+        float reach = sim->seed_max_radius;
+        vec2 lo = {x * sim->grid_size - reach, y * sim->grid_size - reach};
+        vec2 hi = {(x + 1) * sim->grid_size + reach, (y + 1) * sim->grid_size + reach};
+        cell->found = _query_bvh(sim, lo, hi, cell->list, OBSTACLE_LIST_SIZE);
+        cell->x = x;
+        cell->y = y;
+        cell->valid = cell->found <= OBSTACLE_LIST_SIZE;
+    }
+
+    uint32_t seed_list[OBSTACLE_LIST_SIZE];
+    const uint32_t* list = cell->list;
+    size_t found = cell->found;
+    if (!cell->valid) {
+        vec2 extent = {(float)s->radius, (float)s->radius};
+        list = seed_list;
+        found = _query_bvh(sim, vec2_sub(s->pos, extent), vec2_add(s->pos, extent), seed_list, OBSTACLE_LIST_SIZE);
+        found = found < OBSTACLE_LIST_SIZE ? found : OBSTACLE_LIST_SIZE;
+    }
+
+    bool pushed = false;
+    for (size_t k = 0; k < found; k++) {
+        pushed = _push_off_segment(s, &sim->obstacles[list[k]], sim->obstacle_bounce) || pushed;
+    }
+    if (pushed) sim->obstacle_pushed[i] = 1;
+}
 
-    _apply_constraints(width, height);
-    _check_drag(window, height, dt);
-    _solve_collisions();
-    _update_positions(dt);
+// A bucket chain holds the seeds of one cell, apart from the few cells that hash alike
+void _collide_bucket_obstacles(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(seeds[0]) * SEED_COUNT, seeds);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, SEED_COUNT);
+    ObstacleCell cell = {.valid = false};
+    for (size_t idx = begin; idx < end; idx++) {
+        for (Bucket* b = sim->pos_map[idx]; b != NULL; b = b->next) {
+            _collide_seed_obstacles(sim, b->seed, &cell);
+        }
+    }
 }
 
-void _render_bubbles_frame(GLFWwindow* window, double dt, int width, int height) {
-    UNUSED(window);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+// Without a map in sync the seeds go in memory order, which the Morton reorders keep close to cell order
+void _collide_seed_range_obstacles(size_t begin, size_t end, size_t worker, void* ctx) {
+    UNUSED(worker);
+    Sim2D* sim = ctx;
+
+    ObstacleCell cell = {.valid = false};
+    for (size_t i = begin; i < end; i++) {
+        _collide_seed_obstacles(sim, &sim->seeds[i], &cell);
+    }
+}
 
-    _apply_constraints(width, height);
-    _apply_gravity();
-    _solve_collisions();
-    _update_positions(dt);
+// Runs at the end of a step. Impulse steps bounce the seeds off like off the walls of the world, position based
+// steps only take away the velocity into the obstacle, their contacts would pump energy in through a bounce.
+// Seeds only write themselves, the map update afterwards is serial
+void _collide_obstacles(Sim2D* sim, bool bounce) {
+    if (sim->obstacle_count == 0) return;
+    TRACE_ZONE(__func__);
+
+    sim->obstacle_bounce = bounce;
+    if (!sim->map_synced) {
+        parallel_for(sim->seed_count, _collide_seed_range_obstacles, sim);
+        memset(sim->obstacle_pushed, 0, sizeof(uint8_t) * sim->seed_count);
+        return;
+    }
 
-    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(seeds[0]) * SEED_COUNT, seeds);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, SEED_COUNT);
-}
\ No newline at end of file
+    parallel_for(NUM_BUCKETS, _collide_bucket_obstacles, sim);
+    for (size_t i = 0; i < sim->seed_count; i++) {
+        if (!sim->obstacle_pushed[i]) continue;
+        _map_move(sim, &sim->seeds[i]);
+        sim->obstacle_pushed[i] = 0;
+    }
+}
@@ -0,0 +1,291 @@
+#include "snapshot.h"
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "import.h"
+#include "main.h"
+
+#define SNAPSHOT_CHUNK 4096  // seeds gathered per write
+
+static_assert(sizeof(SnapshotHeader) % 8 == 0, "Snapshot header must keep its 64 bit fields aligned");
+
+// This source inner helpers
+size_t _section_element_size(SnapshotSection section);
+bool _write_padding(FILE* f, size_t* offset);
+bool _write_seed_section(FILE* f, SnapshotSection section, void* chunk);
+const char* _validate_header(const SnapshotHeader* h, size_t file_size);
+void _gather_seed_section(const SnapshotHeader* h, const char* base, SnapshotSection section);
+
+const char* SNAPSHOT_LOAD_PATH = NULL;
+volatile sig_atomic_t IS_SNAPSHOT_REQUESTED = 0;
+
+const char snapshot_padding[SNAPSHOT_ALIGN] = {0};
+
+// Function definitions
+// ---------------------
+// Written next to the target and renamed over it, a reader never maps a half written file
+void save_snapshot(const char* path) {
+    double start = now_ms();
+
+    size_t spring_count = 0;
+    const Spring* springs = sim_springs(sim, &spring_count);
+    const SimConfig* config = sim_config(sim);
+
+    SnapshotHeader h = {
+        .version = SNAPSHOT_VERSION,
+        .header_size = sizeof(SnapshotHeader),
+        .byte_order = SNAPSHOT_BYTE_ORDER,
+        .mode = sim_mode(sim),
+        .integrator = config->integrator,
+        .seed_radius = config->seed_radius,
+        .seed_count = config->seed_count,
+        .spring_count = spring_count,
+    };
+    memcpy(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic));
+
+    size_t offset = sizeof(SnapshotHeader);
+    for (int i = 0; i < COUNT_SNAPSHOT_SECTIONS; i++) {
+        size_t count = i == SNAPSHOT_SPRINGS ? spring_count : config->seed_count;
+        offset = (offset + SNAPSHOT_ALIGN - 1) / SNAPSHOT_ALIGN * SNAPSHOT_ALIGN;
+        h.sections[i] = (SnapshotRange){offset, count * _section_element_size(i)};
+        offset += h.sections[i].size;
+    }
+
+    char tmp_path[4096];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open snapshot file '%s'\n", tmp_path);
+        return;
+    }
+
+    void* chunk = malloc(SNAPSHOT_CHUNK * sizeof(vec4));
+    if (chunk == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    offset = sizeof(h);
+    for (int i = 0; i < COUNT_SNAPSHOT_SECTIONS && ok; i++) {
+        ok = _write_padding(f, &offset);
+        if (!ok) break;
+
+        if (i == SNAPSHOT_SPRINGS) {
+            ok = spring_count == 0 || fwrite(springs, sizeof(Spring), spring_count, f) == spring_count;
+        } else {
+            ok = _write_seed_section(f, i, chunk);
+        }
+        offset += h.sections[i].size;
+    }
+
+    free(chunk);
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp_path, path) != 0) {
+        fprintf(stderr, "[ERROR]: Could not write snapshot file '%s'\n", path);
+        remove(tmp_path);
+        return;
+    }
+
+    printf("[INFO]: Snapshot of %zu seeds and %zu springs written to '%s' in %.2f ms\n",
+           config->seed_count, spring_count, path, now_ms() - start);
+}
+
+// Maps the file and copies the sections straight into the simulation, the header is the only thing parsed
+void load_snapshot(const char* path) {
+    double start = now_ms();
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "[ERROR]: Could not open snapshot file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        fprintf(stderr, "[ERROR]: Snapshot file '%s' is truncated\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    size_t file_size = st.st_size;
+    const char* base = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        fprintf(stderr, "[ERROR]: Could not map snapshot file '%s'\n", path);
+        exit(EXIT_FAILURE);
+    }
+    madvise((void*)base, file_size, MADV_SEQUENTIAL | MADV_WILLNEED);
+
+    const SnapshotHeader* h = (const SnapshotHeader*)base;
+    const char* error = _validate_header(h, file_size);
+    if (error != NULL) {
+        fprintf(stderr, "[ERROR]: Snapshot file '%s' is invalid: %s\n", path, error);
+        exit(EXIT_FAILURE);
+    }
+
+    SIM_MODE = h->mode;
+    SEED_COUNT = h->seed_count;
+    SEED_RADIUS = h->seed_radius;
+    INTEGRATOR = h->integrator;
+
+    free_sim(sim);
+    SimConfig config = app_sim_config();
+    Spring* springs = NULL;
+    sim = begin_sim_restore(&config, h->spring_count, &springs);
+    for (int i = 0; i < COUNT_SNAPSHOT_SECTIONS; i++) {
+        if (i != SNAPSHOT_SPRINGS) _gather_seed_section(h, base, i);
+    }
+    memcpy(springs, base + h->sections[SNAPSHOT_SPRINGS].offset, h->sections[SNAPSHOT_SPRINGS].size);
+
+    size_t spring_count = h->spring_count;
+    munmap((void*)base, file_size);
+
+    end_sim_restore(sim, spring_count);
+    printf("[INFO]: Snapshot of %zu seeds and %zu springs loaded from '%s' in %.2f ms\n",
+           SEED_COUNT, spring_count, path, now_ms() - start);
+}
+
+// Private function definitions
+// ---------------------
+size_t _section_element_size(SnapshotSection section) {
+    switch (section) {
+        case SNAPSHOT_POS:
+        case SNAPSHOT_VEL:
+        case SNAPSHOT_ACC:
+            return sizeof(vec2);
+        case SNAPSHOT_COLOR:
+            return sizeof(vec4);
+        case SNAPSHOT_RADIUS:
+            return sizeof(int32_t);
+        case SNAPSHOT_INV_MASS:
+            return sizeof(float);
+        case SNAPSHOT_SPRINGS:
+            return sizeof(Spring);
+        default:
+            UNREACHABLE("Unexpected snapshot section");
+    }
+}
+
+bool _write_padding(FILE* f, size_t* offset) {
+    size_t pad = (SNAPSHOT_ALIGN - *offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN;
+    *offset += pad;
+    return pad == 0 || fwrite(snapshot_padding, 1, pad, f) == pad;
+}
+
+// Seeds are interleaved in memory, each field is gathered a chunk at a time into one contiguous array
+bool _write_seed_section(FILE* f, SnapshotSection section, void* chunk) {
+    size_t size = _section_element_size(section);
+    size_t seed_count = sim_seed_count(sim);
+    const Seed* seeds = sim_seeds(sim);
+    const float* inv_mass = sim_inv_mass(sim);
+
+    for (size_t begin = 0; begin < seed_count; begin += SNAPSHOT_CHUNK) {
+        size_t count = seed_count - begin < SNAPSHOT_CHUNK ? seed_count - begin : SNAPSHOT_CHUNK;
+
+        for (size_t i = 0; i < count; i++) {
+            const Seed* s = &seeds[begin + i];
+            switch (section) {
+                case SNAPSHOT_POS:
+                    ((vec2*)chunk)[i] = s->pos;
+                    break;
+                case SNAPSHOT_VEL:
+                    ((vec2*)chunk)[i] = s->vel;
+                    break;
+                case SNAPSHOT_ACC:
+                    ((vec2*)chunk)[i] = s->acc;
+                    break;
+                case SNAPSHOT_COLOR:
+                    ((vec4*)chunk)[i] = s->color;
+                    break;
+                case SNAPSHOT_RADIUS:
+                    ((int32_t*)chunk)[i] = s->radius;
+                    break;
+                case SNAPSHOT_INV_MASS:
+                    ((float*)chunk)[i] = inv_mass[begin + i];
+                    break;
+                default:
+                    UNREACHABLE("Unexpected snapshot section");
+            }
+        }
+
+        if (fwrite(chunk, size, count, f) != count) return false;
+    }
+    return true;
+}
+
+// Returns NULL when the header describes a state this build can load
+const char* _validate_header(const SnapshotHeader* h, size_t file_size) {
+    if (memcmp(h->magic, SNAPSHOT_MAGIC, sizeof(h->magic)) != 0) return "not a snapshot";
+    if (h->byte_order != SNAPSHOT_BYTE_ORDER) return "written on a machine of different endianness";
+    if (h->version != SNAPSHOT_VERSION) return "unsupported version";
+    if (h->header_size != sizeof(SnapshotHeader)) return "unexpected header size";
+    if (h->mode >= COUNT_MODES) return "unknown mode";
+    if (h->integrator >= COUNT_INTEGRATORS) return "unknown integrator";
+    if (h->seed_count < 1 || h->seed_count > SEED_MAX_COUNT) return "seed count out of range";
+    if (h->seed_radius < SEED_MIN_RADIUS || h->seed_radius > SEED_MAX_RADIUS) return "seed radius out of range";
+    if (h->spring_count > h->seed_count * h->seed_count) return "spring count out of range";
+
+    for (int i = 0; i < COUNT_SNAPSHOT_SECTIONS; i++) {
+        const SnapshotRange* r = &h->sections[i];
+        uint64_t count = i == SNAPSHOT_SPRINGS ? h->spring_count : h->seed_count;
+
+        if (r->offset % SNAPSHOT_ALIGN != 0) return "misaligned section";
+        if (r->size != count * _section_element_size(i)) return "section size does not match the counts";
+        if (r->offset > file_size || r->size > file_size - r->offset) return "section past the end of the file";
+    }
+
+    // Springs index seeds directly, one bad index would write out of bounds in the solver
+    const Spring* springs = (const Spring*)((const char*)h + h->sections[SNAPSHOT_SPRINGS].offset);
+    for (uint64_t i = 0; i < h->spring_count; i++) {
+        if (springs[i].p0 >= h->seed_count || springs[i].p1 >= h->seed_count) return "spring references a missing seed";
+    }
+
+    // Radii go into the contact masses, a zero one divides by zero. Checked here so a bad file never replaces
+    // the running simulation, the range is the one imported seeds may have
+    const int32_t* radii = (const int32_t*)((const char*)h + h->sections[SNAPSHOT_RADIUS].offset);
+    for (uint64_t i = 0; i < h->seed_count; i++) {
+        if (radii[i] < 1 || radii[i] > IMPORT_MAX_RADIUS) return "a seed radius is out of range";
+    }
+    return NULL;
+}
+
+void _gather_seed_section(const SnapshotHeader* h, const char* base, SnapshotSection section) {
+    const char* data = base + h->sections[section].offset;
+    Seed* seeds = sim_seeds(sim);
+    float* inv_mass = sim_inv_mass(sim);
+
+    for (size_t i = 0; i < h->seed_count; i++) {
+        Seed* s = &seeds[i];
+        switch (section) {
+            case SNAPSHOT_POS:
+                s->pos = ((const vec2*)data)[i];
+                break;
+            case SNAPSHOT_VEL:
+                s->vel = ((const vec2*)data)[i];
+                break;
+            case SNAPSHOT_ACC:
+                s->acc = ((const vec2*)data)[i];
+                break;
+            case SNAPSHOT_COLOR:
+                s->color = ((const vec4*)data)[i];
+                break;
+            case SNAPSHOT_RADIUS:
+                s->radius = ((const int32_t*)data)[i];
+                break;
+            case SNAPSHOT_INV_MASS:
+                inv_mass[i] = ((const float*)data)[i];
+                break;
+            default:
+                UNREACHABLE("Unexpected snapshot section");
+        }
+    }
+}
@@ -0,0 +1,188 @@
+#include "stats.h"
+
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+
+// Running totals of the current log interval
+typedef struct {
+    double start_ms;
+    size_t frames;
+    double frame_min_ms;
+    double frame_max_ms;
+    double frame_sum_ms;
+    FrameSample totals;
+} StatsWindow;
+
+// This source inner helpers
+void _reset_window(StatsWindow* w, double now);
+void _accumulate(StatsWindow* w, const FrameSample* sample);
+void _finish_summary(const StatsWindow* w, double seconds, StatsSummary* summary);
+void _log_summary(const StatsSummary* summary);
+
+size_t STATS_INTERVAL = 0;
+const char* STATS_CSV_PATH = NULL;
+bool IS_OVERLAY = false;
+
+FrameSample stats_history[STATS_HISTORY];
+size_t stats_history_count = 0;
+
+StatsWindow stats_window = {0};
+SimCounters stats_prev_counters = {0};
+double stats_start_ms = 0.0;
+FILE* stats_csv = NULL;
+
+// Function definitions
+// ---------------------
+void init_stats(void) {
+    stats_start_ms = now_ms();
+    stats_prev_counters = *sim_counters(sim);
+    _reset_window(&stats_window, stats_start_ms);
+
+    if (STATS_CSV_PATH == NULL) return;
+
+    stats_csv = fopen(STATS_CSV_PATH, "w");
+    if (stats_csv == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open stats file '%s'\n", STATS_CSV_PATH);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stats_csv, "time_s,frames,frame_min_ms,frame_avg_ms,frame_max_ms,physics_ms,upload_ms,steps,"
+                       "pairs_tested,pairs_colliding,seeds_awake,seeds_sleeping,seeds_per_s,memory_bytes,"
+                       "memory_high_water_bytes,memory_reserved_bytes\n");
+}
+
+void free_stats(void) {
+    if (stats_csv != NULL) fclose(stats_csv);
+    stats_csv = NULL;
+}
+
+// Called once per rendered frame, the per-step timings and pair counts come from the simulation counters
+void stats_record_frame(double frame_ms) {
+    const SimCounters* counters = sim_counters(sim);
+    FrameSample sample = {
+        .frame_ms = frame_ms,
+        .physics_ms = counters->physics_ms - stats_prev_counters.physics_ms,
+        .upload_ms = counters->upload_ms - stats_prev_counters.upload_ms,
+        .steps = counters->steps - stats_prev_counters.steps,
+        .pairs_tested = counters->pairs_tested - stats_prev_counters.pairs_tested,
+        .pairs_colliding = counters->pairs_colliding - stats_prev_counters.pairs_colliding,
+        .seeds_awake = counters->seeds_awake - stats_prev_counters.seeds_awake,
+        .seeds_sleeping = counters->seeds_sleeping - stats_prev_counters.seeds_sleeping,
+    };
+    stats_prev_counters = *counters;
+
+    stats_history[stats_history_count % STATS_HISTORY] = sample;
+    stats_history_count++;
+
+    if (STATS_INTERVAL == 0) return;
+
+    _accumulate(&stats_window, &sample);
+
+    double now = now_ms();
+    double seconds = (now - stats_window.start_ms) / 1000.0;
+    if (seconds < STATS_INTERVAL) return;
+
+    StatsSummary summary;
+    _finish_summary(&stats_window, seconds, &summary);
+    _log_summary(&summary);
+    _reset_window(&stats_window, now);
+}
+
+// Summary of the most recent frames still in the history
+void stats_summarize(size_t frames, StatsSummary* summary) {
+    StatsWindow w;
+    _reset_window(&w, 0.0);
+
+    double seconds = 0.0;
+    for (size_t age = 0; age < frames; age++) {
+        const FrameSample* sample = stats_sample(age);
+        if (sample == NULL) break;
+
+        _accumulate(&w, sample);
+        seconds += sample->frame_ms / 1000.0;
+    }
+    _finish_summary(&w, seconds, summary);
+}
+
+// Sample recorded `age` frames ago, NULL once it fell out of the history
+const FrameSample* stats_sample(size_t age) {
+    if (age >= stats_history_count || age >= STATS_HISTORY) return NULL;
+    return &stats_history[(stats_history_count - 1 - age) % STATS_HISTORY];
+}
+
+// Private function definitions
+// ---------------------
+void _reset_window(StatsWindow* w, double now) {
+    *w = (StatsWindow){
+        .start_ms = now,
+        .frame_min_ms = DBL_MAX,
+        .frame_max_ms = 0.0,
+    };
+}
+
+void _accumulate(StatsWindow* w, const FrameSample* sample) {
+    w->frames++;
+    w->frame_sum_ms += sample->frame_ms;
+    if (sample->frame_ms < w->frame_min_ms) w->frame_min_ms = sample->frame_ms;
+    if (sample->frame_ms > w->frame_max_ms) w->frame_max_ms = sample->frame_ms;
+
+    w->totals.physics_ms += sample->physics_ms;
+    w->totals.upload_ms += sample->upload_ms;
+    w->totals.steps += sample->steps;
+    w->totals.pairs_tested += sample->pairs_tested;
+    w->totals.pairs_colliding += sample->pairs_colliding;
+    w->totals.seeds_awake += sample->seeds_awake;
+    w->totals.seeds_sleeping += sample->seeds_sleeping;
+}
+
+// Times and pair counts are per frame averages, seed counts per step averages
+void _finish_summary(const StatsWindow* w, double seconds, StatsSummary* summary) {
+    double frames = w->frames > 0 ? (double)w->frames : 1.0;
+    double steps = w->totals.steps > 0 ? (double)w->totals.steps : 1.0;
+
+    *summary = (StatsSummary){
+        .frames = w->frames,
+        .seconds = seconds,
+        .frame_min_ms = w->frames > 0 ? w->frame_min_ms : 0.0,
+        .frame_avg_ms = w->frame_sum_ms / frames,
+        .frame_max_ms = w->frame_max_ms,
+        .physics_ms = w->totals.physics_ms / frames,
+        .upload_ms = w->totals.upload_ms / frames,
+        .steps = w->totals.steps / frames,
+        .pairs_tested = w->totals.pairs_tested / frames,
+        .pairs_colliding = w->totals.pairs_colliding / frames,
+        .seeds_awake = w->totals.seeds_awake / steps,
+        .seeds_sleeping = w->totals.seeds_sleeping / steps,
+        .seeds_per_sec = w->totals.physics_ms > 0.0
+                             ? SEED_COUNT * w->totals.steps / (w->totals.physics_ms / 1000.0)
+                             : 0.0,
+        .memory_bytes = sim_memory_in_use(sim),
+        .memory_high_water_bytes = sim_memory_high_water(sim),
+        .memory_reserved_bytes = sim_memory_reserved(sim),
+    };
+}
+
+void _log_summary(const StatsSummary* s) {
+    double elapsed = (now_ms() - stats_start_ms) / 1000.0;
+
+    if (stats_csv != NULL) {
+        fprintf(stats_csv, "%.3f,%zu,%.3f,%.3f,%.3f,%.3f,%.3f,%.2f,%.0f,%.0f,%.0f,%.0f,%.0f,%zu,%zu,%zu\n",
+                elapsed, s->frames, s->frame_min_ms, s->frame_avg_ms, s->frame_max_ms,
+                s->physics_ms, s->upload_ms, s->steps, s->pairs_tested, s->pairs_colliding,
+                s->seeds_awake, s->seeds_sleeping, s->seeds_per_sec, s->memory_bytes, s->memory_high_water_bytes,
+                s->memory_reserved_bytes);
+        fflush(stats_csv);
+        return;
+    }
+
+    fprintf(stderr,
+            "[STATS]: %.1fs, %zu frames, frame min/avg/max %.2f/%.2f/%.2f ms, physics %.2f ms in %.2f substeps, "
+            "upload %.2f ms, pairs %.0f tested / %.0f colliding, seeds %.0f awake / %.0f sleeping, %.3g seeds/s, memory %zu bytes "
+            "(%zu high-water, %zu reserved)\n",
+            elapsed, s->frames, s->frame_min_ms, s->frame_avg_ms, s->frame_max_ms,
+            s->physics_ms, s->steps, s->upload_ms, s->pairs_tested, s->pairs_colliding,
+            s->seeds_awake, s->seeds_sleeping, s->seeds_per_sec, s->memory_bytes, s->memory_high_water_bytes,
+            s->memory_reserved_bytes);
+}
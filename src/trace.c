@@ -0,0 +1,144 @@
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef struct {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+} TraceEvent;
+
+// Single producer ring, only the owning thread writes and publishes through head
+typedef struct {
+    TraceEvent events[TRACE_RING_CAPACITY];
+    _Atomic uint64_t head;
+    char name[TRACE_THREAD_NAME_SIZE];
+} TraceRing;
+
+// This source inner helpers
+uint64_t _now_ns(void);
+TraceRing* _thread_ring(void);
+void _write_ring(FILE* f, size_t tid, TraceRing* ring, double ticks_per_us, bool* first);
+
+TraceRing* _Atomic trace_rings[TRACE_MAX_THREADS];
+_Atomic size_t trace_ring_count = 0;
+_Thread_local TraceRing* trace_ring = NULL;
+
+// Reference points to convert ticks into microseconds at dump time
+uint64_t trace_start_ticks = 0;
+uint64_t trace_start_ns = 0;
+
+// Function definitions
+// ---------------------
+void init_trace(void) {
+    trace_start_ticks = trace_ticks();
+    trace_start_ns = _now_ns();
+}
+
+void free_trace(void) {
+    size_t count = atomic_load(&trace_ring_count);
+    for (size_t i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        free(atomic_exchange(&trace_rings[i], NULL));
+    }
+    atomic_store(&trace_ring_count, 0);
+    trace_ring = NULL;
+}
+
+// Writes every ring as complete ('X') events, readable by chrome://tracing and Perfetto
+void trace_dump(const char* path) {
+#ifndef TRACE
+    printf("[INFO]: Tracing is compiled out, rebuild with 'make TRACE=1' to record '%s'\n", path);
+#else
+    uint64_t ticks = trace_ticks() - trace_start_ticks;
+    uint64_t ns = _now_ns() - trace_start_ns;
+    double ticks_per_us = ns > 0 ? (double)ticks * 1000.0 / ns : 1.0;
+
+    FILE* f = fopen(path, "w");
+    if (f == NULL) {
+        fprintf(stderr, "[ERROR]: Could not open trace file '%s'\n", path);
+        return;
+    }
+
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+    size_t count = atomic_load(&trace_ring_count);
+    for (size_t i = 0; i < count && i < TRACE_MAX_THREADS; i++) {
+        TraceRing* ring = atomic_load(&trace_rings[i]);
+        if (ring != NULL) _write_ring(f, i, ring, ticks_per_us, &first);
+    }
+
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    printf("[INFO]: Trace written to '%s'\n", path);
+#endif
+}
+
+void trace_thread_name(const char* name) {
+    TraceRing* ring = _thread_ring();
+    if (ring == NULL) return;
+
+    strncpy(ring->name, name, TRACE_THREAD_NAME_SIZE - 1);
+    ring->name[TRACE_THREAD_NAME_SIZE - 1] = '\0';
+}
+
+void trace_zone_end(TraceZone* zone) {
+    uint64_t end = trace_ticks();
+    TraceRing* ring = _thread_ring();
+    if (ring == NULL) return;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    ring->events[head % TRACE_RING_CAPACITY] = (TraceEvent){zone->name, zone->start, end};
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Private function definitions
+// ---------------------
+uint64_t _now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Rings are created on a thread's first event and registered lock-free, threads past the limit are not traced
+TraceRing* _thread_ring(void) {
+    if (trace_ring != NULL) return trace_ring;
+
+    size_t slot = atomic_fetch_add(&trace_ring_count, 1);
+    if (slot >= TRACE_MAX_THREADS) return NULL;
+
+    TraceRing* ring = calloc(1, sizeof(TraceRing));
+    if (ring == NULL) {
+        printf("[ERROR]: Memory was not allocated\n");
+        exit(EXIT_FAILURE);
+    }
+    snprintf(ring->name, TRACE_THREAD_NAME_SIZE, "thread %zu", slot);
+
+    atomic_store(&trace_rings[slot], ring);
+    trace_ring = ring;
+    return ring;
+}
+
+void _write_ring(FILE* f, size_t tid, TraceRing* ring, double ticks_per_us, bool* first) {
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint64_t begin = head > TRACE_RING_CAPACITY ? head - TRACE_RING_CAPACITY : 0;
+
+    fprintf(f, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}}",
+            *first ? "" : ",", tid, ring->name);
+    *first = false;
+
+    for (uint64_t i = begin; i < head; i++) {
+        TraceEvent* e = &ring->events[i % TRACE_RING_CAPACITY];
+        if (e->start < trace_start_ticks) continue;
+
+        double ts = (e->start - trace_start_ticks) / ticks_per_us;
+        double dur = (e->end - e->start) / ticks_per_us;
+        fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%zu,\"ts\":%.3f,\"dur\":%.3f}",
+                e->name, tid, ts, dur);
+    }
+}